@@ -1 +1 @@
-taskset -c 4 ./build/src/scheduler/astraea_scheduler
\ No newline at end of file
+./build/src/scheduler/astraea_scheduler -j config/scheduler.jsonc
\ No newline at end of file
@@ -20,6 +20,19 @@ struct ec_create_config {
     size_t block_size;
     uint32_t nb_tasks;
     uint32_t latency;
+    uint32_t submit_batch_size;
+    uint32_t submit_spin_in_us;
+    /* Collect completions with astraea_pe_poll_completions */
+    bool poll_completions;
+    /* Run each task as a coroutine on astraea_coro.h */
+    bool coroutines;
+    /* Encode on the CPU backend of cpu_ec.h instead of the device */
+    bool cpu_backend;
+    /* CPU threads strips spill to when out of tokens, 0 never spills */
+    uint32_t cpu_spill_threads;
+    /* What the app registers with the scheduler */
+    uint32_t weight;
+    astraea_slo_class slo_class;
 };
 
 /* Helper class to allocate and destroy resources */
@@ -29,10 +42,11 @@ class ec_create_resources {
 
     astraea_ec_matrix *matrix = nullptr;
     astraea_ec *ec = nullptr;
-    std::vector<astraea_ec_task_create *> tasks;
     astraea_ctx *ctx = nullptr;
 
     astraea_pe *pe = nullptr;
+    /* Applied by setup_ec_ctx before the ctx starts */
+    uint32_t nb_spill_threads = 0;
 
     doca_mmap *mmap = nullptr;
     void *mmap_buffer = nullptr;
@@ -17,14 +17,21 @@
 #include <doca_mmap.h>
 #include <doca_types.h>
 
+#include "astraea_coro.h"
 #include "astraea_ctx.h"
 #include "astraea_ec.h"
 #include "astraea_pe.h"
+#include "latency_hist.h"
 
 #include "ec_create.h"
 
 DOCA_LOG_REGISTER(EC_CREATE : CORE);
 
+/* Completions taken per astraea_pe_poll_completions call */
+constexpr uint32_t POLL_BATCH_SIZE = 64;
+/* Room for the frame of encode_one */
+constexpr size_t CORO_FRAME_SIZE = 256;
+
 static void write_to_file(void *data, size_t size, const char *file_name) {
     namespace fs = std::filesystem;
 
@@ -54,7 +61,7 @@ static void write_to_file(void *data, size_t size, const char *file_name) {
     }
 }
 
-/* Tasks will be free in the destructor */
+/* Astraea recycles the task once this returns */
 void ec_create_success_cb(astraea_ec_task_create *task,
                           doca_data task_user_data, doca_data ctx_user_data) {
     (void)task;
@@ -71,6 +78,17 @@ void ec_create_error_cb(astraea_ec_task_create *task, doca_data task_user_data,
     DOCA_LOG_ERR("EC create task failed");
 }
 
+/* The frame comes from pool, nothing else is allocated per task */
+static astraea::coro encode_one(astraea::frame_pool &pool,
+                                ec_create_resources &rscs, doca_buf *dst_buf) {
+    (void)pool;
+    const doca_error_t status = co_await astraea::encode(
+        rscs.ec, rscs.matrix, rscs.mmap, rscs.mmap, rscs.src_buf, dst_buf);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("EC create task failed: %s", doca_error_get_descr(status));
+    }
+}
+
 doca_error_t ec_create(const ec_create_config &cfg) {
     doca_error_t status;
 
@@ -91,12 +109,35 @@ doca_error_t ec_create(const ec_create_config &cfg) {
     }
 
     /* Create and config ec ctx */
-    status = rscs.setup_ec_ctx(ec_create_success_cb, ec_create_error_cb);
+    rscs.nb_spill_threads = cfg.cpu_spill_threads;
+    status = cfg.poll_completions || cfg.coroutines
+                 ? rscs.setup_ec_ctx(nullptr, nullptr)
+                 : rscs.setup_ec_ctx(ec_create_success_cb, ec_create_error_cb);
     if (status != DOCA_SUCCESS) {
         DOCA_LOG_ERR("Failed to setup ec ctx");
         return status;
     }
 
+    status = astraea_ctx_set_submit_batch_size(rscs.ctx, cfg.submit_batch_size);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to set submit batch size");
+        return status;
+    }
+
+    status = astraea_ctx_set_submit_spin(rscs.ctx, cfg.submit_spin_in_us);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to set submit spin");
+        return status;
+    }
+
+    if (cfg.cpu_backend) {
+        status = astraea_ctx_set_ec_backend(rscs.ctx, ASTRAEA_EC_BACKEND_CPU);
+        if (status != DOCA_SUCCESS) {
+            DOCA_LOG_ERR("Failed to set cpu ec backend");
+            return status;
+        }
+    }
+
     /* Setup mmap, buf inventory and bufs */
     status = rscs.prepare_memory(cfg);
     if (status != DOCA_SUCCESS) {
@@ -126,12 +167,25 @@ doca_error_t ec_create(const ec_create_config &cfg) {
 
     auto begin_time = std::chrono::high_resolution_clock::now();
 
-    uint32_t nb_finished_tasks = 0;
-    for (uint32_t i = 0; i < cfg.nb_tasks; i++) {
+    if (cfg.coroutines) {
+        astraea::frame_pool pool{CORO_FRAME_SIZE, cfg.nb_tasks};
+        astraea::executor executor{rscs.pe};
+        for (uint32_t i = 0; i < cfg.nb_tasks; i++) {
+            if (!encode_one(pool, rscs, rscs.dst_bufs[i]).valid()) {
+                DOCA_LOG_ERR("Failed to start coroutine of task %u", i);
+                executor.run(pool);
+                return DOCA_ERROR_NO_MEMORY;
+            }
+        }
+        executor.run(pool);
+    }
+
+    uint32_t nb_finished_tasks = cfg.coroutines ? cfg.nb_tasks : 0;
+    for (uint32_t i = nb_finished_tasks; i < cfg.nb_tasks; i++) {
         astraea_ec_task_create *task;
         status = astraea_ec_task_create_allocate_init(
-            rscs.ec, rscs.matrix, rscs.mmap, rscs.src_buf, rscs.dst_bufs[i],
-            {.ptr = &nb_finished_tasks}, &task);
+            rscs.ec, rscs.matrix, rscs.mmap, rscs.mmap, rscs.src_buf,
+            rscs.dst_bufs[i], {.ptr = &nb_finished_tasks}, &task);
         if (status != DOCA_SUCCESS) {
             DOCA_LOG_ERR("Failed to allocate and init ec task: %s",
                          doca_error_get_descr(status));
@@ -144,12 +198,25 @@ doca_error_t ec_create(const ec_create_config &cfg) {
                          doca_error_get_descr(status));
             return status;
         }
-
-        rscs.tasks.push_back(task);
     }
 
-    while (nb_finished_tasks < cfg.nb_tasks)
-        (void)astraea_pe_progress(rscs.pe);
+    if (cfg.poll_completions) {
+        astraea_completion completions[POLL_BATCH_SIZE];
+        while (nb_finished_tasks < cfg.nb_tasks) {
+            const uint32_t nb_polled = astraea_pe_poll_completions(
+                rscs.pe, completions, POLL_BATCH_SIZE);
+            for (uint32_t i = 0; i < nb_polled; i++) {
+                if (completions[i].status != DOCA_SUCCESS) {
+                    DOCA_LOG_ERR("EC create task failed: %s",
+                                 doca_error_get_descr(completions[i].status));
+                }
+            }
+            nb_finished_tasks += nb_polled;
+        }
+    } else {
+        while (nb_finished_tasks < cfg.nb_tasks)
+            (void)astraea_pe_progress(rscs.pe);
+    }
 
     auto end_time = std::chrono::high_resolution_clock::now();
 
@@ -159,6 +226,31 @@ doca_error_t ec_create(const ec_create_config &cfg) {
             .count() /
         (double)1000000;
     DOCA_LOG_INFO("All tasks finished, taking %fms", time_cost_in_ms);
+
+    const granularity_stats *gran_stats =
+        astraea_ec_get_granularity_stats(rscs.ec);
+    granularity_snapshot last_gran = {};
+    (void)granularity_stats_last(gran_stats, &last_gran);
+    DOCA_LOG_INFO(
+        "Granularity decisions: %lu, whole: %lu, split for sla: %lu, best "
+        "effort: %lu, partial tails: %lu, last strip: %luB x %u",
+        gran_stats->nb_decisions.load(),
+        gran_stats->nb_reasons[GRANULARITY_WHOLE].load(),
+        gran_stats->nb_reasons[GRANULARITY_SPLIT_FOR_SLA].load(),
+        gran_stats->nb_reasons[GRANULARITY_BEST_EFFORT].load(),
+        gran_stats->nb_partial_tails.load(),
+        last_gran.decision.strip_size, last_gran.decision.nb_strips);
+
+    const latency_hist *submit_latency = astraea_ec_get_submit_latency(rscs.ec);
+    DOCA_LOG_INFO("Submit to doorbell latency over %lu strips: p50 %luns, "
+                  "p99 %luns",
+                  latency_hist_count(submit_latency),
+                  latency_hist_percentile(submit_latency, 0.5),
+                  latency_hist_percentile(submit_latency, 0.99));
+    if (cfg.cpu_spill_threads > 0) {
+        DOCA_LOG_INFO("Strips spilled to the cpu: %lu",
+                      astraea_ctx_get_nb_spilled_strips(rscs.ctx));
+    }
     write_to_file(static_cast<uint8_t *>(rscs.mmap_buffer) +
                       cfg.nb_data_blocks * cfg.block_size,
                   cfg.nb_rdnc_blocks * cfg.block_size, "./out/astraea");
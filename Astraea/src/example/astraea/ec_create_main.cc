@@ -1,6 +1,7 @@
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 
 #include <doca_argp.h>
 #include <doca_error.h>
@@ -11,6 +12,11 @@
 
 DOCA_LOG_REGISTER(EC_CREATE : MAIN);
 
+/* Indexed by astraea_slo_class */
+constexpr uint32_t NB_SLO_CLASSES = 3;
+static const char *const slo_class_names[NB_SLO_CLASSES] = {
+    "latency_critical", "throughput", "best_effort"};
+
 static doca_error_t register_param(const char *short_name,
                                    const char *long_name,
                                    const char *description,
@@ -115,6 +121,128 @@ doca_error_t register_ec_create_params() {
         return status;
     }
 
+    status = register_param(
+        "sb", "submit_batch", "strips submitted per doorbell",
+        [](void *param, void *config) -> doca_error_t {
+            ec_create_config *cfg = static_cast<ec_create_config *>(config);
+            uint32_t submit_batch_size = *static_cast<uint32_t *>(param);
+            cfg->submit_batch_size = submit_batch_size;
+            return DOCA_SUCCESS;
+        },
+        DOCA_ARGP_TYPE_INT);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to register submit batch param: %s",
+                     doca_error_get_descr(status));
+        return status;
+    }
+
+    status = register_param(
+        "ss", "submit_spin", "us the idle submitter spins before sleeping",
+        [](void *param, void *config) -> doca_error_t {
+            ec_create_config *cfg = static_cast<ec_create_config *>(config);
+            uint32_t submit_spin_in_us = *static_cast<uint32_t *>(param);
+            cfg->submit_spin_in_us = submit_spin_in_us;
+            return DOCA_SUCCESS;
+        },
+        DOCA_ARGP_TYPE_INT);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to register submit spin param: %s",
+                     doca_error_get_descr(status));
+        return status;
+    }
+
+    status = register_param(
+        "p", "poll", "poll completions instead of completion callbacks",
+        [](void *param, void *config) -> doca_error_t {
+            ec_create_config *cfg = static_cast<ec_create_config *>(config);
+            cfg->poll_completions = *static_cast<bool *>(param);
+            return DOCA_SUCCESS;
+        },
+        DOCA_ARGP_TYPE_BOOLEAN);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to register poll param: %s",
+                     doca_error_get_descr(status));
+        return status;
+    }
+
+    status = register_param(
+        "co", "coro", "run each task as a coroutine awaiting its encode",
+        [](void *param, void *config) -> doca_error_t {
+            ec_create_config *cfg = static_cast<ec_create_config *>(config);
+            cfg->coroutines = *static_cast<bool *>(param);
+            return DOCA_SUCCESS;
+        },
+        DOCA_ARGP_TYPE_BOOLEAN);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to register coro param: %s",
+                     doca_error_get_descr(status));
+        return status;
+    }
+
+    status = register_param(
+        "c", "cpu", "encode with the cpu backend instead of the device",
+        [](void *param, void *config) -> doca_error_t {
+            ec_create_config *cfg = static_cast<ec_create_config *>(config);
+            cfg->cpu_backend = *static_cast<bool *>(param);
+            return DOCA_SUCCESS;
+        },
+        DOCA_ARGP_TYPE_BOOLEAN);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to register cpu param: %s",
+                     doca_error_get_descr(status));
+        return status;
+    }
+
+    status = register_param(
+        "sp", "spill", "cpu threads encoding strips that would miss the sla",
+        [](void *param, void *config) -> doca_error_t {
+            ec_create_config *cfg = static_cast<ec_create_config *>(config);
+            cfg->cpu_spill_threads = *static_cast<uint32_t *>(param);
+            return DOCA_SUCCESS;
+        },
+        DOCA_ARGP_TYPE_INT);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to register spill param: %s",
+                     doca_error_get_descr(status));
+        return status;
+    }
+
+    status = register_param(
+        "w", "weight", "scheduler weight, 1 to 1000",
+        [](void *param, void *config) -> doca_error_t {
+            ec_create_config *cfg = static_cast<ec_create_config *>(config);
+            cfg->weight = *static_cast<uint32_t *>(param);
+            return DOCA_SUCCESS;
+        },
+        DOCA_ARGP_TYPE_INT);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to register weight param: %s",
+                     doca_error_get_descr(status));
+        return status;
+    }
+
+    status = register_param(
+        "slo", "slo_class",
+        "latency_critical, throughput or best_effort",
+        [](void *param, void *config) -> doca_error_t {
+            ec_create_config *cfg = static_cast<ec_create_config *>(config);
+            const char *slo_class = static_cast<const char *>(param);
+            for (uint32_t i = 0; i < NB_SLO_CLASSES; i++) {
+                if (strcmp(slo_class, slo_class_names[i]) == 0) {
+                    cfg->slo_class = (astraea_slo_class)i;
+                    return DOCA_SUCCESS;
+                }
+            }
+            DOCA_LOG_ERR("Unknown SLO class %s", slo_class);
+            return DOCA_ERROR_INVALID_VALUE;
+        },
+        DOCA_ARGP_TYPE_STRING);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to register slo class param: %s",
+                     doca_error_get_descr(status));
+        return status;
+    }
+
     return DOCA_SUCCESS;
 }
 
@@ -149,7 +277,15 @@ int main(int argc, char **argv) {
                             .nb_rdnc_blocks = 32,
                             .block_size = 1024,
                             .nb_tasks = 1,
-                            .latency = 20};
+                            .latency = 20,
+                            .submit_batch_size = DEFAULT_SUBMIT_BATCH_SIZE,
+                            .submit_spin_in_us = 0,
+                            .poll_completions = false,
+                            .coroutines = false,
+                            .cpu_backend = false,
+                            .cpu_spill_threads = 0,
+                            .weight = ASTRAEA_DEFAULT_TENANT_WEIGHT,
+                            .slo_class = ASTRAEA_SLO_THROUGHPUT};
 
     status = doca_argp_init("ec_create", &cfg);
     if (status != DOCA_SUCCESS) {
@@ -173,7 +309,11 @@ int main(int argc, char **argv) {
     }
 
     /* Use the RAII app register object */
-    astraea_authenticator authenticator{cfg.latency, &status};
+    astraea_authenticator authenticator{
+        tenant_params{.latency_sla_in_us = cfg.latency,
+                      .weight = cfg.weight,
+                      .slo_class = cfg.slo_class},
+        &status};
     if (status != DOCA_SUCCESS) {
         DOCA_LOG_ERR("Failed to register app");
         return EXIT_FAILURE;
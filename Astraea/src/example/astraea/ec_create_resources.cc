@@ -26,10 +26,6 @@ static void mock_data(void *buffer, size_t length) {
 ec_create_resources::ec_create_resources() {}
 
 ec_create_resources::~ec_create_resources() {
-    /* Free tasks */
-    for (astraea_ec_task_create *task : tasks)
-        astraea_task_free(astraea_ec_task_create_as_task(task));
-
     /* Destroy ec related resources */
     if (ctx) {
         doca_error_t status = astraea_ctx_stop(ctx);
@@ -191,6 +187,13 @@ doca_error_t ec_create_resources::setup_ec_ctx(
         return status;
     }
 
+    status = astraea_ctx_set_cpu_spill(ctx, nb_spill_threads);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to set cpu spill: %s",
+                     doca_error_get_descr(status));
+        return status;
+    }
+
     status = astraea_ctx_start(ctx);
     if (status != DOCA_SUCCESS) {
         DOCA_LOG_ERR("Failed to start ctx: %s", doca_error_get_descr(status));
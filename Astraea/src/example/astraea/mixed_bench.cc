@@ -0,0 +1,320 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include <doca_buf.h>
+#include <doca_buf_inventory.h>
+#include <doca_error.h>
+#include <doca_log.h>
+#include <doca_mmap.h>
+#include <doca_types.h>
+
+#include "astraea_ctx.h"
+#include "astraea_ec.h"
+#include "astraea_pe.h"
+#include "latency_hist.h"
+#include "resource_mgmt.h"
+
+#include "ec_create.h"
+
+DOCA_LOG_REGISTER(MIXED_BENCH);
+
+/**
+ * Small task latency next to bulk tasks on one ctx, with strips dispatched
+ * in submission order and by deadline. Every bulk task is followed by a
+ * stream of small ones arriving while its strips drain.
+ * Start the scheduler first
+ */
+
+constexpr uint32_t NB_DATA_BLOCKS = 4;
+constexpr uint32_t NB_RDNC_BLOCKS = 2;
+constexpr size_t BIG_BLOCK_SIZE = 1 << 20;
+constexpr size_t SMALL_BLOCK_SIZE = 4096;
+constexpr uint32_t NB_BIG_TASKS = 8;
+constexpr uint32_t NB_SMALL_TASKS_PER_BIG = 64;
+constexpr uint32_t NB_SMALL_TASKS = NB_BIG_TASKS * NB_SMALL_TASKS_PER_BIG;
+constexpr std::chrono::microseconds SMALL_TASK_GAP{10};
+constexpr uint32_t BENCH_LATENCY_IN_US = 100;
+
+using hrc = std::chrono::high_resolution_clock;
+
+struct task_record {
+    hrc::time_point submit_time;
+    latency_hist *hist;
+    uint32_t *nb_finished;
+};
+
+static void task_done_cb(astraea_ec_task_create *task,
+                         doca_data task_user_data, doca_data ctx_user_data) {
+    (void)task;
+    (void)ctx_user_data;
+    task_record *record = static_cast<task_record *>(task_user_data.ptr);
+    latency_hist_record(record->hist,
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            hrc::now() - record->submit_time)
+                            .count());
+    (*record->nb_finished)++;
+}
+
+/**
+ * Big tasks read the whole data region, small ones its head
+ * dst_bufs holds the big tasks' rdnc bufs, then the small ones', then the
+ * small source, so the resources free them all
+ */
+static doca_error_t prepare_memory(ec_create_resources &rscs,
+                                   doca_buf **small_src_buf) {
+    const size_t big_src_size = NB_DATA_BLOCKS * BIG_BLOCK_SIZE;
+    const size_t big_dst_size = NB_RDNC_BLOCKS * BIG_BLOCK_SIZE;
+    const size_t small_src_size = NB_DATA_BLOCKS * SMALL_BLOCK_SIZE;
+    const size_t small_dst_size = NB_RDNC_BLOCKS * SMALL_BLOCK_SIZE;
+    const size_t mmap_size = big_src_size + big_dst_size * NB_BIG_TASKS +
+                             small_dst_size * NB_SMALL_TASKS;
+
+    doca_error_t status = doca_mmap_create(&rscs.mmap);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to create mmap: %s", doca_error_get_descr(status));
+        return status;
+    }
+
+    status = doca_mmap_add_dev(rscs.mmap, rscs.dev);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to add dev: %s", doca_error_get_descr(status));
+        return status;
+    }
+
+    if (posix_memalign(&rscs.mmap_buffer, 64, mmap_size)) {
+        DOCA_LOG_ERR("Failed to alloc memory for mmap");
+        return DOCA_ERROR_NO_MEMORY;
+    }
+    uint8_t *buffer = static_cast<uint8_t *>(rscs.mmap_buffer);
+    for (size_t i = 0; i < big_src_size; i++) {
+        buffer[i] = i;
+    }
+
+    status = doca_mmap_set_memrange(rscs.mmap, buffer, mmap_size);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to set memrange: %s",
+                     doca_error_get_descr(status));
+        return status;
+    }
+
+    status = doca_mmap_start(rscs.mmap);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to start mmap: %s", doca_error_get_descr(status));
+        return status;
+    }
+
+    status = doca_buf_inventory_create(2 + NB_BIG_TASKS + NB_SMALL_TASKS,
+                                       &rscs.buf_inventory);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to create buf inventory: %s",
+                     doca_error_get_descr(status));
+        return status;
+    }
+
+    status = doca_buf_inventory_start(rscs.buf_inventory);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to start buf inventory: %s",
+                     doca_error_get_descr(status));
+        return status;
+    }
+
+    status = doca_buf_inventory_buf_get_by_data(
+        rscs.buf_inventory, rscs.mmap, buffer, big_src_size, &rscs.src_buf);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to alloc big source buf: %s",
+                     doca_error_get_descr(status));
+        return status;
+    }
+
+    uint8_t *dst_addr = buffer + big_src_size;
+    for (uint32_t i = 0; i < NB_BIG_TASKS + NB_SMALL_TASKS; i++) {
+        const size_t dst_size =
+            i < NB_BIG_TASKS ? big_dst_size : small_dst_size;
+        doca_buf *dst_buf;
+        status = doca_buf_inventory_buf_get_by_addr(
+            rscs.buf_inventory, rscs.mmap, dst_addr, dst_size, &dst_buf);
+        if (status != DOCA_SUCCESS) {
+            DOCA_LOG_ERR("Failed to alloc rdnc buf: %s",
+                         doca_error_get_descr(status));
+            return status;
+        }
+        rscs.dst_bufs.push_back(dst_buf);
+        dst_addr += dst_size;
+    }
+
+    status = doca_buf_inventory_buf_get_by_data(
+        rscs.buf_inventory, rscs.mmap, buffer, small_src_size, small_src_buf);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to alloc small source buf: %s",
+                     doca_error_get_descr(status));
+        return status;
+    }
+    rscs.dst_bufs.push_back(*small_src_buf);
+    return DOCA_SUCCESS;
+}
+
+static doca_error_t submit(ec_create_resources &rscs, doca_buf *src_buf,
+                           doca_buf *dst_buf, task_record *record) {
+    doca_error_t status = doca_buf_reset_data_len(dst_buf);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to reset rdnc buf: %s",
+                     doca_error_get_descr(status));
+        return status;
+    }
+
+    astraea_ec_task_create *task;
+    status = astraea_ec_task_create_allocate_init(
+        rscs.ec, rscs.matrix, rscs.mmap, rscs.mmap, src_buf, dst_buf,
+        {.ptr = record}, &task);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to allocate and init ec task: %s",
+                     doca_error_get_descr(status));
+        return status;
+    }
+
+    record->submit_time = hrc::now();
+    status = astraea_task_submit(astraea_ec_task_create_as_task(task));
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to submit task: %s", doca_error_get_descr(status));
+    }
+    return status;
+}
+
+static doca_error_t run(ec_create_resources &rscs, doca_buf *small_src_buf,
+                        astraea_strip_dispatch dispatch,
+                        latency_hist *small_hist, latency_hist *big_hist) {
+    doca_error_t status = astraea_ctx_set_strip_dispatch(rscs.ctx, dispatch);
+    if (status != DOCA_SUCCESS) {
+        return status;
+    }
+
+    static task_record big_records[NB_BIG_TASKS];
+    static task_record small_records[NB_SMALL_TASKS];
+    uint32_t nb_finished = 0;
+
+    for (uint32_t i = 0; i < NB_BIG_TASKS; i++) {
+        big_records[i] = {.submit_time = hrc::time_point{},
+                          .hist = big_hist,
+                          .nb_finished = &nb_finished};
+        status = submit(rscs, rscs.src_buf, rscs.dst_bufs[i], &big_records[i]);
+        if (status != DOCA_SUCCESS) {
+            return status;
+        }
+
+        for (uint32_t j = 0; j < NB_SMALL_TASKS_PER_BIG; j++) {
+            const uint32_t idx = i * NB_SMALL_TASKS_PER_BIG + j;
+            small_records[idx] = {.submit_time = hrc::time_point{},
+                                  .hist = small_hist,
+                                  .nb_finished = &nb_finished};
+            status = submit(rscs, small_src_buf,
+                            rscs.dst_bufs[NB_BIG_TASKS + idx],
+                            &small_records[idx]);
+            if (status != DOCA_SUCCESS) {
+                return status;
+            }
+
+            const hrc::time_point next_time = hrc::now() + SMALL_TASK_GAP;
+            while (hrc::now() < next_time) {
+                (void)astraea_pe_progress(rscs.pe);
+            }
+        }
+    }
+
+    while (nb_finished < NB_BIG_TASKS + NB_SMALL_TASKS) {
+        (void)astraea_pe_progress(rscs.pe);
+    }
+    return DOCA_SUCCESS;
+}
+
+int main() {
+    doca_log_backend *sdk_log;
+    doca_error_t status = doca_log_backend_create_standard();
+    if (status != DOCA_SUCCESS) {
+        printf("Failed to create log standard backend: %s\n",
+               doca_error_get_descr(status));
+        return EXIT_FAILURE;
+    }
+
+    status = doca_log_backend_create_with_file_sdk(stderr, &sdk_log);
+    if (status != DOCA_SUCCESS) {
+        printf("Failed to create log backend with file sdk: %s\n",
+               doca_error_get_descr(status));
+        return EXIT_FAILURE;
+    }
+
+    status = doca_log_backend_set_sdk_level(sdk_log, DOCA_LOG_LEVEL_WARNING);
+    if (status != DOCA_SUCCESS) {
+        printf("Failed to set log backend level: %s",
+               doca_error_get_descr(status));
+        return EXIT_FAILURE;
+    }
+
+    astraea_authenticator authenticator{BENCH_LATENCY_IN_US, &status};
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to register app");
+        return EXIT_FAILURE;
+    }
+
+    ec_create_resources rscs;
+    status = rscs.open_dev();
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to open device");
+        return EXIT_FAILURE;
+    }
+
+    status = astraea_pe_create(&rscs.pe);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to create pe: %s", doca_error_get_descr(status));
+        return EXIT_FAILURE;
+    }
+
+    status = rscs.setup_ec_ctx(task_done_cb, task_done_cb);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to setup ec ctx");
+        return EXIT_FAILURE;
+    }
+
+    doca_buf *small_src_buf;
+    status = prepare_memory(rscs, &small_src_buf);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to prepare bufs");
+        return EXIT_FAILURE;
+    }
+
+    status = astraea_ec_matrix_create(rscs.ec, DOCA_EC_MATRIX_TYPE_CAUCHY,
+                                      NB_DATA_BLOCKS, NB_RDNC_BLOCKS,
+                                      &rscs.matrix);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to create ec matrix: %s",
+                     doca_error_get_descr(status));
+        return EXIT_FAILURE;
+    }
+
+    constexpr astraea_strip_dispatch dispatch_arr[] = {
+        ASTRAEA_STRIP_DISPATCH_FIFO, ASTRAEA_STRIP_DISPATCH_EDF};
+    constexpr const char *dispatch_names[] = {"edf", "fifo"};
+    printf("%-12s%-18s%-18s%-18s\n", "dispatch", "small p50 us",
+           "small p99 us", "big p99 us");
+    for (astraea_strip_dispatch dispatch : dispatch_arr) {
+        static latency_hist small_hist;
+        static latency_hist big_hist;
+        for (uint32_t i = 0; i < NB_LATENCY_HIST_BUCKETS; i++) {
+            small_hist.counts[i].store(0, std::memory_order_relaxed);
+            big_hist.counts[i].store(0, std::memory_order_relaxed);
+        }
+
+        status = run(rscs, small_src_buf, dispatch, &small_hist, &big_hist);
+        if (status != DOCA_SUCCESS) {
+            DOCA_LOG_ERR("%s dispatch failed", dispatch_names[dispatch]);
+            return EXIT_FAILURE;
+        }
+        printf("%-12s%-18.1f%-18.1f%-18.1f\n", dispatch_names[dispatch],
+               latency_hist_percentile(&small_hist, 0.5) / 1000.0,
+               latency_hist_percentile(&small_hist, 0.99) / 1000.0,
+               latency_hist_percentile(&big_hist, 0.99) / 1000.0);
+    }
+    return EXIT_SUCCESS;
+}
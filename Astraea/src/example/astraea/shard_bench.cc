@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <barrier>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+#include <doca_error.h>
+#include <doca_log.h>
+#include <doca_types.h>
+
+#include "astraea_ctx.h"
+#include "astraea_ec.h"
+#include "astraea_pe.h"
+#include "resource_mgmt.h"
+
+#include "ec_create.h"
+
+DOCA_LOG_REGISTER(SHARD_BENCH);
+
+/**
+ * Encode throughput as an app adds pes, one thread driving its own pe, ec
+ * and ctx each, like a storage daemon running one pe per core.
+ * Start the scheduler first, the app's tokens are split across the shards
+ */
+
+constexpr uint32_t NB_TASKS_PER_SHARD = 1024;
+constexpr uint32_t nb_shards_arr[] = {1, 2, 4, 8};
+constexpr ec_create_config shard_cfg = {.nb_data_blocks = 8,
+                                        .nb_rdnc_blocks = 2,
+                                        .block_size = 4096,
+                                        .nb_tasks = NB_TASKS_PER_SHARD,
+                                        .latency = 1000,
+                                        .submit_batch_size =
+                                            DEFAULT_SUBMIT_BATCH_SIZE,
+                                        .submit_spin_in_us = 0,
+                                        .poll_completions = false,
+                                        .coroutines = false,
+                                        .cpu_backend = false,
+                                        .cpu_spill_threads = 0,
+                                        .weight =
+                                            ASTRAEA_DEFAULT_TENANT_WEIGHT,
+                                        .slo_class = ASTRAEA_SLO_THROUGHPUT};
+
+static void task_done_cb(astraea_ec_task_create *task,
+                         doca_data task_user_data, doca_data ctx_user_data) {
+    (void)task;
+    (void)ctx_user_data;
+    (*static_cast<uint32_t *>(task_user_data.ptr))++;
+}
+
+static doca_error_t setup_shard(ec_create_resources &rscs) {
+    doca_error_t status = rscs.open_dev();
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to open device");
+        return status;
+    }
+
+    status = astraea_pe_create(&rscs.pe);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to create pe: %s", doca_error_get_descr(status));
+        return status;
+    }
+
+    status = rscs.setup_ec_ctx(task_done_cb, task_done_cb);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to setup ec ctx");
+        return status;
+    }
+
+    status = rscs.prepare_memory(shard_cfg);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to prepare bufs");
+        return status;
+    }
+
+    status = astraea_ec_matrix_create(rscs.ec, DOCA_EC_MATRIX_TYPE_CAUCHY,
+                                      shard_cfg.nb_data_blocks,
+                                      shard_cfg.nb_rdnc_blocks, &rscs.matrix);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to create ec matrix: %s",
+                     doca_error_get_descr(status));
+    }
+    return status;
+}
+
+static doca_error_t run_shard(ec_create_resources &rscs) {
+    uint32_t nb_finished = 0;
+    for (uint32_t i = 0; i < NB_TASKS_PER_SHARD; i++) {
+        astraea_ec_task_create *task;
+        doca_error_t status = astraea_ec_task_create_allocate_init(
+            rscs.ec, rscs.matrix, rscs.mmap, rscs.mmap, rscs.src_buf,
+            rscs.dst_bufs[i], {.ptr = &nb_finished}, &task);
+        if (status != DOCA_SUCCESS) {
+            DOCA_LOG_ERR("Failed to allocate and init ec task: %s",
+                         doca_error_get_descr(status));
+            return status;
+        }
+
+        /* A full sub task ring drains as the submitter catches up */
+        while ((status = astraea_task_submit(astraea_ec_task_create_as_task(
+                    task))) == DOCA_ERROR_AGAIN) {
+            (void)astraea_pe_progress(rscs.pe);
+        }
+        if (status != DOCA_SUCCESS) {
+            DOCA_LOG_ERR("Failed to submit task: %s",
+                         doca_error_get_descr(status));
+            return status;
+        }
+    }
+
+    while (nb_finished < NB_TASKS_PER_SHARD) {
+        (void)astraea_pe_progress(rscs.pe);
+    }
+    return DOCA_SUCCESS;
+}
+
+static void shard_main(std::barrier<> *start, doca_error_t *status) {
+    ec_create_resources rscs;
+
+    *status = setup_shard(rscs);
+    if (*status != DOCA_SUCCESS) {
+        start->arrive_and_drop();
+        return;
+    }
+
+    start->arrive_and_wait();
+    *status = run_shard(rscs);
+}
+
+/* Tasks per second of nb_shards threads together */
+static doca_error_t run(uint32_t nb_shards, double *tasks_per_s) {
+    std::barrier<> start{nb_shards + 1};
+    std::vector<doca_error_t> statuses(nb_shards, DOCA_SUCCESS);
+    std::vector<std::thread> shards;
+    for (uint32_t i = 0; i < nb_shards; i++) {
+        shards.emplace_back(shard_main, &start, &statuses[i]);
+    }
+
+    start.arrive_and_wait();
+    const auto begin_time = std::chrono::high_resolution_clock::now();
+    for (std::thread &shard : shards) {
+        shard.join();
+    }
+    const double time_cost_in_s =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::high_resolution_clock::now() - begin_time)
+            .count() /
+        (double)1000000000;
+
+    for (doca_error_t status : statuses) {
+        if (status != DOCA_SUCCESS) {
+            return status;
+        }
+    }
+    *tasks_per_s = nb_shards * NB_TASKS_PER_SHARD / time_cost_in_s;
+    return DOCA_SUCCESS;
+}
+
+int main() {
+    doca_log_backend *sdk_log;
+    doca_error_t status = doca_log_backend_create_standard();
+    if (status != DOCA_SUCCESS) {
+        printf("Failed to create log standard backend: %s\n",
+               doca_error_get_descr(status));
+        return EXIT_FAILURE;
+    }
+
+    status = doca_log_backend_create_with_file_sdk(stderr, &sdk_log);
+    if (status != DOCA_SUCCESS) {
+        printf("Failed to create log backend with file sdk: %s\n",
+               doca_error_get_descr(status));
+        return EXIT_FAILURE;
+    }
+
+    status = doca_log_backend_set_sdk_level(sdk_log, DOCA_LOG_LEVEL_WARNING);
+    if (status != DOCA_SUCCESS) {
+        printf("Failed to set log backend level: %s",
+               doca_error_get_descr(status));
+        return EXIT_FAILURE;
+    }
+
+    astraea_authenticator authenticator{shard_cfg.latency, &status};
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to register app");
+        return EXIT_FAILURE;
+    }
+
+    const double data_size_in_mb =
+        shard_cfg.nb_data_blocks * shard_cfg.block_size / (double)(1 << 20);
+    double base_tasks_per_s = 0;
+    printf("%-12s%-16s%-16s%-16s\n", "shards", "Ktasks/s", "MiB/s", "speedup");
+    for (uint32_t nb_shards : nb_shards_arr) {
+        if (nb_shards > std::max(std::thread::hardware_concurrency(), 1U)) {
+            break;
+        }
+        double tasks_per_s;
+        status = run(nb_shards, &tasks_per_s);
+        if (status != DOCA_SUCCESS) {
+            DOCA_LOG_ERR("%u shards failed", nb_shards);
+            return EXIT_FAILURE;
+        }
+        if (base_tasks_per_s == 0) {
+            base_tasks_per_s = tasks_per_s;
+        }
+        printf("%-12u%-16.2f%-16.2f%-16.2f\n", nb_shards, tasks_per_s / 1000,
+               tasks_per_s * data_size_in_mb, tasks_per_s / base_tasks_per_s);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,210 @@
+#ifndef ASTRAEA_H__
+#define ASTRAEA_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <doca_buf.h>
+#include <doca_dev.h>
+#include <doca_erasure_coding.h>
+#include <doca_error.h>
+#include <doca_mmap.h>
+#include <doca_types.h>
+
+/**
+ * C interface of Astraea, for apps written against the DOCA C samples
+ * The C++ headers include this one first so both see the same declarations,
+ * see them for the documentation of each call
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct astraea_pe;
+struct astraea_ctx;
+struct astraea_task;
+struct astraea_ec;
+struct astraea_ec_matrix;
+struct astraea_ec_task;
+
+#define ASTRAEA_DEFAULT_TENANT_WEIGHT 1
+#define ASTRAEA_MAX_TENANT_WEIGHT 1000
+
+/* Order the submitter hands strips of different tasks to the engine */
+enum astraea_strip_dispatch {
+    /* Earliest deadline first, the default */
+    ASTRAEA_STRIP_DISPATCH_EDF,
+    /* Submission order */
+    ASTRAEA_STRIP_DISPATCH_FIFO,
+};
+
+/* What runs the strips of an ec ctx */
+enum astraea_ec_backend {
+    /* The DOCA engine, the default */
+    ASTRAEA_EC_BACKEND_DOCA,
+    /* The submitter thread, Cauchy matrices only */
+    ASTRAEA_EC_BACKEND_CPU,
+};
+
+/* What a tenant needs from the scheduler */
+enum astraea_slo_class {
+    /* Its weight's share is reserved before the others are served */
+    ASTRAEA_SLO_LATENCY_CRITICAL,
+    /* Served by weight, the default */
+    ASTRAEA_SLO_THROUGHPUT,
+    /* Served by weight, counted as an eighth of it */
+    ASTRAEA_SLO_BEST_EFFORT,
+};
+
+/* A completed task collected with astraea_pe_poll_completions */
+struct astraea_completion {
+    struct astraea_task *task;
+    union doca_data user_data;
+    /* Of the first failed strip, DOCA_SUCCESS if none failed */
+    doca_error_t status;
+};
+
+/* Every ec operation shares one task type, named after DOCA's */
+typedef struct astraea_ec_task astraea_ec_task_create;
+typedef struct astraea_ec_task astraea_ec_task_recover;
+typedef struct astraea_ec_task astraea_ec_task_update;
+
+typedef void (*astraea_ec_task_create_completion_cb_t)(
+    astraea_ec_task_create *task, union doca_data task_user_data,
+    union doca_data ctx_user_data);
+typedef void (*astraea_ec_task_recover_completion_cb_t)(
+    astraea_ec_task_recover *task, union doca_data task_user_data,
+    union doca_data ctx_user_data);
+typedef void (*astraea_ec_task_update_completion_cb_t)(
+    astraea_ec_task_update *task, union doca_data task_user_data,
+    union doca_data ctx_user_data);
+
+/* Join the scheduler, every task must complete within latency_in_us */
+doca_error_t astraea_register(uint32_t latency_in_us);
+
+/* Same with a weight of 1 to ASTRAEA_MAX_TENANT_WEIGHT and an SLO class */
+doca_error_t astraea_register_tenant(uint32_t latency_in_us, uint32_t weight,
+                                     enum astraea_slo_class slo_class);
+
+void astraea_deregister(void);
+
+doca_error_t astraea_pe_create(struct astraea_pe **pe);
+
+doca_error_t astraea_pe_destroy(struct astraea_pe *pe);
+
+uint32_t astraea_pe_progress(struct astraea_pe *pe);
+
+uint32_t astraea_pe_poll_completions(struct astraea_pe *pe,
+                                     struct astraea_completion out[],
+                                     uint32_t max);
+
+doca_error_t astraea_pe_connect_ctx(struct astraea_pe *pe,
+                                    struct astraea_ctx *ctx);
+
+doca_error_t astraea_task_submit(struct astraea_task *task);
+
+void astraea_task_free(struct astraea_task *task);
+
+doca_error_t astraea_ctx_start(struct astraea_ctx *ctx);
+
+doca_error_t astraea_ctx_stop(struct astraea_ctx *ctx);
+
+doca_error_t astraea_ctx_set_user_data(struct astraea_ctx *ctx,
+                                       union doca_data user_data);
+
+doca_error_t astraea_ctx_set_submit_batch_size(struct astraea_ctx *ctx,
+                                               uint32_t batch_size);
+
+doca_error_t astraea_ctx_set_submit_spin(struct astraea_ctx *ctx,
+                                         uint32_t max_spin_in_us);
+
+doca_error_t
+astraea_ctx_set_strip_dispatch(struct astraea_ctx *ctx,
+                               enum astraea_strip_dispatch dispatch);
+
+doca_error_t astraea_ctx_set_ec_backend(struct astraea_ctx *ctx,
+                                        enum astraea_ec_backend backend);
+
+doca_error_t astraea_ctx_set_cpu_spill(struct astraea_ctx *ctx,
+                                       uint32_t nb_threads);
+
+uint64_t astraea_ctx_get_nb_spilled_strips(const struct astraea_ctx *ctx);
+
+doca_error_t astraea_ec_create(struct doca_dev *dev, struct astraea_ec **ec);
+
+doca_error_t astraea_ec_destroy(struct astraea_ec *ec);
+
+struct astraea_ctx *astraea_ec_as_ctx(struct astraea_ec *ec);
+
+doca_error_t astraea_ec_task_create_set_conf(
+    struct astraea_ec *ec,
+    astraea_ec_task_create_completion_cb_t successful_task_completion_cb,
+    astraea_ec_task_create_completion_cb_t error_task_completion_cb,
+    uint32_t num_tasks);
+
+doca_error_t astraea_ec_task_recover_set_conf(
+    struct astraea_ec *ec,
+    astraea_ec_task_recover_completion_cb_t successful_task_completion_cb,
+    astraea_ec_task_recover_completion_cb_t error_task_completion_cb,
+    uint32_t num_tasks);
+
+doca_error_t astraea_ec_task_update_set_conf(
+    struct astraea_ec *ec,
+    astraea_ec_task_update_completion_cb_t successful_task_completion_cb,
+    astraea_ec_task_update_completion_cb_t error_task_completion_cb,
+    uint32_t num_tasks);
+
+doca_error_t astraea_ec_task_create_allocate_init(
+    struct astraea_ec *ec, struct astraea_ec_matrix *coding_matrix,
+    struct doca_mmap *src_mmap, struct doca_mmap *dst_mmap,
+    struct doca_buf *original_data_blocks, struct doca_buf *rdnc_blocks,
+    union doca_data user_data, astraea_ec_task_create **task);
+
+doca_error_t astraea_ec_task_recover_allocate_init(
+    struct astraea_ec *ec, struct astraea_ec_matrix *recover_matrix,
+    struct doca_mmap *src_mmap, struct doca_mmap *dst_mmap,
+    struct doca_buf *available_blocks, struct doca_buf *recovered_data_blocks,
+    union doca_data user_data, astraea_ec_task_recover **task);
+
+doca_error_t astraea_ec_task_update_allocate_init(
+    struct astraea_ec *ec, struct astraea_ec_matrix *update_matrix,
+    struct doca_mmap *src_mmap, struct doca_mmap *dst_mmap,
+    struct doca_buf *original_updated_and_rdnc_blocks,
+    struct doca_buf *updated_rdnc_blocks, union doca_data user_data,
+    astraea_ec_task_update **task);
+
+struct astraea_task *
+astraea_ec_task_create_as_task(astraea_ec_task_create *task);
+
+struct astraea_task *
+astraea_ec_task_recover_as_task(astraea_ec_task_recover *task);
+
+struct astraea_task *
+astraea_ec_task_update_as_task(astraea_ec_task_update *task);
+
+doca_error_t astraea_ec_matrix_create(struct astraea_ec *ec,
+                                      enum doca_ec_matrix_type type,
+                                      size_t data_block_count,
+                                      size_t rdnc_block_count,
+                                      struct astraea_ec_matrix **matrix);
+
+doca_error_t
+astraea_ec_matrix_create_recover(struct astraea_ec *ec,
+                                 const struct astraea_ec_matrix *coding_matrix,
+                                 uint32_t missing_indices[], size_t n_missing,
+                                 struct astraea_ec_matrix **matrix);
+
+doca_error_t
+astraea_ec_matrix_create_update(struct astraea_ec *ec,
+                                const struct astraea_ec_matrix *coding_matrix,
+                                uint32_t update_indices[], size_t n_updates,
+                                struct astraea_ec_matrix **matrix);
+
+doca_error_t astraea_ec_matrix_destroy(struct astraea_ec_matrix *matrix);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,84 @@
+#include <coroutine>
+#include <cstdint>
+
+#include <doca_error.h>
+#include <doca_log.h>
+#include <doca_types.h>
+
+#include "astraea_coro.h"
+#include "astraea_ec.h"
+#include "astraea_pe.h"
+
+DOCA_LOG_REGISTER(ASTRAEA : CORO);
+
+namespace astraea {
+
+bool ec_op::await_suspend(std::coroutine_handle<> awaiting) noexcept {
+    const doca_data user_data = {.ptr = this};
+    astraea_task *task;
+    switch (type) {
+    case EC_CREATE: {
+        astraea_ec_task_create *create_task;
+        status = astraea_ec_task_create_allocate_init(
+            ec, matrix, src_mmap, dst_mmap, src_blocks, dst_blocks, user_data,
+            &create_task);
+        task = status == DOCA_SUCCESS
+                   ? astraea_ec_task_create_as_task(create_task)
+                   : nullptr;
+        break;
+    }
+    case EC_RECOVER: {
+        astraea_ec_task_recover *recover_task;
+        status = astraea_ec_task_recover_allocate_init(
+            ec, matrix, src_mmap, dst_mmap, src_blocks, dst_blocks, user_data,
+            &recover_task);
+        task = status == DOCA_SUCCESS
+                   ? astraea_ec_task_recover_as_task(recover_task)
+                   : nullptr;
+        break;
+    }
+    case EC_UPDATE: {
+        astraea_ec_task_update *update_task;
+        status = astraea_ec_task_update_allocate_init(
+            ec, matrix, src_mmap, dst_mmap, src_blocks, dst_blocks, user_data,
+            &update_task);
+        task = status == DOCA_SUCCESS
+                   ? astraea_ec_task_update_as_task(update_task)
+                   : nullptr;
+        break;
+    }
+    default:
+        status = DOCA_ERROR_INVALID_VALUE;
+        return false;
+    }
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to allocate and init ec task: %s",
+                     doca_error_get_descr(status));
+        return false;
+    }
+
+    /* Completions are only polled by this thread, after this returns */
+    handle = awaiting;
+    status = astraea_task_submit(task);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to submit ec task: %s",
+                     doca_error_get_descr(status));
+        astraea_task_free(task);
+        return false;
+    }
+    return true;
+}
+
+uint32_t executor::poll() {
+    const uint32_t nb_completed =
+        astraea_pe_poll_completions(pe, completions, EXECUTOR_BATCH_SIZE);
+    for (uint32_t i = 0; i < nb_completed; i++) {
+        ec_op *op = static_cast<ec_op *>(completions[i].user_data.ptr);
+        op->status = completions[i].status;
+        /* May submit the coroutine's next op or end it */
+        op->handle.resume();
+    }
+    return nb_completed;
+}
+
+} // namespace astraea
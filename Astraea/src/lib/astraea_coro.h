@@ -0,0 +1,217 @@
+#ifndef ASTRAEA_CORO_H__
+#define ASTRAEA_CORO_H__
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+#include <doca_buf.h>
+#include <doca_error.h>
+#include <doca_mmap.h>
+
+#include "astraea_ec.h"
+#include "astraea_pe.h"
+#include "chunk_arena.h"
+
+/**
+ * Coroutine front-end of the ec ops
+ *
+ *   astraea::coro encode_all(astraea::frame_pool &pool, ...) {
+ *       doca_error_t status = co_await astraea::encode(ec, matrix, ...);
+ *   }
+ *
+ * An op is submitted when awaited and its coroutine is resumed by the
+ * executor polling the ctx's pe, a batch of completions per poll. The ec
+ * must be configured with null callbacks, see astraea_pe_poll_completions.
+ * Nothing is allocated per op: the awaiter lives in the coroutine frame and
+ * the task in the ec's slots. Frames come from a frame_pool, passed as the
+ * coroutine's first argument.
+ * Coroutines of one pe are created and resumed by one thread.
+ */
+
+namespace astraea {
+
+constexpr uint32_t EXECUTOR_BATCH_SIZE = 64;
+
+/**
+ * Free list of fixed size frames carved from chunk_arena chunks
+ * Frames are only allocated when the free list is empty, so the pool grows
+ * to the most coroutines alive at once and stays there
+ */
+class frame_pool {
+  private:
+    /* Every frame starts with its pool, so a frame is freed without it */
+    struct alignas(std::max_align_t) frame_header {
+        frame_pool *pool;
+        frame_header *next_free;
+    };
+
+    chunk_arena<frame_header> arena;
+    frame_header *free_frames = nullptr;
+    /* In frame_header units, header included */
+    size_t frame_units;
+    uint32_t nb_used = 0;
+
+  public:
+    /* Frames of coroutines using this pool must fit in frame_size bytes */
+    frame_pool(size_t frame_size, uint32_t nb_frames_per_chunk)
+        : frame_units(1 + (frame_size + sizeof(frame_header) - 1) /
+                              sizeof(frame_header)) {
+        arena.set_chunk_size(frame_units * nb_frames_per_chunk);
+    }
+    frame_pool(const frame_pool &) = delete;
+    frame_pool &operator=(const frame_pool &) = delete;
+
+    /* nullptr if size doesn't fit a frame or a chunk can't be allocated */
+    void *get(size_t size) noexcept {
+        if (size > (frame_units - 1) * sizeof(frame_header)) {
+            return nullptr;
+        }
+        frame_header *header = free_frames;
+        if (header != nullptr) {
+            free_frames = header->next_free;
+        } else {
+            header = arena.alloc(frame_units);
+            if (header == nullptr) {
+                return nullptr;
+            }
+        }
+        header->pool = this;
+        nb_used++;
+        return header + 1;
+    }
+
+    static void put(void *frame) noexcept {
+        frame_header *header = static_cast<frame_header *>(frame) - 1;
+        frame_pool *pool = header->pool;
+        header->next_free = pool->free_frames;
+        pool->free_frames = header;
+        pool->nb_used--;
+    }
+
+    /* Coroutines still running */
+    uint32_t size() const { return nb_used; }
+};
+
+/**
+ * Fire and forget coroutine, runs until its first co_await when called and
+ * returns its frame to the pool when it ends.
+ * Invalid if no frame could be taken, the coroutine didn't run then
+ */
+class coro {
+  private:
+    bool is_started;
+
+    explicit coro(bool is_started) : is_started(is_started) {}
+
+  public:
+    struct promise_type {
+        template <typename... Args>
+        static void *operator new(size_t size, frame_pool &pool,
+                                  Args &...) noexcept {
+            return pool.get(size);
+        }
+
+        static void operator delete(void *frame, size_t) noexcept {
+            frame_pool::put(frame);
+        }
+
+        static coro get_return_object_on_allocation_failure() noexcept {
+            return coro{false};
+        }
+
+        coro get_return_object() noexcept { return coro{true}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        /* The library is built without exceptions in mind */
+        void unhandled_exception() noexcept { std::abort(); }
+    };
+
+    bool valid() const { return is_started; }
+};
+
+/* Awaiter of one ec op, resumes with the op's status */
+class ec_op {
+  private:
+    task_type type;
+    astraea_ec *ec;
+    astraea_ec_matrix *matrix;
+    doca_mmap *src_mmap;
+    doca_mmap *dst_mmap;
+    doca_buf *src_blocks;
+    doca_buf *dst_blocks;
+    doca_error_t status = DOCA_SUCCESS;
+    std::coroutine_handle<> handle;
+
+    friend class executor;
+
+  public:
+    ec_op(task_type type, astraea_ec *ec, astraea_ec_matrix *matrix,
+          doca_mmap *src_mmap, doca_mmap *dst_mmap, doca_buf *src_blocks,
+          doca_buf *dst_blocks)
+        : type(type), ec(ec), matrix(matrix), src_mmap(src_mmap),
+          dst_mmap(dst_mmap), src_blocks(src_blocks), dst_blocks(dst_blocks) {
+    }
+
+    bool await_ready() const noexcept { return false; }
+
+    /* Doesn't suspend if the op couldn't be submitted */
+    bool await_suspend(std::coroutine_handle<> awaiting) noexcept;
+
+    doca_error_t await_resume() const noexcept { return status; }
+};
+
+/* Same arguments as the allocate_init calls, without the user data */
+inline ec_op encode(astraea_ec *ec, astraea_ec_matrix *coding_matrix,
+                    doca_mmap *src_mmap, doca_mmap *dst_mmap,
+                    doca_buf *original_data_blocks, doca_buf *rdnc_blocks) {
+    return ec_op(EC_CREATE, ec, coding_matrix, src_mmap, dst_mmap,
+                 original_data_blocks, rdnc_blocks);
+}
+
+inline ec_op recover(astraea_ec *ec, astraea_ec_matrix *recover_matrix,
+                     doca_mmap *src_mmap, doca_mmap *dst_mmap,
+                     doca_buf *available_blocks,
+                     doca_buf *recovered_data_blocks) {
+    return ec_op(EC_RECOVER, ec, recover_matrix, src_mmap, dst_mmap,
+                 available_blocks, recovered_data_blocks);
+}
+
+inline ec_op update(astraea_ec *ec, astraea_ec_matrix *update_matrix,
+                    doca_mmap *src_mmap, doca_mmap *dst_mmap,
+                    doca_buf *original_updated_and_rdnc_blocks,
+                    doca_buf *updated_rdnc_blocks) {
+    return ec_op(EC_UPDATE, ec, update_matrix, src_mmap, dst_mmap,
+                 original_updated_and_rdnc_blocks, updated_rdnc_blocks);
+}
+
+/**
+ * Resumes the coroutines whose ops completed on one pe
+ * Coroutines resumed by a poll must not poll the same executor
+ */
+class executor {
+  private:
+    astraea_pe *pe;
+    astraea_completion completions[EXECUTOR_BATCH_SIZE];
+
+  public:
+    explicit executor(astraea_pe *pe) : pe(pe) {}
+    executor(const executor &) = delete;
+    executor &operator=(const executor &) = delete;
+
+    /* Never blocks, returns the number of coroutines resumed */
+    uint32_t poll();
+
+    /* Poll until every coroutine of the pool ended */
+    void run(const frame_pool &pool) {
+        while (pool.size() > 0) {
+            (void)poll();
+        }
+    }
+};
+
+} // namespace astraea
+
+#endif
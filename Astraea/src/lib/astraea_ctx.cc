@@ -1,10 +1,11 @@
+#include <algorithm>
 #include <chrono>
 #include <cstddef>
 #include <cstdint>
-#include <mutex>
-#include <semaphore.h>
+#include <limits>
 #include <stop_token>
 #include <thread>
+#include <vector>
 
 #include <doca_ctx.h>
 #include <doca_error.h>
@@ -13,48 +14,289 @@
 
 #include "astraea_ctx.h"
 #include "astraea_ec.h"
+#include "astraea_pe.h"
+#include "cpu_spill.h"
 #include "doca_erasure_coding.h"
+#include "latency_hist.h"
 #include "resource_mgmt.h"
+#include "task_stats.h"
+#include "token_shard.h"
+#include "wakeup.h"
 
 DOCA_LOG_REGISTER(ASTRAEA : CTX);
 
-extern sem_t *ec_token_sem;
 extern shared_resources *shm_data;
-extern uint32_t app_id;
 
+/* Bounds an idle sleep in case a post is lost, stop posts anyway */
+constexpr int64_t IDLE_TIMEOUT_IN_NS = 100000000;
+/* A full engine frees slots as strips complete */
+constexpr std::chrono::microseconds ENGINE_FULL_RETRY{10};
+/* Where an adaptive spin grows back from once it was halved away */
+constexpr int64_t MIN_SUBMIT_SPIN_IN_NS = 1000;
+
+enum drain_result {
+    /* Every queued strip was submitted */
+    DRAIN_EMPTY,
+    /* The next strip waits for a refill */
+    DRAIN_NO_TOKENS,
+    /* An engine is full, the device's or the CPU's, try again shortly */
+    DRAIN_RETRY,
+};
+
+using hrc = std::chrono::high_resolution_clock;
+
+/* How long a strip waited to reach an engine, the device or a CPU one */
+static void record_dispatch(astraea_ctx *ctx, astraea_ec_task *task,
+                            hrc::time_point now) {
+    const int64_t waited_in_ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(now -
+                                                             task->submit_time)
+            .count();
+    latency_hist_record(&ctx->ec->submit_latency, waited_in_ns);
+    if (task->first_dispatch_time == hrc::time_point{}) {
+        task->first_dispatch_time = now;
+        task_stats_record(task->general_task.type, task->origin_block_size,
+                          task->nb_subtasks, TASK_PHASE_QUEUED, waited_in_ns);
+    }
+}
+
+/**
+ * Ring the doorbell and record how long each strip waited for it
+ * The pe is still owned, so none of the tasks can have completed yet
+ */
+static void flush(astraea_ctx *ctx, astraea_ec_task *const *tasks,
+                  uint32_t nb_unflushed) {
+    doca_ctx_flush_tasks(ctx->ctx);
+    const hrc::time_point now = hrc::now();
+    for (uint32_t i = 0; i < nb_unflushed; i++) {
+        record_dispatch(ctx, tasks[i], now);
+    }
+}
+
+/* Heap order of dispatch_heap, the task on top goes first */
+struct dispatch_later {
+    astraea_strip_dispatch dispatch;
+
+    bool operator()(const astraea_ec_task *a, const astraea_ec_task *b) const {
+        if (dispatch == ASTRAEA_STRIP_DISPATCH_EDF &&
+            a->dispatch_deadline != b->dispatch_deadline) {
+            return a->dispatch_deadline > b->dispatch_deadline;
+        }
+        return a->submit_seq > b->submit_seq;
+    }
+};
+
+/* Move newly submitted tasks into the dispatch heap */
+static void admit_tasks(astraea_ec *ec, const dispatch_later &later) {
+    astraea_ec_task *task;
+    while ((task = ec->submitted_tasks.front()) != nullptr) {
+        ec->submitted_tasks.pop();
+        ec->dispatch_heap.push_back(task);
+        std::push_heap(ec->dispatch_heap.begin(), ec->dispatch_heap.end(),
+                       later);
+    }
+}
+
+/**
+ * Whether the task's strips left, waiting for grants, end past its expected
+ * time. The next grant comes within a period, each later one per grant's
+ * worth of tokens; strips of a task cost about the same
+ */
+static bool is_late_for_tokens(astraea_ctx *ctx, const astraea_ec_task *task,
+                               uint32_t cost) {
+    uint32_t nb_avail_tokens;
+    uint32_t nb_granted_tokens;
+    token_shard_estimate(&ctx->tokens, &nb_avail_tokens, &nb_granted_tokens);
+    nb_granted_tokens = std::max(nb_granted_tokens, 1U);
+    const uint64_t nb_left_tokens =
+        (uint64_t)cost * (task->nb_subtasks - task->nb_dispatched_subtasks);
+    const uint64_t nb_periods =
+        (nb_left_tokens + nb_granted_tokens - 1) / nb_granted_tokens;
+    return hrc::now() + std::chrono::nanoseconds(
+                            nb_periods * shm_data->refresh_period_in_ns) >
+           task->expected_time;
+}
+
+/**
+ * Submit queued strips while tokens last, one doorbell per batch
+ * The pe is owned per batch, so completions are polled in between, and
+ * tasks submitted meanwhile compete for the next batch
+ */
+static drain_result drain_ec(astraea_ctx *ctx, dispatch_later &later) {
+    astraea_ec *ec = ctx->ec;
+    std::vector<astraea_ec_task *> &heap = ec->dispatch_heap;
+    const auto begin_time = std::chrono::steady_clock::now();
+    const uint32_t batch_size =
+        ctx->submit_batch_size.load(std::memory_order_relaxed);
+    astraea_ec_task *batch_tasks[MAX_SUBMIT_BATCH_SIZE];
+    uint32_t nb_submitted = 0;
+    uint32_t nb_spilled_tokens = 0;
+    drain_result result = DRAIN_EMPTY;
+    bool is_drained = false;
+
+    const bool is_cpu = ctx->ec_backend.load(std::memory_order_relaxed) ==
+                        ASTRAEA_EC_BACKEND_CPU;
+    const astraea_strip_dispatch dispatch =
+        ctx->strip_dispatch.load(std::memory_order_relaxed);
+    if (dispatch != later.dispatch) {
+        later.dispatch = dispatch;
+        std::make_heap(heap.begin(), heap.end(), later);
+    }
+
+    while (!is_drained) {
+        admit_tasks(ec, later);
+        astraea_pe_acquire_for_submit(ctx->pe);
+
+        /* Of the batch, only strips handed to DOCA wait for the doorbell */
+        uint32_t nb_batched = 0;
+        uint32_t nb_unflushed = 0;
+        while (nb_batched < batch_size) {
+            if (heap.empty()) {
+                is_drained = true;
+                break;
+            }
+            /* Like a full engine, until progress finishes the CPU's strips */
+            if (is_cpu && ctx->pe->cpu_strips.size() ==
+                              ctx->pe->cpu_strips.capacity()) {
+                result = DRAIN_RETRY;
+                is_drained = true;
+                break;
+            }
+            astraea_ec_task *task = heap.front();
+            _astraea_ec_subtask &subtask =
+                task->subtasks[task->nb_dispatched_subtasks];
+            const uint32_t cost = subtask.user_data.token_cost;
+            doca_error_t status = DOCA_SUCCESS;
+            token_receipt receipt = {};
+            bool is_doca = false;
+            if (!token_shard_take(&ctx->tokens, cost, &receipt)) {
+                /* A strip waits for a period with enough tokens left */
+                /* So does one the CPU can't encode, like non Cauchy ones */
+                if (is_cpu || ctx->spill.threads.empty() ||
+                    task->matrix->cpu_coefs.empty() ||
+                    !is_late_for_tokens(ctx, task, cost) ||
+                    !cpu_spill_push(&ctx->spill, &subtask)) {
+                    result = DRAIN_NO_TOKENS;
+                    is_drained = true;
+                    break;
+                }
+                /* A spill thread encodes it, its tokens charged as CPU work */
+                nb_spilled_tokens += cost;
+            } else if (is_cpu) {
+                /* Its error, if any, is the task's, progress reports it */
+                ctx->pe->cpu_strips.push_back(
+                    {&subtask, run_cpu_subtask(&subtask)});
+            } else {
+                /* Queued strips reach the engine at the next flush */
+                status = doca_task_submit_ex(subtask.task,
+                                             DOCA_TASK_SUBMIT_FLAG_NONE);
+                is_doca = true;
+            }
+            if (status != DOCA_SUCCESS) {
+                /* Usually a full engine, refund the strip for the retry */
+                DOCA_LOG_ERR("Failed to submit sub task: %s",
+                             doca_error_get_descr(status));
+                token_shard_refund(&ctx->tokens, receipt);
+                result = DRAIN_RETRY;
+                is_drained = true;
+                break;
+            }
+            ec->nb_queued_tokens.fetch_sub(cost, std::memory_order_relaxed);
+            nb_batched++;
+            if (is_doca) {
+                batch_tasks[nb_unflushed++] = task;
+            } else {
+                /* Already with a CPU engine, no doorbell to wait for */
+                record_dispatch(ctx, task, hrc::now());
+            }
+
+            /* Off the heap before the doorbell, it may complete right away */
+            if (++task->nb_dispatched_subtasks == task->nb_subtasks) {
+                std::pop_heap(heap.begin(), heap.end(), later);
+                heap.pop_back();
+            }
+        }
+        if (nb_unflushed > 0) {
+            flush(ctx, batch_tasks, nb_unflushed);
+            nb_submitted += nb_unflushed;
+        }
+
+        astraea_pe_release_for_submit(ctx->pe);
+    }
+
+    if (nb_spilled_tokens > 0) {
+        token_shard_charge_spill(nb_spilled_tokens);
+    }
+    if (nb_submitted > 0) {
+        /* Moving average over 1/8 of each new sample */
+        const uint64_t sample =
+            std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - begin_time)
+                .count() /
+            nb_submitted;
+        const uint64_t prev =
+            ec->strip_overhead_in_ns.load(std::memory_order_relaxed);
+        ec->strip_overhead_in_ns.store(
+            prev == 0 ? sample : prev - prev / 8 + sample / 8,
+            std::memory_order_relaxed);
+    }
+    return result;
+}
+
+/**
+ * Sleeps on the event that can unblock it: a submit when the queue is
+ * empty, a refill from the scheduler when tokens ran out
+ */
 static void worker(std::stop_token stoken, astraea_ctx *ctx) {
+    wakeup *submit_wakeup = &ctx->ec->submit_wakeup;
+    /* Waiting for tokens ends within a period anyway */
+    std::stop_callback wake_on_stop{
+        stoken, [submit_wakeup]() { wakeup_post(submit_wakeup, false); }};
+    int64_t spin_in_ns = std::numeric_limits<int64_t>::max();
+    dispatch_later later{
+        ctx->strip_dispatch.load(std::memory_order_relaxed)};
+
     while (!stoken.stop_requested()) {
+        /* Read before draining, so posts during the drain aren't missed */
+        const uint32_t submit_seq = wakeup_prepare(submit_wakeup);
+        const uint32_t refill_seq = wakeup_prepare(&shm_data->refill_wakeup);
+
+        drain_result result = DRAIN_EMPTY;
         switch (ctx->type) {
         case EC:
-            if (sem_wait(ec_token_sem)) {
-                DOCA_LOG_ERR("Failed to get ec_token_sem");
-                break;
-            }
+            result = drain_ec(ctx, later);
+            break;
+        }
 
-            std::lock_guard<std::mutex> task_queue_guard{
-                ctx->ec->ec_create_tasks_lock};
-            std::lock_guard<std::mutex> ctx_guard{ctx->ctx_lock};
-
-            while (shm_data->ec_tokens[app_id] > 0 &&
-                   !ctx->ec->ec_create_tasks.empty()) {
-                doca_error_t status =
-                    doca_task_submit(doca_ec_task_create_as_task(
-                        ctx->ec->ec_create_tasks.front()));
-                if (status == DOCA_SUCCESS) {
-                    ctx->ec->ec_create_tasks.pop();
-                    shm_data->ec_tokens[app_id]--;
-                } else {
-                    DOCA_LOG_ERR("Failed to submit sub task: %s",
-                                 doca_error_get_descr(status));
-                }
-            }
+        if (result == DRAIN_NO_TOKENS) {
+            (void)wakeup_wait(&shm_data->refill_wakeup, refill_seq,
+                              shm_data->refresh_period_in_ns, true);
+            continue;
+        }
+        if (result == DRAIN_RETRY) {
+            std::this_thread::sleep_for(ENGINE_FULL_RETRY);
+            continue;
+        }
 
-            if (sem_post(ec_token_sem)) {
-                DOCA_LOG_ERR("Failed to post ec_token_sem");
-                break;
+        const int64_t max_spin_in_ns =
+            (int64_t)ctx->max_submit_spin_in_us.load(
+                std::memory_order_relaxed) *
+            1000;
+        if (max_spin_in_ns > 0) {
+            spin_in_ns = std::min(spin_in_ns, max_spin_in_ns);
+            if (wakeup_spin(submit_wakeup, submit_seq, spin_in_ns)) {
+                spin_in_ns = std::min(
+                    std::max(spin_in_ns * 2, MIN_SUBMIT_SPIN_IN_NS),
+                    max_spin_in_ns);
+                continue;
             }
+            spin_in_ns /= 2;
+        }
+        if (token_shard_count() > 1) {
+            token_shard_release(&ctx->tokens);
         }
-        std::this_thread::sleep_for(std::chrono::microseconds(100));
+        (void)wakeup_wait(submit_wakeup, submit_seq, IDLE_TIMEOUT_IN_NS,
+                          false);
     }
 }
 
@@ -63,6 +305,8 @@ doca_error_t astraea_ctx_start(astraea_ctx *ctx) {
     if (status != DOCA_SUCCESS) {
         return status;
     }
+    token_shard_join(&ctx->tokens);
+    cpu_spill_start(&ctx->spill, ctx->nb_spill_threads);
     ctx->submitter = new std::jthread{worker, ctx};
     return status;
 }
@@ -77,20 +321,84 @@ doca_error_t astraea_ctx_stop(astraea_ctx *ctx) {
         ctx->submitter->request_stop();
         delete ctx->submitter;
         ctx->submitter = nullptr;
+        token_shard_leave(&ctx->tokens);
+        /* Spilled strips complete, their callbacks may call into DOCA */
+        const bool is_acquired = astraea_pe_acquire_for_app(ctx->pe);
+        cpu_spill_stop(&ctx->spill);
+        astraea_pe_release_for_app(ctx->pe, is_acquired);
     }
 
     if (ctx->type == EC) {
-        for (uint32_t i = 0; i < MAX_NB_INFLIGHT_EC_TASKS; i++) {
-            astraea_ec_task_create *task = ctx->ec->task_pool[i];
-            for (uint32_t j = 0; j < MAX_NB_SUBTASKS_PER_TASK; j++) {
-                _astraea_ec_subtask_create *subtask = task->subtask_pool[j];
-                if (subtask->task) {
-                    doca_task_free(doca_ec_task_create_as_task(subtask->task));
-                }
-            }
+        /* Undispatched tasks are dropped with the DOCA tasks below */
+        ctx->ec->dispatch_heap.clear();
+        while (ctx->ec->submitted_tasks.front() != nullptr) {
+            ctx->ec->submitted_tasks.pop();
         }
+        ctx->ec->subtask_arena.for_each([](_astraea_ec_subtask &subtask) {
+            if (subtask.task) {
+                doca_task_free(subtask.task);
+                subtask.task = nullptr;
+            }
+        });
     }
 
     /* Astraea will release astraea_ctx's memory in astraea_pe_progress */
     return doca_ctx_stop(ctx->ctx);
+}
+
+doca_error_t astraea_ctx_set_submit_batch_size(astraea_ctx *ctx,
+                                               uint32_t batch_size) {
+    if (batch_size == 0 || batch_size > MAX_SUBMIT_BATCH_SIZE) {
+        DOCA_LOG_ERR("Submit batch size must be in [1, %u]",
+                     MAX_SUBMIT_BATCH_SIZE);
+        return DOCA_ERROR_INVALID_VALUE;
+    }
+    ctx->submit_batch_size.store(batch_size, std::memory_order_relaxed);
+    return DOCA_SUCCESS;
+}
+
+doca_error_t astraea_ctx_set_submit_spin(astraea_ctx *ctx,
+                                         uint32_t max_spin_in_us) {
+    ctx->max_submit_spin_in_us.store(max_spin_in_us,
+                                     std::memory_order_relaxed);
+    return DOCA_SUCCESS;
+}
+
+doca_error_t astraea_ctx_set_strip_dispatch(astraea_ctx *ctx,
+                                            astraea_strip_dispatch dispatch) {
+    if (dispatch != ASTRAEA_STRIP_DISPATCH_EDF &&
+        dispatch != ASTRAEA_STRIP_DISPATCH_FIFO) {
+        DOCA_LOG_ERR("Unknown strip dispatch %d", dispatch);
+        return DOCA_ERROR_INVALID_VALUE;
+    }
+    ctx->strip_dispatch.store(dispatch, std::memory_order_relaxed);
+    return DOCA_SUCCESS;
+}
+
+doca_error_t astraea_ctx_set_ec_backend(astraea_ctx *ctx,
+                                        astraea_ec_backend backend) {
+    if (backend != ASTRAEA_EC_BACKEND_DOCA &&
+        backend != ASTRAEA_EC_BACKEND_CPU) {
+        DOCA_LOG_ERR("Unknown ec backend %d", backend);
+        return DOCA_ERROR_INVALID_VALUE;
+    }
+    ctx->ec_backend.store(backend, std::memory_order_relaxed);
+    return DOCA_SUCCESS;
+}
+
+doca_error_t astraea_ctx_set_cpu_spill(astraea_ctx *ctx, uint32_t nb_threads) {
+    if (ctx->submitter) {
+        DOCA_LOG_ERR("Cpu spill must be set before the ctx starts");
+        return DOCA_ERROR_BAD_STATE;
+    }
+    ctx->nb_spill_threads = nb_threads;
+    return DOCA_SUCCESS;
+}
+
+uint64_t astraea_ctx_get_nb_spilled_strips(const astraea_ctx *ctx) {
+    return ctx->spill.nb_spilled_strips.load(std::memory_order_relaxed);
+}
+
+doca_error_t astraea_ctx_set_user_data(astraea_ctx *ctx, doca_data user_data) {
+    return doca_ctx_set_user_data(ctx->ctx, user_data);
 }
\ No newline at end of file
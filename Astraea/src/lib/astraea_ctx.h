@@ -1,32 +1,95 @@
 #ifndef ASTRAEA_CTX_H__
 #define ASTRAEA_CTX_H__
 
-#include <mutex>
+#include <atomic>
+#include <cstdint>
 #include <stop_token>
 #include <thread>
 
 #include <doca_ctx.h>
 #include <doca_error.h>
+#include <doca_types.h>
 
-/**
- * Forward declarations
- */
-struct astraea_ec;
+#include "astraea.h"
+#include "cpu_spill.h"
+#include "token_shard.h"
+
+/* Strips submitted per doorbell unless the app sets otherwise */
+constexpr uint32_t DEFAULT_SUBMIT_BATCH_SIZE = 128;
+/* Bounds the submitter's per batch bookkeeping */
+constexpr uint32_t MAX_SUBMIT_BATCH_SIZE = 1024;
 
 enum ctx_type { EC };
 
 struct astraea_ctx {
     doca_ctx *ctx;
     std::jthread *submitter;
+    /* Set by astraea_pe_connect_ctx, its owner word guards ctx */
+    astraea_pe *pe;
     ctx_type type;
     union {
         astraea_ec *ec;
     };
-    std::mutex ctx_lock;
+    /* Most strips the submitter queues before ringing the doorbell */
+    std::atomic<uint32_t> submit_batch_size;
+    /* Longest the idle submitter spins before sleeping, 0 sleeps at once */
+    std::atomic<uint32_t> max_submit_spin_in_us;
+    std::atomic<astraea_strip_dispatch> strip_dispatch;
+    std::atomic<astraea_ec_backend> ec_backend;
+    /* Encoder threads strips spill to, set before the ctx starts */
+    uint32_t nb_spill_threads;
+    cpu_spill_pool spill;
+    /* This ctx's slice of the app's tokens while started */
+    token_shard tokens;
 };
 
 doca_error_t astraea_ctx_start(astraea_ctx *ctx);
 
 doca_error_t astraea_ctx_stop(astraea_ctx *ctx);
 
+/**
+ * The submitter rings the doorbell once per batch_size strips, or once for
+ * all the strips the tokens left allow if that is fewer
+ */
+doca_error_t astraea_ctx_set_submit_batch_size(astraea_ctx *ctx,
+                                               uint32_t batch_size);
+
+/**
+ * The idle submitter sleeps until a task is submitted. With a spin, it
+ * first busy waits up to max_spin_in_us, trading a core for the futex
+ * wakeup. The spin adapts: halved after each one that catches nothing,
+ * doubled back after each one that does
+ */
+doca_error_t astraea_ctx_set_submit_spin(astraea_ctx *ctx,
+                                         uint32_t max_spin_in_us);
+
+/**
+ * With EDF, strips of concurrent tasks interleave by deadline so small
+ * tasks overtake bulk ones, strips of one task still go in order
+ */
+doca_error_t astraea_ctx_set_strip_dispatch(astraea_ctx *ctx,
+                                            astraea_strip_dispatch dispatch);
+
+/**
+ * With the CPU backend the submitter encodes each strip itself once it has
+ * its tokens, and the pe completes it at its next progress, so token pacing
+ * and completions behave as with the engine
+ */
+doca_error_t astraea_ctx_set_ec_backend(astraea_ctx *ctx,
+                                        astraea_ec_backend backend);
+
+/**
+ * Out of tokens, a strip whose task would finish after its expected time
+ * waiting for the next grants is encoded by one of nb_threads CPU threads
+ * instead, 0 disables it. Spilled tokens are reported to the scheduler,
+ * which counts them as service. Only before astraea_ctx_start
+ */
+doca_error_t astraea_ctx_set_cpu_spill(astraea_ctx *ctx, uint32_t nb_threads);
+
+/* Strips encoded by the spill threads so far */
+uint64_t astraea_ctx_get_nb_spilled_strips(const astraea_ctx *ctx);
+
+/* Passed as ctx_user_data to the completion callbacks of the ctx's tasks */
+doca_error_t astraea_ctx_set_user_data(astraea_ctx *ctx, doca_data user_data);
+
 #endif
\ No newline at end of file
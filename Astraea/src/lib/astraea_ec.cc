@@ -1,3 +1,6 @@
+#include <algorithm>
+#include <atomic>
+#include <bit>
 #include <chrono>
 #include <cstddef>
 #include <cstdint>
@@ -16,145 +19,382 @@
 #include "astraea_ctx.h"
 #include "astraea_ec.h"
 #include "astraea_pe.h"
+#include "cost_table.h"
+#include "cpu_ec.h"
 #include "resource_mgmt.h"
+#include "task_stats.h"
+#include "token_shard.h"
 
 DOCA_LOG_REGISTER(ASTRAEA : EC);
 
-extern sem_t *ec_deficit_sem;
 extern shared_resources *shm_data;
 extern uint32_t app_id;
-extern sem_t *ec_token_sem;
-
-extern bool has_finished_task;
-
-void subtask_success_cb(doca_ec_task_create *task, doca_data task_user_data,
-                        doca_data ctx_user_data) {
-    (void)ctx_user_data;
-    const _astraea_ec_subtask_create_user_data *user_data =
-        static_cast<_astraea_ec_subtask_create_user_data *>(task_user_data.ptr);
-
-    if (user_data->is_sub) {
-        const doca_buf *sub_dst_buf = doca_ec_task_create_get_rdnc_blocks(task);
-        uint8_t *dst_data;
-        doca_buf_get_data(sub_dst_buf, (void **)&dst_data);
-
-        const size_t origin_block_size =
-            user_data->origin_task->origin_block_size;
-        const size_t sub_block_size = user_data->origin_task->sub_block_size;
-        const uint32_t nb_rdnc_blocks =
-            user_data->origin_task->matrix->nb_rdnc_blocks;
-        uint8_t *dst_base_addr =
-            static_cast<uint8_t *>(user_data->origin_task->dst_base_addr);
-
-        for (uint32_t i = 0; i < nb_rdnc_blocks; i++) {
-            memcpy(dst_base_addr + i * origin_block_size +
-                       user_data->strip_id * sub_block_size,
-                   dst_data + i * sub_block_size, sub_block_size);
+
+extern std::chrono::microseconds latency_sla;
+
+/* The pe the ec's ctx is connected to, null before that */
+static astraea_pe *ec_pe(const astraea_ec *ec) {
+    return ec->ctx ? ec->ctx->pe : nullptr;
+}
+
+/**
+ * Slots of completed tasks go back to the free list for the next allocate
+ * A slot that ran a large split task gives most of its DOCA tasks back, or
+ * a few of them would hold the whole pool
+ */
+void put_task_slot(astraea_ec_task *task) {
+    if (task->src_sgl) {
+        sgl_cache_put(&task->ec->src_sgl_cache, task->src_sgl);
+        task->src_sgl = nullptr;
+    }
+    for (uint32_t i = MAX_NB_KEPT_SUBTASKS_PER_SLOT; i < task->subtask_capacity;
+         i++) {
+        _astraea_ec_subtask &subtask = task->subtasks[i];
+        if (subtask.task) {
+            doca_task_free(subtask.task);
+            subtask.task = nullptr;
         }
     }
+    task->slot_state.store(TASK_SLOT_FREE, std::memory_order_release);
+    /* Never fails, the ring holds every slot that can exist */
+    task->ec->free_tasks.push(task);
+}
 
-    if (user_data->is_last) {
-        auto cur_time = std::chrono::high_resolution_clock::now();
-        if (cur_time > user_data->origin_task->expected_time) {
-            if (sem_wait(ec_deficit_sem)) {
-                DOCA_LOG_ERR("Failed to get ec_token_sem");
-                return;
-            }
+/* Unpack a strip that init_task staged as nb_dst_blocks packed pieces */
+static void copy_staged_strip(const _astraea_ec_subtask_user_data *user_data) {
+    const astraea_ec_task *origin_task = user_data->origin_task;
+    const size_t origin_block_size = origin_task->origin_block_size;
+    const size_t sub_block_size = origin_task->sub_block_size;
+    const uint32_t nb_dst_blocks = origin_task->matrix->nb_dst_blocks;
+    /* The last strip may be shorter */
+    const size_t strip_offset = user_data->strip_id * sub_block_size;
+    const size_t strip_size =
+        std::min(sub_block_size, origin_block_size - strip_offset);
+    const uint8_t *staged_data =
+        static_cast<uint8_t *>(origin_task->ec->tmp_rdnc_buffer) +
+        strip_offset * nb_dst_blocks;
+
+    for (uint32_t i = 0; i < nb_dst_blocks; i++) {
+        memcpy(origin_task->dst_base_addr + i * origin_block_size +
+                   strip_offset,
+               staged_data + i * strip_size, strip_size);
+    }
+}
 
-            shm_data->deficits[app_id]++;
+/* Device and total latency, from the thread progressing the pe */
+static void
+record_completion(const astraea_ec_task *task,
+                  std::chrono::high_resolution_clock::time_point cur_time) {
+    const task_type type = task->general_task.type;
+    task_stats_record(type, task->origin_block_size, task->nb_subtasks,
+                      TASK_PHASE_DEVICE,
+                      std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          cur_time - task->first_dispatch_time)
+                          .count());
+    task_stats_record(type, task->origin_block_size, task->nb_subtasks,
+                      TASK_PHASE_TOTAL,
+                      std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          cur_time - task->submit_time)
+                          .count());
+}
 
-            if (sem_post(ec_deficit_sem)) {
-                DOCA_LOG_ERR("Failed to post ec_token_sem");
-                return;
-            }
+/**
+ * The origin task completes once all of its strips completed, whatever
+ * order the engine finishes them in
+ */
+static void finish_subtask(_astraea_ec_subtask_user_data *user_data,
+                           doca_error_t status, doca_data ctx_user_data) {
+    astraea_ec_task *origin_task = user_data->origin_task;
+    if (status != DOCA_SUCCESS) {
+        /* The first failed strip tells why */
+        if (origin_task->status == DOCA_SUCCESS) {
+            origin_task->status = status;
         }
+    } else if (user_data->is_staged) {
+        copy_staged_strip(user_data);
+    }
+
+    if (++origin_task->nb_finished_subtasks < origin_task->nb_subtasks) {
+        return;
+    }
+
+    const task_type type = origin_task->general_task.type;
+    const auto cur_time = std::chrono::high_resolution_clock::now();
+    record_completion(origin_task, cur_time);
+
+    astraea_ec_task_completion_cb_t cb;
+    if (origin_task->status != DOCA_SUCCESS) {
+        cb = origin_task->ec->error_cbs[type];
+    } else {
+        if (cur_time > origin_task->expected_time) {
+            shm_data->deficits[app_id].fetch_add(1, std::memory_order_relaxed);
+        }
+        cb = origin_task->ec->success_cbs[type];
+    }
+
+    astraea_pe *pe = origin_task->ec->ctx->pe;
+    pe->nb_completed++;
+    if (cb == nullptr) {
+        /* Its slot goes back once astraea_pe_poll_completions is done */
+        astraea_pe_push_completion(pe, {.task = &origin_task->general_task,
+                                        .user_data = origin_task->user_data,
+                                        .status = origin_task->status});
+        return;
+    }
+
+    cb(origin_task, origin_task->user_data, ctx_user_data);
+    /* The user is done with the task once its callback returns */
+    put_task_slot(origin_task);
+}
+
+static doca_task *as_doca_task(doca_ec_task_create *task) {
+    return doca_ec_task_create_as_task(task);
+}
+
+static doca_task *as_doca_task(doca_ec_task_recover *task) {
+    return doca_ec_task_recover_as_task(task);
+}
+
+static doca_task *as_doca_task(doca_ec_task_update *task) {
+    return doca_ec_task_update_as_task(task);
+}
+
+/* Registered for the DOCA task type of every op */
+template <typename doca_ec_task_t>
+static void subtask_success_cb(doca_ec_task_t *task, doca_data task_user_data,
+                               doca_data ctx_user_data) {
+    (void)task;
+    finish_subtask(
+        static_cast<_astraea_ec_subtask_user_data *>(task_user_data.ptr),
+        DOCA_SUCCESS, ctx_user_data);
+}
+
+template <typename doca_ec_task_t>
+static void subtask_error_cb(doca_ec_task_t *task, doca_data task_user_data,
+                             doca_data ctx_user_data) {
+    const doca_error_t status = doca_task_get_status(as_doca_task(task));
+    finish_subtask(
+        static_cast<_astraea_ec_subtask_user_data *>(task_user_data.ptr),
+        status == DOCA_SUCCESS ? DOCA_ERROR_UNKNOWN : status, ctx_user_data);
+}
 
-        user_data->origin_task->ec->success_cb(
-            user_data->origin_task, user_data->origin_task->user_data,
-            {.u64 = 0});
-        has_finished_task = true;
+/* The longest source list, an update's 2u + m blocks */
+constexpr uint32_t MAX_NB_CPU_BLOCKS =
+    2 * MAX_NB_DATA_BLOCKS + MAX_NB_RDNC_BLOCKS;
+
+static size_t list_data_len(doca_buf *list) {
+    size_t total = 0;
+    for (doca_buf *buf = list; buf != nullptr;) {
+        size_t data_len = 0;
+        if (doca_buf_get_data_len(buf, &data_len) != DOCA_SUCCESS ||
+            doca_buf_get_next_in_list(buf, &buf) != DOCA_SUCCESS) {
+            return 0;
+        }
+        total += data_len;
     }
+    return total;
 }
 
-void subtask_error_cb(doca_ec_task_create *task, doca_data task_user_data,
-                      doca_data ctx_user_data) {
-    (void)ctx_user_data;
-    _astraea_ec_subtask_create_user_data *user_data =
-        static_cast<_astraea_ec_subtask_create_user_data *>(task_user_data.ptr);
+/**
+ * Cut a buf list into nb_blocks blocks of block_size, in list order
+ * Sources are read from each buf's data, outputs are appended after it and
+ * counted in its data right away, as the engine would
+ */
+static bool gather_blocks(doca_buf *list, bool is_dst, size_t block_size,
+                          uint32_t nb_blocks, uint8_t **blocks) {
+    uint32_t nb_gathered = 0;
+    for (doca_buf *buf = list; buf != nullptr && nb_gathered < nb_blocks;) {
+        void *data;
+        size_t data_len;
+        if (doca_buf_get_data(buf, &data) != DOCA_SUCCESS ||
+            doca_buf_get_data_len(buf, &data_len) != DOCA_SUCCESS) {
+            return false;
+        }
+        uint8_t *begin = static_cast<uint8_t *>(data);
+        size_t room = data_len;
+        if (is_dst) {
+            void *head;
+            size_t len;
+            if (doca_buf_get_head(buf, &head) != DOCA_SUCCESS ||
+                doca_buf_get_len(buf, &len) != DOCA_SUCCESS) {
+                return false;
+            }
+            begin += data_len;
+            room = static_cast<uint8_t *>(head) + len - begin;
+        }
 
-    if (user_data->is_last) {
-        user_data->origin_task->ec->error_cb(user_data->origin_task,
-                                             user_data->origin_task->user_data,
-                                             {.u64 = 0});
-        has_finished_task = true;
+        const uint32_t nb_in_buf =
+            std::min<size_t>(room / block_size, nb_blocks - nb_gathered);
+        for (uint32_t i = 0; i < nb_in_buf; i++) {
+            blocks[nb_gathered++] = begin + i * block_size;
+        }
+        if (is_dst && nb_in_buf > 0 &&
+            doca_buf_set_data(buf, data, data_len + nb_in_buf * block_size) !=
+                DOCA_SUCCESS) {
+            return false;
+        }
+        if (doca_buf_get_next_in_list(buf, &buf) != DOCA_SUCCESS) {
+            return false;
+        }
     }
+    return nb_gathered == nb_blocks;
 }
 
-doca_error_t astraea_ec_create(doca_dev *dev, astraea_ec **ec) {
-    astraea_ec *new_ec = new astraea_ec;
-    *ec = nullptr;
+doca_error_t run_cpu_subtask(_astraea_ec_subtask *subtask) {
+    const astraea_ec_matrix *matrix = subtask->user_data.origin_task->matrix;
+    if (matrix->cpu_coefs.empty()) {
+        return DOCA_ERROR_NOT_SUPPORTED;
+    }
 
-    new_ec->dev = dev;
+    /* The bufs the DOCA task was built with, so both backends agree */
+    doca_buf *src;
+    doca_buf *dst;
+    switch (subtask->type) {
+    case EC_CREATE:
+        src = const_cast<doca_buf *>(
+            doca_ec_task_create_get_original_data_blocks(
+                subtask->create_task));
+        dst = doca_ec_task_create_get_rdnc_blocks(subtask->create_task);
+        break;
+    case EC_RECOVER:
+        src = const_cast<doca_buf *>(
+            doca_ec_task_recover_get_available_blocks(subtask->recover_task));
+        dst = doca_ec_task_recover_get_recovered_data(subtask->recover_task);
+        break;
+    case EC_UPDATE:
+        src = const_cast<doca_buf *>(
+            doca_ec_task_update_get_original_updated_and_rdnc_blocks(
+                subtask->update_task));
+        dst = doca_ec_task_update_get_updated_rdnc_blocks(
+            subtask->update_task);
+        break;
+    default:
+        return DOCA_ERROR_INVALID_VALUE;
+    }
 
-    doca_error_t status = doca_ec_create(dev, &new_ec->ec);
-    if (status != DOCA_SUCCESS) {
-        delete new_ec;
-        return status;
+    const uint32_t nb_src = matrix->nb_src_blocks;
+    const uint32_t nb_dst = matrix->nb_dst_blocks;
+    const size_t src_len = list_data_len(src);
+    if (nb_src > MAX_NB_CPU_BLOCKS || nb_dst > MAX_NB_CPU_BLOCKS ||
+        src_len == 0 || src_len % nb_src != 0) {
+        return DOCA_ERROR_INVALID_VALUE;
+    }
+    const size_t block_size = src_len / nb_src;
+
+    uint8_t *src_blocks[MAX_NB_CPU_BLOCKS];
+    uint8_t *dst_blocks[MAX_NB_CPU_BLOCKS];
+    if (!gather_blocks(src, false, block_size, nb_src, src_blocks) ||
+        !gather_blocks(dst, true, block_size, nb_dst, dst_blocks)) {
+        return DOCA_ERROR_INVALID_VALUE;
+    }
+    cpu_ec_apply(matrix->cpu_coefs.data(), nb_src, nb_dst, block_size,
+                 src_blocks, dst_blocks);
+    return DOCA_SUCCESS;
+}
+
+void finish_cpu_subtask(_astraea_ec_subtask *subtask, doca_error_t status) {
+    doca_data ctx_user_data = {.ptr = nullptr};
+    (void)doca_ctx_get_user_data(
+        subtask->user_data.origin_task->ec->ctx->ctx, &ctx_user_data);
+    finish_subtask(&subtask->user_data, status, ctx_user_data);
+}
+
+/* Return a strip's buf list to the inventory */
+static void release_strip_buf(_astraea_ec_strip_buf &strip_buf) {
+    if (strip_buf.buf) {
+        doca_buf_dec_refcount(strip_buf.buf, nullptr);
+        strip_buf.buf = nullptr;
     }
+}
 
-    int ret =
-        posix_memalign(&new_ec->tmp_rdnc_buffer, 64, TMP_RDNC_BUFFER_SIZE);
+/**
+ * The staging buffer is only needed by strips whose parity can't be written
+ * in place, so it is set up the first time such a strip shows up
+ */
+static doca_error_t prepare_tmp_rdnc_buffer(astraea_ec *ec) {
+    int ret = posix_memalign(&ec->tmp_rdnc_buffer, 64, TMP_RDNC_BUFFER_SIZE);
     if (ret) {
         DOCA_LOG_ERR("Failed to alloc memory");
-        doca_ec_destroy(new_ec->ec);
-        delete new_ec;
-        return status;
+        ec->tmp_rdnc_buffer = nullptr;
+        return DOCA_ERROR_NO_MEMORY;
     }
-    status = doca_mmap_create(&new_ec->dst_mmap);
+
+    doca_error_t status = doca_mmap_create(&ec->tmp_rdnc_mmap);
     if (status != DOCA_SUCCESS) {
-        DOCA_LOG_ERR("Failed to create dst mmap: %s",
+        DOCA_LOG_ERR("Failed to create tmp rdnc mmap: %s",
                      doca_error_get_descr(status));
-        doca_ec_destroy(new_ec->ec);
-        delete new_ec;
+        ec->tmp_rdnc_mmap = nullptr;
         return status;
     }
 
-    status = doca_mmap_add_dev(new_ec->dst_mmap, dev);
+    status = doca_mmap_add_dev(ec->tmp_rdnc_mmap, ec->dev);
     if (status != DOCA_SUCCESS) {
-        DOCA_LOG_ERR("Failed to add dev to dst mmap: %s",
+        DOCA_LOG_ERR("Failed to add dev to tmp rdnc mmap: %s",
                      doca_error_get_descr(status));
-        doca_mmap_destroy(new_ec->dst_mmap);
-        doca_ec_destroy(new_ec->ec);
-        delete new_ec;
         return status;
     }
 
-    status = doca_mmap_set_memrange(new_ec->dst_mmap, new_ec->tmp_rdnc_buffer,
+    status = doca_mmap_set_memrange(ec->tmp_rdnc_mmap, ec->tmp_rdnc_buffer,
                                     TMP_RDNC_BUFFER_SIZE);
     if (status != DOCA_SUCCESS) {
         DOCA_LOG_ERR("Failed to set mmap memrange: %s",
                      doca_error_get_descr(status));
-        doca_mmap_destroy(new_ec->dst_mmap);
-        doca_ec_destroy(new_ec->ec);
-        delete new_ec;
         return status;
     }
 
-    status = doca_mmap_start(new_ec->dst_mmap);
+    status = doca_mmap_start(ec->tmp_rdnc_mmap);
     if (status != DOCA_SUCCESS) {
-        DOCA_LOG_ERR("Failed to start dst mmap: %s",
+        DOCA_LOG_ERR("Failed to start tmp rdnc mmap: %s",
                      doca_error_get_descr(status));
-        doca_mmap_destroy(new_ec->dst_mmap);
-        doca_ec_destroy(new_ec->ec);
+        return status;
+    }
+
+    return DOCA_SUCCESS;
+}
+
+doca_error_t astraea_ec_create(doca_dev *dev, astraea_ec **ec) {
+    astraea_ec *new_ec = new astraea_ec;
+    *ec = nullptr;
+
+    new_ec->dev = dev;
+    new_ec->ctx = nullptr;
+    for (uint32_t i = 0; i < NB_TASK_TYPES; i++) {
+        new_ec->success_cbs[i] = nullptr;
+        new_ec->error_cbs[i] = nullptr;
+    }
+
+    if (!new_ec->submitted_tasks.init(MAX_NB_INFLIGHT_EC_TASKS)) {
+        DOCA_LOG_ERR("Failed to alloc submitted task ring");
+        delete new_ec;
+        return DOCA_ERROR_NO_MEMORY;
+    }
+    new_ec->nb_submitted_tasks.store(0, std::memory_order_relaxed);
+    /* The submitter never allocates, a task is queued at most once */
+    new_ec->dispatch_heap.reserve(MAX_NB_INFLIGHT_EC_TASKS);
+
+    doca_error_t status = doca_ec_create(dev, &new_ec->ec);
+    if (status != DOCA_SUCCESS) {
         delete new_ec;
         return status;
     }
 
+    status = doca_ec_cap_get_max_buf_list_len(doca_dev_as_devinfo(dev),
+                                              &new_ec->max_buf_list_len);
+    if (status != DOCA_SUCCESS) {
+        /* Unknown list support, always stage parity in tmp_rdnc_buffer */
+        DOCA_LOG_WARN("Failed to get max buf list len: %s",
+                      doca_error_get_descr(status));
+        new_ec->max_buf_list_len = 1;
+    }
+    new_ec->tmp_rdnc_buffer = nullptr;
+    new_ec->tmp_rdnc_mmap = nullptr;
+    new_ec->is_tmp_rdnc_prepared = false;
+    new_ec->tmp_rdnc_status = DOCA_SUCCESS;
+
     status = doca_buf_inventory_create(MAX_NB_CTX_BUFS, &new_ec->buf_inventory);
     if (status != DOCA_SUCCESS) {
         DOCA_LOG_ERR("Failed to create buf inventory: %s",
                      doca_error_get_descr(status));
-        doca_mmap_destroy(new_ec->dst_mmap);
         doca_ec_destroy(new_ec->ec);
         delete new_ec;
         return status;
@@ -165,24 +405,40 @@ doca_error_t astraea_ec_create(doca_dev *dev, astraea_ec **ec) {
         DOCA_LOG_ERR("Failed to start buf inventory: %s",
                      doca_error_get_descr(status));
         doca_buf_inventory_destroy(new_ec->buf_inventory);
-        doca_mmap_destroy(new_ec->dst_mmap);
         doca_ec_destroy(new_ec->ec);
         delete new_ec;
         return status;
     }
 
-    new_ec->cur_task_pos = 0;
-    for (uint32_t i = 0; i < MAX_NB_INFLIGHT_EC_TASKS; i++) {
-        new_ec->task_pool[i] = new astraea_ec_task_create;
-        new_ec->task_pool[i]->cur_subtask_pos = 0;
-        new_ec->task_pool[i]->is_free = false;
-        for (uint32_t j = 0; j < MAX_NB_SUBTASKS_PER_TASK; j++) {
-            new_ec->task_pool[i]->subtask_pool[j] =
-                new _astraea_ec_subtask_create;
-            new_ec->task_pool[i]->subtask_pool[j]->user_data =
-                new _astraea_ec_subtask_create_user_data;
-            new_ec->task_pool[i]->subtask_pool[j]->task = nullptr;
-        }
+    sgl_cache_init(&new_ec->src_sgl_cache, new_ec->buf_inventory,
+                   MAX_NB_SGL_CACHE_BUFS);
+
+    if (!new_ec->free_tasks.init(MAX_NB_INFLIGHT_EC_TASKS)) {
+        DOCA_LOG_ERR("Failed to alloc free task ring");
+        doca_buf_inventory_destroy(new_ec->buf_inventory);
+        doca_ec_destroy(new_ec->ec);
+        delete new_ec;
+        return DOCA_ERROR_NO_MEMORY;
+    }
+    new_ec->nb_task_slots = 0;
+    new_ec->nb_conf_tasks = 0;
+    new_ec->nb_queued_tokens.store(0, std::memory_order_relaxed);
+    new_ec->strip_overhead_in_ns.store(0, std::memory_order_relaxed);
+    new_ec->submit_wakeup.seq.store(0, std::memory_order_relaxed);
+    new_ec->submit_wakeup.nb_sleepers.store(0, std::memory_order_relaxed);
+    new_ec->task_arena.set_chunk_size(MAX_NB_INFLIGHT_EC_TASKS);
+    new_ec->subtask_arena.set_chunk_size(SUBTASK_ARENA_CHUNK_SIZE);
+
+    new_ec->cost_table = new ec_cost_table;
+    const char *cost_table_path = getenv(EC_COST_TABLE_ENV);
+    if (cost_table_path == nullptr) {
+        cost_table_path = DEFAULT_EC_COST_TABLE_PATH;
+    }
+    if (ec_cost_table_load(new_ec->cost_table, cost_table_path) !=
+        DOCA_SUCCESS) {
+        DOCA_LOG_WARN("No usable cost table at %s, charge by bytes instead",
+                      cost_table_path);
+        ec_cost_table_init_default(new_ec->cost_table);
     }
 
     *ec = new_ec;
@@ -191,28 +447,21 @@ doca_error_t astraea_ec_create(doca_dev *dev, astraea_ec **ec) {
 }
 
 doca_error_t astraea_ec_destroy(astraea_ec *ec) {
-    for (uint32_t i = 0; i < MAX_NB_INFLIGHT_EC_TASKS; i++) {
-        astraea_ec_task_create *task = ec->task_pool[i];
-        for (uint32_t j = 0; j < MAX_NB_SUBTASKS_PER_TASK; j++) {
-            _astraea_ec_subtask_create *subtask = task->subtask_pool[j];
-            /* DOCA tasks are free in astraea_ctx_stop */
-            delete subtask->user_data;
-            delete subtask;
-        }
-        for (std::pair<doca_buf *, doca_buf *> sub_buf_pair :
-             task->sub_buf_pairs) {
-            doca_buf_dec_refcount(sub_buf_pair.first, nullptr);
-            doca_buf_dec_refcount(sub_buf_pair.second, nullptr);
-        }
+    /* DOCA tasks are free in astraea_ctx_stop */
+    ec->subtask_arena.for_each([](_astraea_ec_subtask &subtask) {
+        release_strip_buf(subtask.dst);
+    });
+    sgl_cache_destroy(&ec->src_sgl_cache);
 
-        delete task;
-    }
     doca_error_t status;
     status = doca_ec_destroy(ec->ec);
     status = doca_buf_inventory_destroy(ec->buf_inventory);
-    status = doca_mmap_destroy(ec->dst_mmap);
+    if (ec->tmp_rdnc_mmap) {
+        status = doca_mmap_destroy(ec->tmp_rdnc_mmap);
+    }
     free(ec->tmp_rdnc_buffer);
 
+    delete ec->cost_table;
     delete ec;
 
     return status;
@@ -229,151 +478,432 @@ astraea_ctx *astraea_ec_as_ctx(astraea_ec *ec) {
     ctx->type = EC;
     ctx->ec = ec;
     ctx->submitter = nullptr;
+    ctx->pe = nullptr;
+    ec->ctx = ctx;
+    ctx->submit_batch_size.store(DEFAULT_SUBMIT_BATCH_SIZE,
+                                 std::memory_order_relaxed);
+    ctx->max_submit_spin_in_us.store(0, std::memory_order_relaxed);
+    ctx->strip_dispatch.store(ASTRAEA_STRIP_DISPATCH_EDF,
+                              std::memory_order_relaxed);
+    ctx->ec_backend.store(ASTRAEA_EC_BACKEND_DOCA, std::memory_order_relaxed);
+    ctx->nb_spill_threads = 0;
+    ctx->spill.nb_spilled_strips.store(0, std::memory_order_relaxed);
 
     return ctx;
 }
 
+/* Slots are shared by every op, size the chunks for the largest conf */
+static void set_task_conf(astraea_ec *ec, task_type type,
+                          astraea_ec_task_completion_cb_t success_cb,
+                          astraea_ec_task_completion_cb_t error_cb,
+                          uint32_t num_tasks) {
+    ec->nb_conf_tasks = std::max(ec->nb_conf_tasks,
+                                 std::min(num_tasks, MAX_NB_INFLIGHT_EC_TASKS));
+    ec->task_arena.set_chunk_size(ec->nb_conf_tasks);
+    ec->success_cbs[type] = success_cb;
+    ec->error_cbs[type] = error_cb;
+}
+
 doca_error_t astraea_ec_task_create_set_conf(
     astraea_ec *ec,
     astraea_ec_task_create_completion_cb_t successful_task_completion_cb,
     astraea_ec_task_create_completion_cb_t error_task_completion_cb,
     uint32_t num_tasks) {
-    (void)num_tasks;
-    ec->success_cb = successful_task_completion_cb;
-    ec->error_cb = error_task_completion_cb;
+    set_task_conf(ec, EC_CREATE, successful_task_completion_cb,
+                  error_task_completion_cb, num_tasks);
     return doca_ec_task_create_set_conf(
-        ec->ec, subtask_success_cb, subtask_error_cb, MAX_NB_INFLIGHT_EC_TASKS);
+        ec->ec, subtask_success_cb<doca_ec_task_create>,
+        subtask_error_cb<doca_ec_task_create>, DOCA_TASK_POOL_SIZE);
+}
+
+doca_error_t astraea_ec_task_recover_set_conf(
+    astraea_ec *ec,
+    astraea_ec_task_recover_completion_cb_t successful_task_completion_cb,
+    astraea_ec_task_recover_completion_cb_t error_task_completion_cb,
+    uint32_t num_tasks) {
+    set_task_conf(ec, EC_RECOVER, successful_task_completion_cb,
+                  error_task_completion_cb, num_tasks);
+    return doca_ec_task_recover_set_conf(
+        ec->ec, subtask_success_cb<doca_ec_task_recover>,
+        subtask_error_cb<doca_ec_task_recover>, DOCA_TASK_POOL_SIZE);
+}
+
+doca_error_t astraea_ec_task_update_set_conf(
+    astraea_ec *ec,
+    astraea_ec_task_update_completion_cb_t successful_task_completion_cb,
+    astraea_ec_task_update_completion_cb_t error_task_completion_cb,
+    uint32_t num_tasks) {
+    set_task_conf(ec, EC_UPDATE, successful_task_completion_cb,
+                  error_task_completion_cb, num_tasks);
+    return doca_ec_task_update_set_conf(
+        ec->ec, subtask_success_cb<doca_ec_task_update>,
+        subtask_error_cb<doca_ec_task_update>, DOCA_TASK_POOL_SIZE);
+}
+
+/**
+ * Gather what the controller needs: this shard's tokens, the queue and the
+ * budget left until the deadline this task gets once submitted
+ */
+static granularity_decision calc_granularity(astraea_ec_task *task) {
+    astraea_ec *ec = task->ec;
+    /* Every op is costed as a create reading and writing as many blocks */
+    granularity_inputs inputs = {
+        .block_size = task->origin_block_size,
+        .nb_data_blocks = task->matrix->nb_src_blocks,
+        .nb_rdnc_blocks = task->matrix->nb_dst_blocks,
+        .nb_avail_tokens = 0,
+        .nb_granted_tokens = 0,
+        .period_in_ns = shm_data->refresh_period_in_ns,
+        .nb_queued_tokens =
+            ec->nb_queued_tokens.load(std::memory_order_relaxed),
+        .budget_in_ns = 0,
+        .strip_overhead_in_ns =
+            ec->strip_overhead_in_ns.load(std::memory_order_relaxed)};
+
+    token_shard_estimate(&ec->ctx->tokens, &inputs.nb_avail_tokens,
+                         &inputs.nb_granted_tokens);
+
+    /* Same deadline astraea_task_submit will assign */
+    using clock = std::chrono::high_resolution_clock;
+    const clock::duration cur_time = clock::now().time_since_epoch();
+    const clock::duration expect_time =
+        std::max(clock::duration{ec->ctx->pe->last_expect_time.load(
+                     std::memory_order_relaxed)},
+                 cur_time) +
+        std::chrono::duration_cast<clock::duration>(latency_sla);
+    inputs.budget_in_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              expect_time - cur_time)
+                              .count();
+
+    const granularity_decision decision =
+        choose_granularity(ec->cost_table, inputs);
+    granularity_stats_record(&ec->gran_stats, inputs, decision);
+    DOCA_LOG_DBG("Strip %luB x %u (tail %luB) for block %luB, reason %d, "
+                 "predicted %ldns, budget %ldns, tokens %u/%u, queued %lu",
+                 decision.strip_size, decision.nb_strips, decision.tail_size,
+                 inputs.block_size, decision.reason, decision.predicted_in_ns,
+                 inputs.budget_in_ns, inputs.nb_avail_tokens,
+                 inputs.nb_granted_tokens, inputs.nb_queued_tokens);
+    return decision;
+}
+
+/* Empty every buf of a list so the engine can write it again */
+static doca_error_t reset_strip_buf(doca_buf *strip_buf) {
+    for (doca_buf *buf = strip_buf; buf != nullptr;) {
+        doca_error_t status = doca_buf_reset_data_len(buf);
+        if (status != DOCA_SUCCESS) {
+            return status;
+        }
+        status = doca_buf_get_next_in_list(buf, &buf);
+        if (status != DOCA_SUCCESS) {
+            return status;
+        }
+    }
+    return DOCA_SUCCESS;
 }
 
-static inline uint32_t calc_token_cost(uint32_t nb_data_blocks,
-                                       uint32_t nb_rdnc_blocks,
-                                       size_t block_size) {
-    if (nb_data_blocks == 128 && nb_rdnc_blocks == 32 && block_size == 1024) {
-        return 1;
+/**
+ * Get an empty buf list covering one strip of nb_blocks rdnc blocks laid out
+ * every block_stride bytes from addr, for the engine to fill.
+ * The list left by the slot's previous task is reused if it covers the same
+ * memory, so re-encoding into the same buffers costs no inventory operation
+ */
+static doca_error_t get_strip_buf(astraea_ec *ec, doca_mmap *mmap,
+                                  uint8_t *addr, size_t block_stride,
+                                  size_t sub_block_size, uint32_t nb_blocks,
+                                  _astraea_ec_strip_buf &strip_buf) {
+    if (strip_buf.buf && strip_buf.mmap == mmap && strip_buf.addr == addr &&
+        strip_buf.block_stride == block_stride &&
+        strip_buf.sub_block_size == sub_block_size &&
+        strip_buf.nb_blocks == nb_blocks) {
+        return reset_strip_buf(strip_buf.buf);
     }
+    release_strip_buf(strip_buf);
 
-    if (nb_data_blocks == 128 && nb_rdnc_blocks == 32 &&
-        block_size == 1024 * 1024) {
-        return 1024;
+    doca_error_t status;
+    doca_buf *head = nullptr;
+    for (uint32_t j = 0; j < nb_blocks; j++) {
+        doca_buf *buf;
+        uint8_t *block_addr = addr + j * block_stride;
+
+        status = doca_buf_inventory_buf_get_by_addr(
+            ec->buf_inventory, mmap, block_addr, sub_block_size, &buf);
+        if (status != DOCA_SUCCESS) {
+            DOCA_LOG_ERR("Failed to alloc buf: %s",
+                         doca_error_get_descr(status));
+            if (head) {
+                doca_buf_dec_refcount(head, nullptr);
+            }
+            return status;
+        }
+
+        if (j == 0) {
+            head = buf;
+        } else {
+            status = doca_buf_chain_list(head, buf);
+            if (status != DOCA_SUCCESS) {
+                DOCA_LOG_ERR("Failed to chain list: %s",
+                             doca_error_get_descr(status));
+                doca_buf_dec_refcount(buf, nullptr);
+                doca_buf_dec_refcount(head, nullptr);
+                return status;
+            }
+        }
     }
-    return 1;
+
+    strip_buf = {.buf = head,
+                 .mmap = mmap,
+                 .addr = addr,
+                 .block_stride = block_stride,
+                 .sub_block_size = sub_block_size,
+                 .nb_blocks = nb_blocks};
+    return DOCA_SUCCESS;
 }
 
 /**
- * This function should be modify later!
- * The granularity should be calculated according to real time metadata
- * Which must incurs semaphore operations
+ * Strips can write straight into the user's dst blocks if the user gave us
+ * the mmap backing them and the engine accepts one buf per block
  */
-static size_t calc_granularity(astraea_ec_task_create *task) {
-    size_t granularity = 0;
+static bool can_write_dst_in_place(const astraea_ec *ec, doca_mmap *dst_mmap,
+                                    const uint8_t *dst_base_addr,
+                                    uint32_t nb_dst_blocks,
+                                    size_t origin_block_size) {
+    if (dst_mmap == nullptr || nb_dst_blocks > ec->max_buf_list_len) {
+        return false;
+    }
 
-    uint32_t token_cost =
-        calc_token_cost(task->matrix->nb_data_blocks,
-                        task->matrix->nb_rdnc_blocks, task->origin_block_size);
+    void *mmap_addr;
+    size_t mmap_len;
+    if (doca_mmap_get_memrange(dst_mmap, &mmap_addr, &mmap_len) !=
+        DOCA_SUCCESS) {
+        return false;
+    }
+
+    const uint8_t *mmap_begin = static_cast<uint8_t *>(mmap_addr);
+    return dst_base_addr >= mmap_begin &&
+           dst_base_addr + nb_dst_blocks * origin_block_size <=
+               mmap_begin + mmap_len;
+}
 
-    if (sem_wait(ec_token_sem)) {
-        DOCA_LOG_ERR("Failed to get ec_token_sem");
-        return 1024;
+/**
+ * Pop a recycled slot, or carve a new one until the inflight limit
+ * The caller owns the pe, so it is free_tasks' only consumer
+ */
+static astraea_ec_task *get_task_slot(astraea_ec *ec) {
+    astraea_ec_task *task = ec->free_tasks.front();
+    if (task) {
+        ec->free_tasks.pop();
+    } else if (ec->nb_task_slots < MAX_NB_INFLIGHT_EC_TASKS) {
+        task = ec->task_arena.alloc(1);
+        if (task) {
+            ec->nb_task_slots++;
+        }
     }
+    return task;
+}
 
-    const uint32_t nb_avail_tokens = shm_data->ec_tokens[app_id];
+/**
+ * Make room for nb_subtasks strips. A slot keeps its sub tasks across reuses
+ * and only trades them for a larger run when a task needs more strips.
+ * Runs are a power of two long, and the one traded away goes to the next
+ * slot that grows to its size
+ */
+static doca_error_t reserve_subtasks(astraea_ec_task *task,
+                                     uint32_t nb_subtasks) {
+    if (nb_subtasks <= task->subtask_capacity) {
+        return DOCA_SUCCESS;
+    }
+    const uint32_t run_class = std::bit_width(nb_subtasks - 1);
+    if (run_class >= NB_SUBTASK_RUN_CLASSES) {
+        return DOCA_ERROR_INVALID_VALUE;
+    }
 
-    if (token_cost < nb_avail_tokens) {
-        granularity = task->origin_block_size;
+    astraea_ec *ec = task->ec;
+    std::vector<_astraea_ec_subtask *> &runs =
+        ec->free_subtask_runs[run_class];
+    _astraea_ec_subtask *subtasks;
+    if (!runs.empty()) {
+        subtasks = runs.back();
+        runs.pop_back();
     } else {
-        granularity = nb_avail_tokens < 2      ? 1 * 1024
-                      : nb_avail_tokens < 4    ? 2 * 1024
-                      : nb_avail_tokens < 8    ? 4 * 1024
-                      : nb_avail_tokens < 16   ? 8 * 1024
-                      : nb_avail_tokens < 32   ? 16 * 1024
-                      : nb_avail_tokens < 64   ? 32 * 1024
-                      : nb_avail_tokens < 128  ? 64 * 1024
-                      : nb_avail_tokens < 256  ? 128 * 1024
-                      : nb_avail_tokens < 512  ? 256 * 1024
-                      : nb_avail_tokens < 1024 ? 512 * 1024
-                                               : 1024 * 1024;
+        subtasks = ec->subtask_arena.alloc(1U << run_class);
+        if (subtasks == nullptr) {
+            return DOCA_ERROR_NO_MEMORY;
+        }
     }
 
-    if (sem_post(ec_token_sem)) {
-        DOCA_LOG_ERR("Failed to post ec_token_sem");
-        return 1024;
+    /* Drop what the old run holds, its DOCA tasks point into it */
+    for (uint32_t i = 0; i < task->subtask_capacity; i++) {
+        _astraea_ec_subtask &subtask = task->subtasks[i];
+        if (subtask.task) {
+            doca_task_free(subtask.task);
+            subtask.task = nullptr;
+        }
+        release_strip_buf(subtask.dst);
+    }
+    if (task->subtask_capacity > 0) {
+        ec->free_subtask_runs[std::bit_width(task->subtask_capacity - 1)]
+            .push_back(task->subtasks);
     }
 
-    return granularity;
+    task->subtasks = subtasks;
+    task->subtask_capacity = 1U << run_class;
+    return DOCA_SUCCESS;
 }
 
 /* Only use to reduce function parameter */
-struct subtask_create_ctx {
+struct subtask_ctx {
     doca_buf *sub_src_buf;
     doca_buf *sub_dst_buf;
     uint32_t strip_id;
-    bool is_last;
+    uint32_t token_cost;
     bool is_sub;
-    astraea_ec_task_create *origin_task;
+    bool is_staged;
+    astraea_ec_task *origin_task;
 };
 
-static inline doca_error_t
-create_subtask(const subtask_create_ctx &stsk_ctx,
-               _astraea_ec_subtask_create **subtask) {
-    *subtask = nullptr;
-    _astraea_ec_subtask_create *new_subtask =
-        stsk_ctx.origin_task
-            ->subtask_pool[stsk_ctx.origin_task->cur_subtask_pos++];
-
-    new_subtask->user_data->is_sub = stsk_ctx.is_sub;
-    new_subtask->user_data->is_last = stsk_ctx.is_last;
-    new_subtask->user_data->strip_id = stsk_ctx.strip_id;
-    new_subtask->user_data->origin_task = stsk_ctx.origin_task;
-
-    doca_error_t status = doca_ec_task_create_allocate_init(
-        stsk_ctx.origin_task->ec->ec, stsk_ctx.origin_task->matrix->matrix,
-        stsk_ctx.sub_src_buf, stsk_ctx.sub_dst_buf,
-        {.ptr = new_subtask->user_data}, &new_subtask->task);
+/* Point the DOCA task a sub task slot kept at new bufs and matrix */
+static void reset_doca_task(const subtask_ctx &stsk_ctx,
+                            _astraea_ec_subtask *subtask) {
+    const doca_ec_matrix *matrix = stsk_ctx.origin_task->matrix->matrix;
+    switch (subtask->type) {
+    case EC_CREATE:
+        doca_ec_task_create_set_matrix(subtask->create_task, matrix);
+        doca_ec_task_create_set_original_data_blocks(subtask->create_task,
+                                                     stsk_ctx.sub_src_buf);
+        doca_ec_task_create_set_rdnc_blocks(subtask->create_task,
+                                            stsk_ctx.sub_dst_buf);
+        break;
+    case EC_RECOVER:
+        doca_ec_task_recover_set_matrix(subtask->recover_task, matrix);
+        doca_ec_task_recover_set_available_blocks(subtask->recover_task,
+                                                  stsk_ctx.sub_src_buf);
+        doca_ec_task_recover_set_recovered_data(subtask->recover_task,
+                                                stsk_ctx.sub_dst_buf);
+        break;
+    case EC_UPDATE:
+        doca_ec_task_update_set_matrix(subtask->update_task, matrix);
+        doca_ec_task_update_set_original_updated_and_rdnc_blocks(
+            subtask->update_task, stsk_ctx.sub_src_buf);
+        doca_ec_task_update_set_updated_rdnc_blocks(subtask->update_task,
+                                                    stsk_ctx.sub_dst_buf);
+        break;
+    default:
+        break;
+    }
+}
+
+static doca_error_t allocate_doca_task(const subtask_ctx &stsk_ctx,
+                                       task_type type,
+                                       _astraea_ec_subtask *subtask) {
+    doca_ec *ec = stsk_ctx.origin_task->ec->ec;
+    const doca_ec_matrix *matrix = stsk_ctx.origin_task->matrix->matrix;
+    const doca_data user_data = {.ptr = &subtask->user_data};
+    doca_error_t status = DOCA_ERROR_NOT_SUPPORTED;
+
+    switch (type) {
+    case EC_CREATE:
+        status = doca_ec_task_create_allocate_init(
+            ec, matrix, stsk_ctx.sub_src_buf, stsk_ctx.sub_dst_buf, user_data,
+            &subtask->create_task);
+        if (status == DOCA_SUCCESS) {
+            subtask->task = doca_ec_task_create_as_task(subtask->create_task);
+        }
+        break;
+    case EC_RECOVER:
+        status = doca_ec_task_recover_allocate_init(
+            ec, matrix, stsk_ctx.sub_src_buf, stsk_ctx.sub_dst_buf, user_data,
+            &subtask->recover_task);
+        if (status == DOCA_SUCCESS) {
+            subtask->task = doca_ec_task_recover_as_task(subtask->recover_task);
+        }
+        break;
+    case EC_UPDATE:
+        status = doca_ec_task_update_allocate_init(
+            ec, matrix, stsk_ctx.sub_src_buf, stsk_ctx.sub_dst_buf, user_data,
+            &subtask->update_task);
+        if (status == DOCA_SUCCESS) {
+            subtask->task = doca_ec_task_update_as_task(subtask->update_task);
+        }
+        break;
+    default:
+        break;
+    }
+
     if (status != DOCA_SUCCESS) {
-        DOCA_LOG_ERR("Failed to allocate and init ec create task: %s",
+        DOCA_LOG_ERR("Failed to allocate and init ec task: %s",
                      doca_error_get_descr(status));
+        subtask->task = nullptr;
         return status;
     }
-
-    *subtask = new_subtask;
+    subtask->type = type;
     return DOCA_SUCCESS;
 }
 
-doca_error_t astraea_ec_task_create_allocate_init(
-    astraea_ec *ec, astraea_ec_matrix *coding_matrix, doca_mmap *src_mmap,
-    doca_buf *original_data_blocks, doca_buf *rdnc_blocks, doca_data user_data,
-    astraea_ec_task_create **task) {
-    *task = nullptr;
-    astraea_ec_task_create *new_task = ec->task_pool[ec->cur_task_pos++];
+/**
+ * Reuses the DOCA task the sub task slot kept from its previous use if it
+ * runs the same op, the slot's previous task may have run another one
+ */
+static inline doca_error_t init_subtask(const subtask_ctx &stsk_ctx,
+                                        _astraea_ec_subtask *subtask) {
+    subtask->user_data.is_sub = stsk_ctx.is_sub;
+    subtask->user_data.is_staged = stsk_ctx.is_staged;
+    subtask->user_data.strip_id = stsk_ctx.strip_id;
+    subtask->user_data.token_cost = stsk_ctx.token_cost;
+    subtask->user_data.origin_task = stsk_ctx.origin_task;
+
+    const task_type type = stsk_ctx.origin_task->general_task.type;
+    if (subtask->task && subtask->type != type) {
+        doca_task_free(subtask->task);
+        subtask->task = nullptr;
+    }
+
+    if (subtask->task) {
+        reset_doca_task(stsk_ctx, subtask);
+        return DOCA_SUCCESS;
+    }
+
+    return allocate_doca_task(stsk_ctx, type, subtask);
+}
+
+static doca_error_t init_task(astraea_ec_task *new_task,
+                              astraea_ec_matrix *matrix, doca_mmap *src_mmap,
+                              doca_mmap *dst_mmap, doca_buf *src_blocks,
+                              doca_buf *dst_blocks, doca_data user_data) {
+    astraea_ec *ec = new_task->ec;
 
     size_t src_buf_size;
-    doca_error_t status =
-        doca_buf_get_data_len(original_data_blocks, &src_buf_size);
+    doca_error_t status = doca_buf_get_data_len(src_blocks, &src_buf_size);
     if (status != DOCA_SUCCESS) {
         DOCA_LOG_ERR("Failed to get block size: %s",
                      doca_error_get_descr(status));
         return status;
     }
 
-    const size_t origin_block_size =
-        src_buf_size / coding_matrix->nb_data_blocks;
+    const size_t origin_block_size = src_buf_size / matrix->nb_src_blocks;
 
     new_task->origin_block_size = origin_block_size;
     new_task->user_data = user_data;
-    new_task->original_data_blocks = original_data_blocks;
-    new_task->rdnc_blocks = rdnc_blocks;
-    new_task->ec = ec;
-    new_task->matrix = coding_matrix;
+    new_task->src_blocks = src_blocks;
+    new_task->dst_blocks = dst_blocks;
+    new_task->matrix = matrix;
+    new_task->nb_subtasks = 0;
+    new_task->nb_finished_subtasks = 0;
+    new_task->status = DOCA_SUCCESS;
 
-    const size_t sub_block_size = calc_granularity(new_task);
+    const granularity_decision decision = calc_granularity(new_task);
+    const size_t sub_block_size = decision.strip_size;
 
     new_task->sub_block_size = sub_block_size;
+    new_task->token_cost =
+        (uint64_t)(decision.nb_strips - 1) * decision.strip_token_cost +
+        decision.tail_token_cost;
 
-    if (origin_block_size > sub_block_size) {
+    if (decision.nb_strips > 1) {
         void *dst_base_addr = nullptr;
-        status = doca_buf_get_data(rdnc_blocks, &dst_base_addr);
+        status = doca_buf_get_data(dst_blocks, &dst_base_addr);
         if (status != DOCA_SUCCESS) {
-            DOCA_LOG_ERR("Failed to get rdnc buf addr: %s",
+            DOCA_LOG_ERR("Failed to get dst buf addr: %s",
                          doca_error_get_descr(status));
             return status;
         }
@@ -381,106 +911,191 @@ doca_error_t astraea_ec_task_create_allocate_init(
         new_task->dst_base_addr = static_cast<uint8_t *>(dst_base_addr);
 
         void *src_base_addr = nullptr;
-        status = doca_buf_get_data(original_data_blocks, &src_base_addr);
+        status = doca_buf_get_data(src_blocks, &src_base_addr);
         if (status != DOCA_SUCCESS) {
-            DOCA_LOG_ERR("Failed to get data buf addr: %s",
+            DOCA_LOG_ERR("Failed to get src buf addr: %s",
                          doca_error_get_descr(status));
             return status;
         }
 
-        const uint32_t nb_strips = origin_block_size / sub_block_size;
-        for (uint32_t i = 0; i < nb_strips; i++) {
-            doca_buf *sub_src_buf, *sub_dst_buf;
-
-            doca_buf *tmp_bufs[MAX_NB_DATA_BLOCKS];
-            // create scatter gather list
-            for (uint32_t j = 0; j < coding_matrix->nb_data_blocks; j++) {
-                uint8_t *addr = static_cast<uint8_t *>(src_base_addr) +
-                                j * origin_block_size + i * sub_block_size;
-
-                status = doca_buf_inventory_buf_get_by_addr(
-                    ec->buf_inventory, src_mmap, addr, sub_block_size,
-                    &tmp_bufs[j]);
-                if (status != DOCA_SUCCESS) {
-                    DOCA_LOG_ERR("Failed to alloc buf for data blocks: %s",
-                                 doca_error_get_descr(status));
-                    return status;
-                }
-
-                status = doca_buf_set_data(tmp_bufs[j], addr, sub_block_size);
-                if (status != DOCA_SUCCESS) {
-                    DOCA_LOG_ERR("Failed to set buf data for data bufs: %s",
-                                 doca_error_get_descr(status));
-                    return status;
-                }
-
-                if (j == 0) {
-                    sub_src_buf = tmp_bufs[j];
-                } else {
-                    status = doca_buf_chain_list(sub_src_buf, tmp_bufs[j]);
-                    if (status != DOCA_SUCCESS) {
-                        DOCA_LOG_ERR("Failed to chain list: %s",
-                                     doca_error_get_descr(status));
-                        return status;
-                    }
-                }
+        const bool is_staged = !can_write_dst_in_place(
+            ec, dst_mmap, new_task->dst_base_addr, matrix->nb_dst_blocks,
+            origin_block_size);
+        if (is_staged) {
+            /* Tried once, allocations are serialized */
+            if (!ec->is_tmp_rdnc_prepared) {
+                ec->tmp_rdnc_status = prepare_tmp_rdnc_buffer(ec);
+                ec->is_tmp_rdnc_prepared = true;
             }
+            if (ec->tmp_rdnc_status != DOCA_SUCCESS) {
+                DOCA_LOG_ERR("Failed to prepare tmp rdnc buffer");
+                return ec->tmp_rdnc_status;
+            }
+        }
+
+        const sgl_key src_key = {
+            .mmap = src_mmap,
+            .base_addr = static_cast<uint8_t *>(src_base_addr),
+            .block_size = origin_block_size,
+            .sub_block_size = sub_block_size,
+            .nb_blocks = matrix->nb_src_blocks};
+        status = sgl_cache_get(&ec->src_sgl_cache, src_key, &new_task->src_sgl);
+        if (status != DOCA_SUCCESS) {
+            DOCA_LOG_ERR("Failed to get sgl for src blocks");
+            return status;
+        }
+
+        const uint32_t nb_strips = decision.nb_strips;
+        status = reserve_subtasks(new_task, nb_strips);
+        if (status != DOCA_SUCCESS) {
+            DOCA_LOG_ERR("Failed to alloc sub tasks");
+            return status;
+        }
 
-            status = doca_buf_inventory_buf_get_by_addr(
-                ec->buf_inventory, ec->dst_mmap,
-                static_cast<uint8_t *>(ec->tmp_rdnc_buffer) +
-                    i * sub_block_size * coding_matrix->nb_rdnc_blocks,
-                sub_block_size * coding_matrix->nb_rdnc_blocks, &sub_dst_buf);
+        for (uint32_t i = 0; i < nb_strips; i++) {
+            _astraea_ec_subtask *subtask = &new_task->subtasks[i];
+            const bool is_tail = i == nb_strips - 1;
+            const size_t strip_size =
+                is_tail ? decision.tail_size : sub_block_size;
+
+            if (is_staged) {
+                /* Output of strip i is packed as nb_dst_blocks pieces */
+                status = get_strip_buf(
+                    ec, ec->tmp_rdnc_mmap,
+                    static_cast<uint8_t *>(ec->tmp_rdnc_buffer) +
+                        i * sub_block_size * matrix->nb_dst_blocks,
+                    strip_size * matrix->nb_dst_blocks,
+                    strip_size * matrix->nb_dst_blocks, 1, subtask->dst);
+            } else {
+                status = get_strip_buf(
+                    ec, dst_mmap, new_task->dst_base_addr + i * sub_block_size,
+                    origin_block_size, strip_size, matrix->nb_dst_blocks,
+                    subtask->dst);
+            }
             if (status != DOCA_SUCCESS) {
-                DOCA_LOG_ERR("Failed to alloc buf for rdnc blocks: %s",
-                             doca_error_get_descr(status));
+                DOCA_LOG_ERR("Failed to get buf for dst blocks");
                 return status;
             }
 
-            const subtask_create_ctx stsk_ctx = {
-                .sub_src_buf = sub_src_buf,
-                .sub_dst_buf = sub_dst_buf,
+            const subtask_ctx stsk_ctx = {
+                .sub_src_buf = new_task->src_sgl->strips[i],
+                .sub_dst_buf = subtask->dst.buf,
                 .strip_id = i,
-                .is_last = i == nb_strips - 1 ? true : false,
+                .token_cost = is_tail ? decision.tail_token_cost
+                                      : decision.strip_token_cost,
                 .is_sub = true,
+                .is_staged = is_staged,
                 .origin_task = new_task};
 
-            _astraea_ec_subtask_create *subtask = nullptr;
-            status = create_subtask(stsk_ctx, &subtask);
+            status = init_subtask(stsk_ctx, subtask);
             if (status != DOCA_SUCCESS) {
                 DOCA_LOG_ERR("Failed to create sub task");
                 return status;
             }
-            new_task->subtasks.push_back(subtask);
-            new_task->sub_buf_pairs.push_back(
-                std::make_pair(stsk_ctx.sub_src_buf, stsk_ctx.sub_dst_buf));
+            new_task->nb_subtasks++;
         }
     } else {
-        const subtask_create_ctx stsk_ctx = {.sub_src_buf =
-                                                 original_data_blocks,
-                                             .sub_dst_buf = rdnc_blocks,
-                                             .strip_id = 0,
-                                             .is_last = true,
-                                             .is_sub = false,
-                                             .origin_task = new_task};
-        _astraea_ec_subtask_create *subtask = nullptr;
-        status = create_subtask(stsk_ctx, &subtask);
+        status = reserve_subtasks(new_task, 1);
         if (status != DOCA_SUCCESS) {
-            DOCA_LOG_ERR("Failed to create sub task");
+            DOCA_LOG_ERR("Failed to alloc sub task");
             return status;
         }
 
-        new_task->subtasks.push_back(subtask);
+        /* Dst strip bufs of sub task 0 stay cached for a later split task */
+        const subtask_ctx stsk_ctx = {.sub_src_buf = src_blocks,
+                                      .sub_dst_buf = dst_blocks,
+                                      .strip_id = 0,
+                                      .token_cost = decision.strip_token_cost,
+                                      .is_sub = false,
+                                      .is_staged = false,
+                                      .origin_task = new_task};
+        status = init_subtask(stsk_ctx, &new_task->subtasks[0]);
+        if (status != DOCA_SUCCESS) {
+            DOCA_LOG_ERR("Failed to create sub task");
+            return status;
+        }
+        new_task->nb_subtasks++;
     }
-    *task = new_task;
     return DOCA_SUCCESS;
 }
 
+static doca_error_t allocate_init(astraea_ec *ec, task_type type,
+                                  astraea_ec_matrix *matrix,
+                                  doca_mmap *src_mmap, doca_mmap *dst_mmap,
+                                  doca_buf *src_blocks, doca_buf *dst_blocks,
+                                  doca_data user_data, astraea_ec_task **task) {
+    *task = nullptr;
+    /* Task pools and buf inventories are the pe's, see astraea_pe.h */
+    const bool is_acquired = astraea_pe_acquire_for_app(ec_pe(ec));
+    doca_error_t status = DOCA_ERROR_NO_MEMORY;
+    astraea_ec_task *new_task = get_task_slot(ec);
+    if (new_task == nullptr) {
+        DOCA_LOG_ERR("No free task slot");
+    } else {
+        new_task->ec = ec;
+        new_task->src_sgl = nullptr;
+        new_task->slot_state.store(TASK_SLOT_ALLOCATED,
+                                   std::memory_order_relaxed);
+        new_task->general_task = {.type = type, .ec_task = new_task};
+
+        status = init_task(new_task, matrix, src_mmap, dst_mmap, src_blocks,
+                           dst_blocks, user_data);
+        if (status != DOCA_SUCCESS) {
+            put_task_slot(new_task);
+        } else {
+            *task = new_task;
+        }
+    }
+    astraea_pe_release_for_app(ec_pe(ec), is_acquired);
+    return status;
+}
+
+doca_error_t astraea_ec_task_create_allocate_init(
+    astraea_ec *ec, astraea_ec_matrix *coding_matrix, doca_mmap *src_mmap,
+    doca_mmap *dst_mmap, doca_buf *original_data_blocks, doca_buf *rdnc_blocks,
+    doca_data user_data, astraea_ec_task_create **task) {
+    return allocate_init(ec, EC_CREATE, coding_matrix, src_mmap, dst_mmap,
+                         original_data_blocks, rdnc_blocks, user_data, task);
+}
+
+doca_error_t astraea_ec_task_recover_allocate_init(
+    astraea_ec *ec, astraea_ec_matrix *recover_matrix, doca_mmap *src_mmap,
+    doca_mmap *dst_mmap, doca_buf *available_blocks,
+    doca_buf *recovered_data_blocks, doca_data user_data,
+    astraea_ec_task_recover **task) {
+    return allocate_init(ec, EC_RECOVER, recover_matrix, src_mmap, dst_mmap,
+                         available_blocks, recovered_data_blocks, user_data,
+                         task);
+}
+
+doca_error_t astraea_ec_task_update_allocate_init(
+    astraea_ec *ec, astraea_ec_matrix *update_matrix, doca_mmap *src_mmap,
+    doca_mmap *dst_mmap, doca_buf *original_updated_and_rdnc_blocks,
+    doca_buf *updated_rdnc_blocks, doca_data user_data,
+    astraea_ec_task_update **task) {
+    return allocate_init(ec, EC_UPDATE, update_matrix, src_mmap, dst_mmap,
+                         original_updated_and_rdnc_blocks, updated_rdnc_blocks,
+                         user_data, task);
+}
+
 astraea_task *astraea_ec_task_create_as_task(astraea_ec_task_create *task) {
-    astraea_task *general_task = new astraea_task;
-    general_task->type = EC_CREATE;
-    general_task->ec_task_create = task;
-    return general_task;
+    return &task->general_task;
+}
+
+astraea_task *astraea_ec_task_recover_as_task(astraea_ec_task_recover *task) {
+    return &task->general_task;
+}
+
+astraea_task *astraea_ec_task_update_as_task(astraea_ec_task_update *task) {
+    return &task->general_task;
+}
+
+const granularity_stats *astraea_ec_get_granularity_stats(astraea_ec *ec) {
+    return &ec->gran_stats;
+}
+
+const latency_hist *astraea_ec_get_submit_latency(astraea_ec *ec) {
+    return &ec->submit_latency;
 }
 
 doca_error_t astraea_ec_matrix_create(astraea_ec *ec, doca_ec_matrix_type type,
@@ -488,14 +1103,98 @@ doca_error_t astraea_ec_matrix_create(astraea_ec *ec, doca_ec_matrix_type type,
                                       size_t rdnc_block_count,
                                       astraea_ec_matrix **matrix) {
     *matrix = new astraea_ec_matrix;
-    (*matrix)->nb_data_blocks = data_block_count;
-    (*matrix)->nb_rdnc_blocks = rdnc_block_count;
+    (*matrix)->nb_src_blocks = data_block_count;
+    (*matrix)->nb_dst_blocks = rdnc_block_count;
 
+    const bool is_acquired = astraea_pe_acquire_for_app(ec_pe(ec));
     doca_error_t status = doca_ec_matrix_create(
         ec->ec, type, data_block_count, rdnc_block_count, &(*matrix)->matrix);
+    astraea_pe_release_for_app(ec_pe(ec), is_acquired);
     if (status != DOCA_SUCCESS) {
         delete *matrix;
         *matrix = nullptr;
+        return status;
+    }
+
+    /* The CPU backend only knows the Cauchy layout */
+    if (type == DOCA_EC_MATRIX_TYPE_CAUCHY) {
+        (*matrix)->cpu_coefs.resize(rdnc_block_count * data_block_count);
+        if (!cpu_ec_cauchy_matrix(data_block_count, rdnc_block_count,
+                                  (*matrix)->cpu_coefs.data())) {
+            (*matrix)->cpu_coefs.clear();
+        }
+    }
+
+    return status;
+}
+
+doca_error_t
+astraea_ec_matrix_create_recover(astraea_ec *ec,
+                                 const astraea_ec_matrix *coding_matrix,
+                                 uint32_t missing_indices[], size_t n_missing,
+                                 astraea_ec_matrix **matrix) {
+    *matrix = new astraea_ec_matrix;
+    /* Reads as many available blocks as there are data blocks */
+    (*matrix)->nb_src_blocks = coding_matrix->nb_src_blocks;
+    (*matrix)->nb_dst_blocks = n_missing;
+
+    const bool is_acquired = astraea_pe_acquire_for_app(ec_pe(ec));
+    doca_error_t status =
+        doca_ec_matrix_create_recover(ec->ec, coding_matrix->matrix,
+                                      missing_indices, n_missing,
+                                      &(*matrix)->matrix);
+    astraea_pe_release_for_app(ec_pe(ec), is_acquired);
+    if (status != DOCA_SUCCESS) {
+        delete *matrix;
+        *matrix = nullptr;
+        return status;
+    }
+
+    if (!coding_matrix->cpu_coefs.empty()) {
+        (*matrix)->cpu_coefs.resize(n_missing * coding_matrix->nb_src_blocks);
+        if (!cpu_ec_recover_matrix(coding_matrix->cpu_coefs.data(),
+                                   coding_matrix->nb_src_blocks,
+                                   coding_matrix->nb_dst_blocks,
+                                   missing_indices, n_missing,
+                                   (*matrix)->cpu_coefs.data())) {
+            (*matrix)->cpu_coefs.clear();
+        }
+    }
+
+    return status;
+}
+
+doca_error_t
+astraea_ec_matrix_create_update(astraea_ec *ec,
+                                const astraea_ec_matrix *coding_matrix,
+                                uint32_t update_indices[], size_t n_updates,
+                                astraea_ec_matrix **matrix) {
+    *matrix = new astraea_ec_matrix;
+    /* The original and updated version of each block, then the rdnc blocks */
+    (*matrix)->nb_src_blocks = 2 * n_updates + coding_matrix->nb_dst_blocks;
+    (*matrix)->nb_dst_blocks = coding_matrix->nb_dst_blocks;
+
+    const bool is_acquired = astraea_pe_acquire_for_app(ec_pe(ec));
+    doca_error_t status = doca_ec_matrix_create_update(
+        ec->ec, coding_matrix->matrix, update_indices, n_updates,
+        &(*matrix)->matrix);
+    astraea_pe_release_for_app(ec_pe(ec), is_acquired);
+    if (status != DOCA_SUCCESS) {
+        delete *matrix;
+        *matrix = nullptr;
+        return status;
+    }
+
+    if (!coding_matrix->cpu_coefs.empty()) {
+        (*matrix)->cpu_coefs.resize((*matrix)->nb_dst_blocks *
+                                    (*matrix)->nb_src_blocks);
+        if (!cpu_ec_update_matrix(coding_matrix->cpu_coefs.data(),
+                                  coding_matrix->nb_src_blocks,
+                                  coding_matrix->nb_dst_blocks,
+                                  update_indices, n_updates,
+                                  (*matrix)->cpu_coefs.data())) {
+            (*matrix)->cpu_coefs.clear();
+        }
     }
 
     return status;
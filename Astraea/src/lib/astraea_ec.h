@@ -1,11 +1,10 @@
 #ifndef ASTRAEA_EC_H__
 #define ASTRAEA_EC_H__
 
+#include <atomic>
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
-#include <mutex>
-#include <queue>
-#include <utility>
 #include <vector>
 
 #include <doca_buf.h>
@@ -16,52 +15,119 @@
 #include <doca_mmap.h>
 #include <doca_types.h>
 
+#include "astraea.h"
+#include "astraea_pe.h"
+#include "chunk_arena.h"
+#include "ec_limits.h"
+#include "granularity.h"
+#include "latency_hist.h"
+#include "mpsc_ring.h"
+#include "sgl_cache.h"
+#include "wakeup.h"
+
 constexpr uint32_t MAX_NB_SUBTASKS_PER_TASK = 1024;
 constexpr uint32_t MAX_NB_INFLIGHT_EC_TASKS = 8192;
+/* A recycled slot keeps the DOCA tasks of this many strips, frees the rest */
+constexpr uint32_t MAX_NB_KEPT_SUBTASKS_PER_SLOT = 4;
+/**
+ * DOCA tasks per op: what every slot keeps, plus the strips of this many
+ * tasks split to the most at once
+ */
+constexpr uint32_t NB_SPLIT_TASKS_IN_DOCA_POOL = 64;
+constexpr uint32_t DOCA_TASK_POOL_SIZE =
+    MAX_NB_INFLIGHT_EC_TASKS * MAX_NB_KEPT_SUBTASKS_PER_SLOT +
+    NB_SPLIT_TASKS_IN_DOCA_POOL * MAX_NB_SUBTASKS_PER_TASK;
+/* Sub tasks are carved from chunks holding this many */
+constexpr uint32_t SUBTASK_ARENA_CHUNK_SIZE = 64 * MAX_NB_SUBTASKS_PER_TASK;
+/* A slot's sub tasks come in runs of a power of two, up to the largest task */
+constexpr uint32_t NB_SUBTASK_RUN_CLASSES = 11;
+static_assert(1U << (NB_SUBTASK_RUN_CLASSES - 1) == MAX_NB_SUBTASKS_PER_TASK);
 constexpr uint32_t MAX_NB_CTX_BUFS = 1024 * 1024;
+/* Leave the other half of the inventory to rdnc strip bufs */
+constexpr uint32_t MAX_NB_SGL_CACHE_BUFS = MAX_NB_CTX_BUFS / 2;
 constexpr size_t TMP_RDNC_BUFFER_SIZE = 32 * 1024 * 1024 * 32;
-constexpr uint32_t MAX_NB_DATA_BLOCKS = 128;
-constexpr uint32_t MAX_NB_RDNC_BLOCKS = 32;
+
+/* Who releases a slot, only that one ever does */
+enum task_slot_state : uint8_t {
+    TASK_SLOT_FREE,
+    /* Not submitted, astraea_task_free releases it */
+    TASK_SLOT_ALLOCATED,
+    /* Its completion callback, or the poll after the one returning it */
+    TASK_SLOT_SUBMITTED,
+};
 
 /**
  * Forward declarations
  */
-struct astraea_task;
 struct astraea_ctx;
-
-/* Forward declaration for structs in this file */
-struct astraea_ec;
-struct astraea_ec_task_create;
+struct ec_cost_table;
 ///////////////////////
 
-typedef void (*astraea_ec_task_create_completion_cb_t)(
-    astraea_ec_task_create *task, doca_data task_user_data,
-    doca_data ctx_user_data);
+/* The three ops share their callback type, see astraea.h */
+typedef astraea_ec_task_create_completion_cb_t astraea_ec_task_completion_cb_t;
 
-struct _astraea_ec_subtask_create_user_data {
+struct _astraea_ec_subtask_user_data {
     bool is_sub;
-    bool is_last;
+    /* Output went to tmp_rdnc_buffer and must be copied to the user */
+    bool is_staged;
     uint32_t strip_id;
-    astraea_ec_task_create *origin_task;
+    /* Tokens charged when this strip is submitted */
+    uint32_t token_cost;
+    astraea_ec_task *origin_task;
 };
 
-struct _astraea_ec_subtask_create {
-    doca_ec_task_create *task;
-    _astraea_ec_subtask_create_user_data *user_data;
+/* An output strip's buf list and the memory it covers, kept across reuses */
+struct _astraea_ec_strip_buf {
+    doca_buf *buf;
+    doca_mmap *mmap;
+    uint8_t *addr;
+    size_t block_stride;
+    size_t sub_block_size;
+    uint32_t nb_blocks;
 };
 
+struct _astraea_ec_subtask {
+    /* Kept across reuses, reallocated only when the op changes */
+    task_type type;
+    union {
+        doca_ec_task_create *create_task;
+        doca_ec_task_recover *recover_task;
+        doca_ec_task_update *update_task;
+    };
+    /* What the submitter queues and submits, nullptr if none is allocated */
+    doca_task *task;
+    _astraea_ec_subtask_user_data user_data;
+    /* Owned by astraea, unused when the user's bufs are used */
+    _astraea_ec_strip_buf dst;
+};
+
+/**
+ * Every op reads nb_src_blocks and writes nb_dst_blocks of the same size
+ *   create:  data blocks -> rdnc blocks
+ *   recover: available blocks -> missing blocks
+ *   update:  (original, updated) pairs and rdnc blocks -> updated rdnc blocks
+ */
 struct astraea_ec_matrix {
     doca_ec_matrix *matrix;
-    uint32_t nb_data_blocks;
-    uint32_t nb_rdnc_blocks;
+    uint32_t nb_src_blocks;
+    uint32_t nb_dst_blocks;
+    /* nb_dst_blocks x nb_src_blocks for the CPU backend, empty if unknown */
+    std::vector<uint8_t> cpu_coefs;
 };
 
-struct astraea_ec_task_create {
-    /* Resources managed by task itself */
-    std::vector<_astraea_ec_subtask_create *> subtasks;
-    std::vector<std::pair<doca_buf *, doca_buf *>> sub_buf_pairs;
-    _astraea_ec_subtask_create *subtask_pool[MAX_NB_SUBTASKS_PER_TASK];
-    uint32_t cur_subtask_pos;
+struct astraea_ec_task {
+    /**
+     * Resources managed by task itself, carved from the ec subtask arena
+     * They outlive the task and are reused by the next task of this slot
+     */
+    _astraea_ec_subtask *subtasks;
+    uint32_t subtask_capacity;
+    uint32_t nb_subtasks;
+    uint32_t nb_finished_subtasks;
+    /* Of the first failed strip, DOCA_SUCCESS if none failed */
+    doca_error_t status;
+    /* Its type tells which op the task runs */
+    astraea_task general_task;
 
     /* Metadatas that we only want to set once */
     size_t origin_block_size;
@@ -70,28 +136,85 @@ struct astraea_ec_task_create {
 
     /* Resources managed by other objects */
     doca_data user_data;
-    doca_buf *original_data_blocks;
-    doca_buf *rdnc_blocks;
+    doca_buf *src_blocks;
+    doca_buf *dst_blocks;
+    /* Source strip lists of a split task, referenced until completion */
+    sgl_entry *src_sgl;
     astraea_ec *ec;
     astraea_ec_matrix *matrix;
     std::chrono::high_resolution_clock::time_point expected_time;
-    bool is_free;
+    /* When astraea_task_submit queued the strips */
+    std::chrono::high_resolution_clock::time_point submit_time;
+    /* Doorbell of the first strip, set by the submitter */
+    std::chrono::high_resolution_clock::time_point first_dispatch_time;
+    /* Submitter order: arrival + latency sla + own device time */
+    std::chrono::high_resolution_clock::time_point dispatch_deadline;
+    /* Breaks deadline ties, and the only key of fifo dispatch */
+    uint64_t submit_seq;
+    /* Strips handed to the engine, only touched by the submitter */
+    uint32_t nb_dispatched_subtasks;
+    /* Sum of the token costs of all strips */
+    uint64_t token_cost;
+    /* Set by the app and by whoever releases the slot */
+    std::atomic<task_slot_state> slot_state;
 };
 
 struct astraea_ec {
     doca_ec *ec;
-    astraea_ec_task_create_completion_cb_t success_cb;
-    astraea_ec_task_create_completion_cb_t error_cb;
-    std::queue<doca_ec_task_create *> ec_create_tasks; /* Sub tasks */
-    std::mutex ec_create_tasks_lock;
+    /* Set by astraea_ec_as_ctx */
+    astraea_ctx *ctx;
+    /* Indexed by the op of the task */
+    astraea_ec_task_completion_cb_t success_cbs[NB_TASK_TYPES];
+    astraea_ec_task_completion_cb_t error_cbs[NB_TASK_TYPES];
+    /* Tasks of every op, pushed by app threads */
+    mpsc_ring<astraea_ec_task> submitted_tasks;
+    std::atomic<uint64_t> nb_submitted_tasks;
+    /**
+     * Submitter only: tasks with strips left, moved from submitted_tasks
+     * A heap whose top holds the strip to dispatch next
+     */
+    std::vector<astraea_ec_task *> dispatch_heap;
+    /* Posted after every submit, the idle submitter sleeps on it */
+    wakeup submit_wakeup;
+    /* From astraea_task_submit to the doorbell of each strip */
+    latency_hist submit_latency;
     doca_dev *dev;
 
+    /* Profiled token cost per task shape, loaded once at create */
+    ec_cost_table *cost_table;
+    /* Tokens of strips pushed by astraea_task_submit but not submitted yet */
+    std::atomic<uint64_t> nb_queued_tokens;
+    /* Submitter's moving average of the time to submit one strip */
+    std::atomic<uint64_t> strip_overhead_in_ns;
+    granularity_stats gran_stats;
+
+    /* Longest buf list a task accepts, bounds in place rdnc lists */
+    uint32_t max_buf_list_len;
+
+    /* Staging area for strips that can't write parity in place, lazily set */
     void *tmp_rdnc_buffer;
-    doca_mmap *dst_mmap;
+    doca_mmap *tmp_rdnc_mmap;
+    bool is_tmp_rdnc_prepared;
+    doca_error_t tmp_rdnc_status;
     doca_buf_inventory *buf_inventory;
+    sgl_cache src_sgl_cache;
 
-    astraea_ec_task_create *task_pool[MAX_NB_INFLIGHT_EC_TASKS];
-    uint32_t cur_task_pos;
+    /**
+     * Allocation state below is only touched by allocate_init, which owns
+     * the ec's pe: one allocating thread at a time, free_tasks has a single
+     * consumer
+     */
+    /* Sized by the set_conf calls and grown on demand, shared by all ops */
+    chunk_arena<astraea_ec_task> task_arena;
+    chunk_arena<_astraea_ec_subtask> subtask_arena;
+    /* Runs slots outgrew, empty, by log2 of their size */
+    std::vector<_astraea_ec_subtask *>
+        free_subtask_runs[NB_SUBTASK_RUN_CLASSES];
+    /* Slots of completed tasks, pushed on completion and reused by allocate */
+    mpsc_ring<astraea_ec_task> free_tasks;
+    uint32_t nb_task_slots;
+    /* Largest num_tasks given to a set_conf call */
+    uint32_t nb_conf_tasks;
 };
 
 doca_error_t astraea_ec_create(doca_dev *dev, astraea_ec **ec);
@@ -100,24 +223,99 @@ doca_error_t astraea_ec_destroy(astraea_ec *ec);
 
 astraea_ctx *astraea_ec_as_ctx(astraea_ec *ec);
 
+/**
+ * Either callback may be null, completions of that kind are then collected
+ * with astraea_pe_poll_completions
+ */
 doca_error_t astraea_ec_task_create_set_conf(
     astraea_ec *ec,
     astraea_ec_task_create_completion_cb_t successful_task_completion_cb,
     astraea_ec_task_create_completion_cb_t error_task_completion_cb,
     uint32_t num_tasks);
 
+doca_error_t astraea_ec_task_recover_set_conf(
+    astraea_ec *ec,
+    astraea_ec_task_recover_completion_cb_t successful_task_completion_cb,
+    astraea_ec_task_recover_completion_cb_t error_task_completion_cb,
+    uint32_t num_tasks);
+
+doca_error_t astraea_ec_task_update_set_conf(
+    astraea_ec *ec,
+    astraea_ec_task_update_completion_cb_t successful_task_completion_cb,
+    astraea_ec_task_update_completion_cb_t error_task_completion_cb,
+    uint32_t num_tasks);
+
+/**
+ * dst_mmap must back rdnc_blocks for strips to write parity in place
+ * Passing nullptr makes split tasks stage parity and copy it on completion
+ * The task slot is recycled once the completion callback returns, so the task
+ * must not be touched afterwards
+ */
 doca_error_t astraea_ec_task_create_allocate_init(
     astraea_ec *ec, astraea_ec_matrix *coding_matrix, doca_mmap *src_mmap,
-    doca_buf *original_data_blocks, doca_buf *rdnc_blocks, doca_data user_data,
-    astraea_ec_task_create **task);
+    doca_mmap *dst_mmap, doca_buf *original_data_blocks, doca_buf *rdnc_blocks,
+    doca_data user_data, astraea_ec_task_create **task);
+
+/**
+ * recover_matrix comes from astraea_ec_matrix_create_recover
+ * Same mmap and slot rules as create, dst_mmap backs recovered_data_blocks
+ */
+doca_error_t astraea_ec_task_recover_allocate_init(
+    astraea_ec *ec, astraea_ec_matrix *recover_matrix, doca_mmap *src_mmap,
+    doca_mmap *dst_mmap, doca_buf *available_blocks,
+    doca_buf *recovered_data_blocks, doca_data user_data,
+    astraea_ec_task_recover **task);
+
+/**
+ * update_matrix comes from astraea_ec_matrix_create_update
+ * Same mmap and slot rules as create, dst_mmap backs updated_rdnc_blocks
+ */
+doca_error_t astraea_ec_task_update_allocate_init(
+    astraea_ec *ec, astraea_ec_matrix *update_matrix, doca_mmap *src_mmap,
+    doca_mmap *dst_mmap, doca_buf *original_updated_and_rdnc_blocks,
+    doca_buf *updated_rdnc_blocks, doca_data user_data,
+    astraea_ec_task_update **task);
 
 astraea_task *astraea_ec_task_create_as_task(astraea_ec_task_create *task);
 
+/* Internal, returns a completed task to its ec's free slots */
+void put_task_slot(astraea_ec_task *task);
+
+/* Internal, encodes a strip on the CPU into its dst bufs */
+doca_error_t run_cpu_subtask(_astraea_ec_subtask *subtask);
+
+/* Internal, completes a strip run by run_cpu_subtask, pe owner only */
+void finish_cpu_subtask(_astraea_ec_subtask *subtask, doca_error_t status);
+
+astraea_task *astraea_ec_task_recover_as_task(astraea_ec_task_recover *task);
+
+astraea_task *astraea_ec_task_update_as_task(astraea_ec_task_update *task);
+
+/* Why each strip size was chosen, counters can be read from any thread */
+const granularity_stats *astraea_ec_get_granularity_stats(astraea_ec *ec);
+
+/* Time strips spent queued before the submitter rang their doorbell */
+const latency_hist *astraea_ec_get_submit_latency(astraea_ec *ec);
+
 doca_error_t astraea_ec_matrix_create(astraea_ec *ec, doca_ec_matrix_type type,
                                       size_t data_block_count,
                                       size_t rdnc_block_count,
                                       astraea_ec_matrix **matrix);
 
+/* Decode the blocks at missing_indices from as many available blocks */
+doca_error_t
+astraea_ec_matrix_create_recover(astraea_ec *ec,
+                                 const astraea_ec_matrix *coding_matrix,
+                                 uint32_t missing_indices[], size_t n_missing,
+                                 astraea_ec_matrix **matrix);
+
+/* Refresh the rdnc blocks after the data blocks at update_indices changed */
+doca_error_t
+astraea_ec_matrix_create_update(astraea_ec *ec,
+                                const astraea_ec_matrix *coding_matrix,
+                                uint32_t update_indices[], size_t n_updates,
+                                astraea_ec_matrix **matrix);
+
 doca_error_t astraea_ec_matrix_destroy(astraea_ec_matrix *matrix);
 
 #endif
\ No newline at end of file
@@ -1,6 +1,7 @@
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cstdint>
-#include <mutex>
 #include <semaphore.h>
 
 #include <doca_error.h>
@@ -11,25 +12,38 @@
 #include "astraea_ctx.h"
 #include "astraea_ec.h"
 #include "astraea_pe.h"
+#include "cost_table.h"
+#include "cpu_spill.h"
 
 #include "doca_buf.h"
 #include "doca_log.h"
 #include "doca_mmap.h"
 #include "resource_mgmt.h"
+#include "wakeup.h"
 
 DOCA_LOG_REGISTER(ASTRAEA : PE);
 
+/**
+ * Set while this thread progresses the pe or owns it for the app, the
+ * callbacks it runs own it already
+ */
+static thread_local astraea_pe *owned_pe = nullptr;
+
 extern sem_t *metadata_sem;
 extern shared_resources *shm_data;
 extern uint32_t app_id;
 extern std::chrono::microseconds latency_sla;
 
-auto last_expect_time = std::chrono::high_resolution_clock::now();
-
-bool has_finished_task = false;
-
 doca_error_t astraea_pe_create(astraea_pe **pe) {
     *pe = new astraea_pe;
+    (*pe)->owner.store(PE_FREE, std::memory_order_relaxed);
+    (*pe)->nb_completed = 0;
+    (*pe)->completion_tail = 0;
+    (*pe)->completion_head = 0;
+    (*pe)->completion_released = 0;
+    (*pe)->last_expect_time.store(
+        std::chrono::high_resolution_clock::now().time_since_epoch().count(),
+        std::memory_order_relaxed);
 
     doca_error_t status = doca_pe_create(&(*pe)->pe);
 
@@ -53,47 +67,188 @@ doca_error_t astraea_pe_destroy(astraea_pe *pe) {
     return status;
 }
 
-uint8_t astraea_pe_progress(astraea_pe *pe) {
-    std::vector<std::unique_lock<std::mutex>> locks;
+/* Strips the CPU backend and the spill threads ran since the last progress */
+static void finish_cpu_strips(astraea_pe *pe) {
+    for (const cpu_strip &strip : pe->cpu_strips) {
+        finish_cpu_subtask(strip.subtask, strip.status);
+    }
+    pe->cpu_strips.clear();
     for (astraea_ctx *ctx : pe->ctxs) {
-        locks.push_back(std::unique_lock<std::mutex>{ctx->ctx_lock});
+        cpu_spill_collect(&ctx->spill);
     }
-    doca_pe_progress(pe->pe);
+}
 
-    if (has_finished_task) {
-        has_finished_task = false;
-        return 1;
+uint32_t astraea_pe_progress(astraea_pe *pe) {
+    uint32_t state = PE_FREE;
+    /* A submitter holds or waits for the pe, completions keep until then */
+    if (!pe->owner.compare_exchange_strong(state, PE_PROGRESS,
+                                           std::memory_order_acquire,
+                                           std::memory_order_relaxed)) {
+        return 0;
     }
-    return 0;
+    owned_pe = pe;
+
+    pe->nb_completed = 0;
+    doca_pe_progress(pe->pe);
+    finish_cpu_strips(pe);
+    const uint32_t nb_completed = pe->nb_completed;
+
+    owned_pe = nullptr;
+    /* Keeps a pending bit a submitter set meanwhile */
+    pe->owner.fetch_and(~PE_PROGRESS, std::memory_order_release);
+    return nb_completed;
 }
 
-doca_error_t astraea_task_submit(astraea_task *task) {
-    if (task->type == EC_CREATE) {
-        std::lock_guard<std::mutex> guard{
-            task->ec_task_create->ec->ec_create_tasks_lock};
+uint32_t astraea_pe_poll_completions(astraea_pe *pe, astraea_completion out[],
+                                     uint32_t max) {
+    uint32_t state = PE_FREE;
+    if (!pe->owner.compare_exchange_strong(state, PE_PROGRESS,
+                                           std::memory_order_acquire,
+                                           std::memory_order_relaxed)) {
+        return 0;
+    }
+    owned_pe = pe;
+
+    /* The app is done with what the last poll returned */
+    for (; pe->completion_released < pe->completion_head;
+         pe->completion_released++) {
+        astraea_task *task =
+            pe->completions[pe->completion_released % pe->completions.size()]
+                .task;
+        /* Freeing a polled task is a no-op, the poll alone releases it */
+        put_task_slot(task->ec_task);
+    }
+
+    if (pe->completion_tail - pe->completion_head < max) {
+        pe->nb_completed = 0;
+        doca_pe_progress(pe->pe);
+        finish_cpu_strips(pe);
+    }
 
-        auto cur_time = std::chrono::high_resolution_clock::now();
+    const uint32_t nb_out = std::min<uint64_t>(
+        max, pe->completion_tail - pe->completion_head);
+    for (uint32_t i = 0; i < nb_out; i++) {
+        out[i] = pe->completions[pe->completion_head++ %
+                                 pe->completions.size()];
+    }
 
-        last_expect_time =
-            latency_sla +
-            (last_expect_time > cur_time ? last_expect_time : cur_time);
-        task->ec_task_create->expected_time = last_expect_time;
+    owned_pe = nullptr;
+    pe->owner.fetch_and(~PE_PROGRESS, std::memory_order_release);
+    return nb_out;
+}
 
-        for (_astraea_ec_subtask_create *subtask :
-             task->ec_task_create->subtasks) {
-            task->ec_task_create->ec->ec_create_tasks.push(subtask->task);
+bool astraea_pe_acquire_for_app(astraea_pe *pe) {
+    if (pe == nullptr || owned_pe == pe) {
+        return false;
+    }
+    astraea_pe_acquire_for_submit(pe);
+    owned_pe = pe;
+    return true;
+}
+
+void astraea_pe_release_for_app(astraea_pe *pe, bool is_acquired) {
+    if (is_acquired) {
+        owned_pe = nullptr;
+        astraea_pe_release_for_submit(pe);
+    }
+}
+
+doca_error_t astraea_task_submit(astraea_task *task) {
+    if (task->type == EC_CREATE || task->type == EC_RECOVER ||
+        task->type == EC_UPDATE) {
+        astraea_ec_task *ec_task = task->ec_task;
+        const int64_t cur_time = std::chrono::high_resolution_clock::now()
+                                     .time_since_epoch()
+                                     .count();
+        const int64_t sla =
+            std::chrono::duration_cast<std::chrono::high_resolution_clock::
+                                           duration>(latency_sla)
+                .count();
+
+        /* Tasks of one pe queue behind each other, pes run side by side */
+        std::atomic<int64_t> &last_expect_time =
+            ec_task->ec->ctx->pe->last_expect_time;
+        int64_t prev_expect_time =
+            last_expect_time.load(std::memory_order_relaxed);
+        int64_t expect_time;
+        do {
+            expect_time = sla + std::max(prev_expect_time, cur_time);
+        } while (!last_expect_time.compare_exchange_weak(
+            prev_expect_time, expect_time, std::memory_order_relaxed));
+        ec_task->expected_time = std::chrono::high_resolution_clock::time_point{
+            std::chrono::high_resolution_clock::duration{expect_time}};
+        ec_task->submit_time = std::chrono::high_resolution_clock::time_point{
+            std::chrono::high_resolution_clock::duration{cur_time}};
+
+        /**
+         * Dispatch order: a task can't finish before its own strips ran, so
+         * small tasks get earlier deadlines than bulk ones submitted before
+         */
+        const int64_t device_time =
+            std::chrono::duration_cast<
+                std::chrono::high_resolution_clock::duration>(
+                std::chrono::nanoseconds((int64_t)(
+                    ec_task->token_cost *
+                    ec_task->ec->cost_table->token_time_in_ns)))
+                .count();
+        ec_task->dispatch_deadline =
+            std::chrono::high_resolution_clock::time_point{
+                std::chrono::high_resolution_clock::duration{
+                    cur_time + sla + device_time}};
+        ec_task->submit_seq = ec_task->ec->nb_submitted_tasks.fetch_add(
+            1, std::memory_order_relaxed);
+        ec_task->nb_dispatched_subtasks = 0;
+        ec_task->first_dispatch_time = {};
+
+        /* Counted before the push so the submitter never goes below zero */
+        ec_task->ec->nb_queued_tokens.fetch_add(ec_task->token_cost,
+                                                std::memory_order_relaxed);
+        /* From here on the completion path releases the slot */
+        ec_task->slot_state.store(TASK_SLOT_SUBMITTED,
+                                  std::memory_order_relaxed);
+        if (!ec_task->ec->submitted_tasks.push(ec_task)) {
+            ec_task->slot_state.store(TASK_SLOT_ALLOCATED,
+                                      std::memory_order_relaxed);
+            ec_task->ec->nb_queued_tokens.fetch_sub(ec_task->token_cost,
+                                                    std::memory_order_relaxed);
+            DOCA_LOG_ERR("Submitted task ring is full");
+            return DOCA_ERROR_AGAIN;
         }
+        wakeup_post(&ec_task->ec->submit_wakeup, false);
     }
     return DOCA_SUCCESS;
 }
 
-void astraea_task_free(astraea_task *task) { delete task; }
+/**
+ * Only releases tasks that were never submitted. Submitted tasks go back to
+ * their pool once their completion callback returns, or on the poll after
+ * the one that returned them, freeing them is a no-op
+ */
+void astraea_task_free(astraea_task *task) {
+    if ((task->type == EC_CREATE || task->type == EC_RECOVER ||
+         task->type == EC_UPDATE) &&
+        task->ec_task->slot_state.load(std::memory_order_acquire) ==
+            TASK_SLOT_ALLOCATED) {
+        /* Its DOCA tasks go back to the ctx's pool */
+        astraea_pe *pe = task->ec_task->ec->ctx->pe;
+        const bool is_acquired = astraea_pe_acquire_for_app(pe);
+        put_task_slot(task->ec_task);
+        astraea_pe_release_for_app(pe, is_acquired);
+    }
+}
 
 doca_error_t astraea_pe_connect_ctx(astraea_pe *pe, astraea_ctx *ctx) {
-    std::lock_guard<std::mutex> guard{ctx->ctx_lock};
     doca_error_t status = doca_pe_connect_ctx(pe->pe, ctx->ctx);
     if (status == DOCA_SUCCESS) {
         pe->ctxs.push_back(ctx);
+        ctx->pe = pe;
+        /* Sized before any task runs, ring positions depend on it */
+        if (ctx->type == EC) {
+            pe->completions.resize(pe->completions.size() +
+                                   MAX_NB_INFLIGHT_EC_TASKS);
+            pe->cpu_strips.reserve(pe->cpu_strips.capacity() +
+                                   MAX_SUBMIT_BATCH_SIZE);
+        }
     }
     return status;
 }
\ No newline at end of file
@@ -1,29 +1,77 @@
 #ifndef ASTRAEA_PE_H__
 #define ASTRAEA_PE_H__
 
+#include <atomic>
 #include <cstdint>
 #include <vector>
 
 #include <doca_error.h>
 #include <doca_pe.h>
 
+#include "astraea.h"
+#include "wakeup.h"
+
 /**
- * Forward declarations
+ * Ownership of a pe and the ctxs connected to it
+ *
+ * DOCA pes and ctxs are not thread safe, but the app thread progresses the
+ * pe while submitter threads submit to its ctxs. Whoever moves the owner
+ * word off PE_FREE may call into DOCA. Progress only tries once and returns
+ * if the pe is taken, submitters spin for it per batch. A waiting submitter
+ * sets PE_SUBMIT_PENDING so a busy polling app can't starve it.
+ * App threads allocating, freeing or building matrices own it like a
+ * submitter, unless they run in a completion callback of its progress.
+ * Spill threads only read the bufs of the strips they were handed.
  */
-struct astraea_ec_task_create;
-struct astraea_ctx;
+enum pe_owner : uint32_t {
+    PE_FREE = 0,
+    PE_PROGRESS = 1 << 0,
+    PE_SUBMITTER = 1 << 1,
+    PE_SUBMIT_PENDING = 1 << 2,
+};
+
+struct _astraea_ec_subtask;
+
+/* A strip the CPU backend ran, completed by the next progress */
+struct cpu_strip {
+    _astraea_ec_subtask *subtask;
+    doca_error_t status;
+};
 
 struct astraea_pe {
     doca_pe *pe;
+    /* Only touched by astraea_pe_connect_ctx and astraea_pe_destroy */
     std::vector<astraea_ctx *> ctxs;
+    std::atomic<uint32_t> owner;
+    /* User tasks completed by the running progress call, owner only */
+    uint32_t nb_completed;
+    /* Deadline of the last task submitted through this pe, clock ticks */
+    std::atomic<int64_t> last_expect_time;
+
+    /**
+     * Owner only: ring of completions of ops without callbacks, one entry
+     * per task slot of the connected ctxs so it never overflows.
+     * Entries before head were returned by the last poll, their slots are
+     * released by the next one
+     */
+    std::vector<astraea_completion> completions;
+    uint64_t completion_tail;
+    uint64_t completion_head;
+    uint64_t completion_released;
+    /**
+     * Owner only: pushed by the submitter, drained by progress. Never grows
+     * past what connecting reserved, the submitter waits for progress then
+     */
+    std::vector<cpu_strip> cpu_strips;
 };
 
-enum task_type { EC_CREATE };
+enum task_type { EC_CREATE, EC_RECOVER, EC_UPDATE, NB_TASK_TYPES };
 
 struct astraea_task {
     task_type type;
     union {
-        astraea_ec_task_create *ec_task_create;
+        /* EC_CREATE, EC_RECOVER and EC_UPDATE */
+        astraea_ec_task *ec_task;
     };
 };
 
@@ -31,7 +79,24 @@ doca_error_t astraea_pe_create(astraea_pe **pe);
 
 doca_error_t astraea_pe_destroy(astraea_pe *pe);
 
-uint8_t astraea_pe_progress(astraea_pe *pe);
+/* Returns the number of user tasks completed, never blocks */
+uint32_t astraea_pe_progress(astraea_pe *pe);
+
+/**
+ * Progress the pe and copy up to max completions of ops configured without
+ * callbacks to out, returns how many. Like progress it never blocks.
+ * The tasks stay valid until the next poll of the pe, which returns their
+ * slots for reuse
+ */
+uint32_t astraea_pe_poll_completions(astraea_pe *pe, astraea_completion out[],
+                                     uint32_t max);
+
+/* Owner only, called by the completion path */
+inline void astraea_pe_push_completion(astraea_pe *pe,
+                                       const astraea_completion &completion) {
+    pe->completions[pe->completion_tail++ % pe->completions.size()] =
+        completion;
+}
 
 doca_error_t astraea_task_submit(astraea_task *task);
 
@@ -39,4 +104,37 @@ void astraea_task_free(astraea_task *task);
 
 doca_error_t astraea_pe_connect_ctx(astraea_pe *pe, astraea_ctx *ctx);
 
+inline void astraea_pe_acquire_for_submit(astraea_pe *pe) {
+    uint32_t state = pe->owner.load(std::memory_order_relaxed);
+    while (true) {
+        if ((state & (PE_PROGRESS | PE_SUBMITTER)) == 0) {
+            if (pe->owner.compare_exchange_weak(state, PE_SUBMITTER,
+                                                std::memory_order_acquire,
+                                                std::memory_order_relaxed)) {
+                return;
+            }
+            continue;
+        }
+        if ((state & PE_SUBMIT_PENDING) == 0) {
+            pe->owner.fetch_or(PE_SUBMIT_PENDING, std::memory_order_relaxed);
+        }
+        cpu_relax();
+        state = pe->owner.load(std::memory_order_relaxed);
+    }
+}
+
+inline void astraea_pe_release_for_submit(astraea_pe *pe) {
+    pe->owner.store(PE_FREE, std::memory_order_release);
+}
+
+/**
+ * Own the pe for the app's own DOCA calls, waiting like a submitter.
+ * Returns false at once if this thread owns it already, progressing it or
+ * through an outer call, pass that to the release. pe may be null before
+ * the ctx is connected
+ */
+bool astraea_pe_acquire_for_app(astraea_pe *pe);
+
+void astraea_pe_release_for_app(astraea_pe *pe, bool is_acquired);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,69 @@
+#ifndef CHUNK_ARENA_H__
+#define CHUNK_ARENA_H__
+
+#include <algorithm>
+#include <cstddef>
+#include <new>
+#include <vector>
+
+/**
+ * Bump allocator handing out contiguous runs of T from large chunks
+ *
+ * A chunk is only allocated once the previous one can't hold the next run,
+ * so memory follows the real demand instead of the worst case. Objects never
+ * move and are released together when the arena is destroyed.
+ * Not thread safe, callers serialize allocation.
+ */
+template <typename T> class chunk_arena {
+  private:
+    struct chunk {
+        T *items;
+        size_t size;
+        size_t used;
+    };
+
+    std::vector<chunk> chunks;
+    size_t chunk_size = 1;
+
+  public:
+    chunk_arena() = default;
+    chunk_arena(const chunk_arena &) = delete;
+    chunk_arena &operator=(const chunk_arena &) = delete;
+
+    ~chunk_arena() {
+        for (chunk &c : chunks) {
+            delete[] c.items;
+        }
+    }
+
+    /* Only affects chunks allocated after this call */
+    void set_chunk_size(size_t size) { chunk_size = std::max<size_t>(size, 1); }
+
+    /* Returns nullptr if a new chunk is needed and can't be allocated */
+    T *alloc(size_t n) {
+        if (chunks.empty() || chunks.back().used + n > chunks.back().size) {
+            const size_t size = std::max(chunk_size, n);
+            T *items = new (std::nothrow) T[size]();
+            if (items == nullptr) {
+                return nullptr;
+            }
+            chunks.push_back({items, size, 0});
+        }
+
+        chunk &c = chunks.back();
+        T *items = c.items + c.used;
+        c.used += n;
+        return items;
+    }
+
+    /* Visit every object handed out so far */
+    template <typename F> void for_each(F &&visit) {
+        for (chunk &c : chunks) {
+            for (size_t i = 0; i < c.used; i++) {
+                visit(c.items[i]);
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,162 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <doca_error.h>
+#include <doca_log.h>
+
+#include "cost_table.h"
+
+DOCA_LOG_REGISTER(ASTRAEA : COST_TABLE);
+
+void ec_cost_table_init_default(ec_cost_table *table) {
+    const double ref_bytes =
+        (double)(REF_NB_DATA_BLOCKS + REF_NB_RDNC_BLOCKS) * REF_BLOCK_SIZE;
+    table->token_time_in_ns = DEFAULT_REF_TASK_TIME_IN_US * 1000;
+    for (uint32_t k = 1; k <= MAX_NB_DATA_BLOCKS; k++) {
+        for (uint32_t m = 1; m <= MAX_NB_RDNC_BLOCKS; m++) {
+            for (uint32_t b = 0; b < NB_COST_BLOCK_SIZES; b++) {
+                const double bytes =
+                    (double)(k + m) * (1UL << (b + MIN_COST_BLOCK_SIZE_LOG2));
+                table->costs[k - 1][m - 1][b] = bytes / ref_bytes;
+            }
+        }
+    }
+}
+
+/* Nearest measured values around v, clamped to the measured range */
+static std::pair<uint32_t, uint32_t>
+bracket(const std::vector<uint32_t> &measured, uint32_t v) {
+    auto hi = std::lower_bound(measured.begin(), measured.end(), v);
+    if (hi == measured.end()) {
+        return {measured.back(), measured.back()};
+    }
+    if (*hi == v || hi == measured.begin()) {
+        return {*hi, *hi};
+    }
+    return {*(hi - 1), *hi};
+}
+
+static double lerp(uint32_t x0, uint32_t x1, double y0, double y1,
+                   uint32_t x) {
+    return x0 == x1 ? y0 : y0 + (y1 - y0) * (x - x0) / (x1 - x0);
+}
+
+/* Fill one block size from a complete grid of measured block counts */
+static doca_error_t
+fill_block_size(ec_cost_table *table, uint32_t b, double ref_time,
+                const std::map<std::pair<uint32_t, uint32_t>, double> &times) {
+    std::vector<uint32_t> ks, ms;
+    for (const auto &[km, time] : times) {
+        ks.push_back(km.first);
+        ms.push_back(km.second);
+    }
+    std::sort(ks.begin(), ks.end());
+    ks.erase(std::unique(ks.begin(), ks.end()), ks.end());
+    std::sort(ms.begin(), ms.end());
+    ms.erase(std::unique(ms.begin(), ms.end()), ms.end());
+
+    if (times.size() != ks.size() * ms.size()) {
+        DOCA_LOG_ERR("Block size %lu is not a complete grid",
+                     1UL << (b + MIN_COST_BLOCK_SIZE_LOG2));
+        return DOCA_ERROR_INVALID_VALUE;
+    }
+
+    for (uint32_t k = 1; k <= MAX_NB_DATA_BLOCKS; k++) {
+        const auto [k0, k1] = bracket(ks, k);
+        for (uint32_t m = 1; m <= MAX_NB_RDNC_BLOCKS; m++) {
+            const auto [m0, m1] = bracket(ms, m);
+            const double t0 =
+                lerp(m0, m1, times.at({k0, m0}), times.at({k0, m1}), m);
+            const double t1 =
+                lerp(m0, m1, times.at({k1, m0}), times.at({k1, m1}), m);
+            table->costs[k - 1][m - 1][b] = lerp(k0, k1, t0, t1, k) / ref_time;
+        }
+    }
+    return DOCA_SUCCESS;
+}
+
+doca_error_t ec_cost_table_load(ec_cost_table *table, const char *path) {
+    std::ifstream file(path);
+    if (!file) {
+        return DOCA_ERROR_NOT_FOUND;
+    }
+
+    /* Measured times per block size, keyed by (data, rdnc) block counts */
+    std::map<std::pair<uint32_t, uint32_t>, double>
+        times[NB_COST_BLOCK_SIZES];
+    double ref_time = 0;
+
+    std::string line;
+    while (std::getline(file, line)) {
+        uint32_t k, m;
+        size_t block_size;
+        double time_us;
+        /* Header and comments don't parse */
+        if (sscanf(line.c_str(), "%u,%u,%zu,%lf", &k, &m, &block_size,
+                   &time_us) != 4) {
+            continue;
+        }
+        if (k == 0 || k > MAX_NB_DATA_BLOCKS || m == 0 ||
+            m > MAX_NB_RDNC_BLOCKS || time_us <= 0 ||
+            (block_size & (block_size - 1)) != 0 ||
+            block_size < (1UL << MIN_COST_BLOCK_SIZE_LOG2) ||
+            block_size > (1UL << MAX_COST_BLOCK_SIZE_LOG2)) {
+            DOCA_LOG_WARN("Skip unsupported cost table line: %s",
+                          line.c_str());
+            continue;
+        }
+
+        const uint32_t b =
+            __builtin_ctzll(block_size) - MIN_COST_BLOCK_SIZE_LOG2;
+        times[b][{k, m}] = time_us;
+        if (k == REF_NB_DATA_BLOCKS && m == REF_NB_RDNC_BLOCKS &&
+            block_size == REF_BLOCK_SIZE) {
+            ref_time = time_us;
+        }
+    }
+
+    if (ref_time == 0) {
+        DOCA_LOG_ERR("Cost table misses the reference shape %u + %u on %luB",
+                     REF_NB_DATA_BLOCKS, REF_NB_RDNC_BLOCKS, REF_BLOCK_SIZE);
+        return DOCA_ERROR_INVALID_VALUE;
+    }
+
+    table->token_time_in_ns = ref_time * 1000;
+
+    std::vector<uint32_t> measured;
+    for (uint32_t b = 0; b < NB_COST_BLOCK_SIZES; b++) {
+        if (times[b].empty()) {
+            continue;
+        }
+        doca_error_t status = fill_block_size(table, b, ref_time, times[b]);
+        if (status != DOCA_SUCCESS) {
+            return status;
+        }
+        measured.push_back(b);
+    }
+
+    /* Scale unmeasured block sizes from the nearest measured one */
+    for (uint32_t b = 0; b < NB_COST_BLOCK_SIZES; b++) {
+        const auto [b0, b1] = bracket(measured, b);
+        const uint32_t src = (b1 > b && b1 - b < b - b0) ? b1 : b0;
+        if (src == b) {
+            continue;
+        }
+        const double scale = b > src ? (double)(1UL << (b - src))
+                                     : 1.0 / (1UL << (src - b));
+        for (uint32_t k = 0; k < MAX_NB_DATA_BLOCKS; k++) {
+            for (uint32_t m = 0; m < MAX_NB_RDNC_BLOCKS; m++) {
+                table->costs[k][m][b] = table->costs[k][m][src] * scale;
+            }
+        }
+    }
+
+    return DOCA_SUCCESS;
+}
@@ -0,0 +1,98 @@
+#ifndef COST_TABLE_H__
+#define COST_TABLE_H__
+
+#include <cstddef>
+#include <cstdint>
+
+#include <doca_error.h>
+
+#include "ec_limits.h"
+
+/**
+ * Token cost of ec tasks per shape
+ *
+ * profiling/ec_create_doca sweeps (data blocks, rdnc blocks, block size) and
+ * writes the measured per task device time as csv lines
+ *   nb_data_blocks,nb_rdnc_blocks,block_size,time_us
+ * The table is expanded at load time to every block count on power of two
+ * block sizes, so a lookup is two loads and one interpolation.
+ * One token is the time of a 128 + 32 task on 1KiB blocks.
+ * Recover and update tasks are charged as a create task reading and writing
+ * as many blocks, see astraea_ec_matrix.
+ */
+
+constexpr char EC_COST_TABLE_ENV[] = "ASTRAEA_EC_COST_TABLE";
+constexpr char DEFAULT_EC_COST_TABLE_PATH[] = "./out/ec_cost_table.csv";
+
+constexpr uint32_t MIN_COST_BLOCK_SIZE_LOG2 = 10; /* 1KiB */
+constexpr uint32_t MAX_COST_BLOCK_SIZE_LOG2 = 20; /* 1MiB */
+constexpr uint32_t NB_COST_BLOCK_SIZES =
+    MAX_COST_BLOCK_SIZE_LOG2 - MIN_COST_BLOCK_SIZE_LOG2 + 1;
+
+constexpr uint32_t REF_NB_DATA_BLOCKS = 128;
+constexpr uint32_t REF_NB_RDNC_BLOCKS = 32;
+constexpr size_t REF_BLOCK_SIZE = 1024;
+/**
+ * Device time of the reference task when no table was profiled: its 160KiB
+ * at a nominal 8GB/s. A loaded table measures it, either way it is the
+ * time of one token
+ */
+constexpr double DEFAULT_REF_TASK_TIME_IN_US = 20;
+
+struct ec_cost_table {
+    /* Device time of the reference task, profiled or the default */
+    double token_time_in_ns;
+    /* In tokens, indexed by data blocks - 1, rdnc blocks - 1, log2 - 10 */
+    float costs[MAX_NB_DATA_BLOCKS][MAX_NB_RDNC_BLOCKS][NB_COST_BLOCK_SIZES];
+};
+
+/* Cost proportional to the bytes touched, used when no table is available */
+void ec_cost_table_init_default(ec_cost_table *table);
+
+/**
+ * Load a profiled table, unmeasured block counts are interpolated linearly
+ * between the nearest measured ones
+ */
+doca_error_t ec_cost_table_load(ec_cost_table *table, const char *path);
+
+/**
+ * O(1), interpolates between the power of two block sizes around block_size
+ * Shapes past the table, like updates reading 2u + m blocks, are scaled by
+ * the blocks touched from the largest shape in the table
+ */
+inline uint32_t ec_cost_table_lookup(const ec_cost_table *table,
+                                     uint32_t nb_data_blocks,
+                                     uint32_t nb_rdnc_blocks,
+                                     size_t block_size) {
+    if (nb_data_blocks == 0 || nb_rdnc_blocks == 0) {
+        return 1;
+    }
+    const uint32_t nb_table_data_blocks =
+        nb_data_blocks < MAX_NB_DATA_BLOCKS ? nb_data_blocks
+                                            : MAX_NB_DATA_BLOCKS;
+    const uint32_t nb_table_rdnc_blocks =
+        nb_rdnc_blocks < MAX_NB_RDNC_BLOCKS ? nb_rdnc_blocks
+                                            : MAX_NB_RDNC_BLOCKS;
+
+    const float *costs =
+        table->costs[nb_table_data_blocks - 1][nb_table_rdnc_blocks - 1];
+    float cost;
+    if (block_size <= (1UL << MIN_COST_BLOCK_SIZE_LOG2)) {
+        cost = costs[0];
+    } else if (block_size >= (1UL << MAX_COST_BLOCK_SIZE_LOG2)) {
+        cost = costs[NB_COST_BLOCK_SIZES - 1] * block_size /
+               (1UL << MAX_COST_BLOCK_SIZE_LOG2);
+    } else {
+        const uint32_t size_log2 = 63 - __builtin_clzll(block_size);
+        const uint32_t idx = size_log2 - MIN_COST_BLOCK_SIZE_LOG2;
+        const float frac =
+            (float)(block_size - (1UL << size_log2)) / (1UL << size_log2);
+        cost = costs[idx] + (costs[idx + 1] - costs[idx]) * frac;
+    }
+    cost = cost * (nb_data_blocks + nb_rdnc_blocks) /
+           (nb_table_data_blocks + nb_table_rdnc_blocks);
+
+    return cost < 1 ? 1 : (uint32_t)(cost + 0.5f);
+}
+
+#endif
@@ -0,0 +1,396 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "cpu_ec.h"
+
+/* Bytes of every block processed before moving on, keeps sources in L2 */
+constexpr size_t CPU_EC_CHUNK_SIZE = 4096;
+constexpr uint32_t GF_POLY = 0x11d;
+
+struct gf_tables {
+    uint8_t exp[512];
+    uint8_t log[256];
+    /* c * x for the low and high nibble of x, the shuffle kernels' tables */
+    alignas(16) uint8_t mul_lo[256][16];
+    alignas(16) uint8_t mul_hi[256][16];
+    /* c * x as the 8x8 bit matrix of gf2p8affine */
+    uint64_t affine[256];
+
+    gf_tables() {
+        uint32_t x = 1;
+        for (uint32_t i = 0; i < 255; i++) {
+            exp[i] = x;
+            exp[i + 255] = x;
+            log[x] = i;
+            x <<= 1;
+            if (x & 0x100) {
+                x ^= GF_POLY;
+            }
+        }
+        exp[510] = exp[0];
+        exp[511] = exp[1];
+        log[0] = 0;
+
+        for (uint32_t c = 0; c < 256; c++) {
+            for (uint32_t n = 0; n < 16; n++) {
+                mul_lo[c][n] = mul(c, n);
+                mul_hi[c][n] = mul(c, n << 4);
+            }
+            /* Byte 7 - i selects the input bits feeding output bit i */
+            uint64_t matrix = 0;
+            for (uint32_t i = 0; i < 8; i++) {
+                uint64_t row = 0;
+                for (uint32_t j = 0; j < 8; j++) {
+                    row |= (uint64_t)((mul(c, 1 << j) >> i) & 1) << j;
+                }
+                matrix |= row << (8 * (7 - i));
+            }
+            affine[c] = matrix;
+        }
+    }
+
+    uint8_t mul(uint8_t a, uint8_t b) const {
+        return a && b ? exp[log[a] + log[b]] : 0;
+    }
+};
+
+static const gf_tables &tables() {
+    static const gf_tables gf;
+    return gf;
+}
+
+uint8_t gf_mul(uint8_t a, uint8_t b) { return tables().mul(a, b); }
+
+uint8_t gf_inv(uint8_t a) {
+    const gf_tables &gf = tables();
+    return a ? gf.exp[255 - gf.log[a]] : 0;
+}
+
+bool cpu_ec_cauchy_matrix(uint32_t nb_data, uint32_t nb_rdnc, uint8_t *coefs) {
+    if (nb_data == 0 || nb_data + nb_rdnc > CPU_EC_MAX_NB_BLOCKS) {
+        return false;
+    }
+    for (uint32_t r = 0; r < nb_rdnc; r++) {
+        for (uint32_t j = 0; j < nb_data; j++) {
+            coefs[r * nb_data + j] = gf_inv((nb_data + r) ^ j);
+        }
+    }
+    return true;
+}
+
+/* Row idx of the generator: identity for data blocks, then coding rows */
+static void generator_row(const uint8_t *coding, uint32_t nb_data,
+                          uint32_t idx, uint8_t *row) {
+    if (idx < nb_data) {
+        memset(row, 0, nb_data);
+        row[idx] = 1;
+    } else {
+        memcpy(row, coding + (idx - nb_data) * nb_data, nb_data);
+    }
+}
+
+/* Gauss-Jordan in place, false if singular */
+static bool invert(uint8_t *matrix, uint8_t *inverse, uint32_t n) {
+    for (uint32_t i = 0; i < n; i++) {
+        memset(inverse + i * n, 0, n);
+        inverse[i * n + i] = 1;
+    }
+    for (uint32_t col = 0; col < n; col++) {
+        uint32_t pivot = col;
+        while (pivot < n && matrix[pivot * n + col] == 0) {
+            pivot++;
+        }
+        if (pivot == n) {
+            return false;
+        }
+        if (pivot != col) {
+            std::swap_ranges(matrix + pivot * n, matrix + pivot * n + n,
+                             matrix + col * n);
+            std::swap_ranges(inverse + pivot * n, inverse + pivot * n + n,
+                             inverse + col * n);
+        }
+        const uint8_t scale = gf_inv(matrix[col * n + col]);
+        for (uint32_t j = 0; j < n; j++) {
+            matrix[col * n + j] = gf_mul(matrix[col * n + j], scale);
+            inverse[col * n + j] = gf_mul(inverse[col * n + j], scale);
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            const uint8_t factor = matrix[i * n + col];
+            if (i == col || factor == 0) {
+                continue;
+            }
+            for (uint32_t j = 0; j < n; j++) {
+                matrix[i * n + j] ^= gf_mul(factor, matrix[col * n + j]);
+                inverse[i * n + j] ^= gf_mul(factor, inverse[col * n + j]);
+            }
+        }
+    }
+    return true;
+}
+
+bool cpu_ec_recover_matrix(const uint8_t *coding, uint32_t nb_data,
+                           uint32_t nb_rdnc, const uint32_t *missing_indices,
+                           uint32_t n_missing, uint8_t *coefs) {
+    const uint32_t nb_blocks = nb_data + nb_rdnc;
+    if (nb_blocks > CPU_EC_MAX_NB_BLOCKS) {
+        return false;
+    }
+    bool is_missing[CPU_EC_MAX_NB_BLOCKS] = {};
+    for (uint32_t i = 0; i < n_missing; i++) {
+        if (missing_indices[i] >= nb_blocks) {
+            return false;
+        }
+        is_missing[missing_indices[i]] = true;
+    }
+
+    /* Generator rows of the blocks read, then inverted */
+    uint8_t *avail = new uint8_t[2 * nb_data * nb_data];
+    uint8_t *inverse = avail + nb_data * nb_data;
+    uint32_t nb_avail = 0;
+    for (uint32_t idx = 0; idx < nb_blocks && nb_avail < nb_data; idx++) {
+        if (!is_missing[idx]) {
+            generator_row(coding, nb_data, idx, avail + nb_avail * nb_data);
+            nb_avail++;
+        }
+    }
+    if (nb_avail < nb_data || !invert(avail, inverse, nb_data)) {
+        delete[] avail;
+        return false;
+    }
+
+    /* A missing block is its generator row applied to the decoded data */
+    uint8_t row[CPU_EC_MAX_NB_BLOCKS];
+    for (uint32_t i = 0; i < n_missing; i++) {
+        generator_row(coding, nb_data, missing_indices[i], row);
+        for (uint32_t j = 0; j < nb_data; j++) {
+            uint8_t coef = 0;
+            for (uint32_t l = 0; l < nb_data; l++) {
+                coef ^= gf_mul(row[l], inverse[l * nb_data + j]);
+            }
+            coefs[i * nb_data + j] = coef;
+        }
+    }
+    delete[] avail;
+    return true;
+}
+
+bool cpu_ec_update_matrix(const uint8_t *coding, uint32_t nb_data,
+                          uint32_t nb_rdnc, const uint32_t *update_indices,
+                          uint32_t n_updates, uint8_t *coefs) {
+    const uint32_t nb_src = 2 * n_updates + nb_rdnc;
+    for (uint32_t i = 0; i < n_updates; i++) {
+        if (update_indices[i] >= nb_data) {
+            return false;
+        }
+    }
+    /* c * original + c * updated is c times the change */
+    for (uint32_t r = 0; r < nb_rdnc; r++) {
+        uint8_t *row = coefs + r * nb_src;
+        memset(row, 0, nb_src);
+        for (uint32_t i = 0; i < n_updates; i++) {
+            const uint8_t coef = coding[r * nb_data + update_indices[i]];
+            row[2 * i] = coef;
+            row[2 * i + 1] = coef;
+        }
+        row[2 * n_updates + r] = 1;
+    }
+    return true;
+}
+
+/* One dst row over len bytes at offset of every source */
+typedef void (*row_kernel_t)(const gf_tables &gf, const uint8_t *coefs,
+                             uint32_t nb_src, const uint8_t *const *src,
+                             size_t offset, uint8_t *dst, size_t len);
+
+static void row_tail(const gf_tables &gf, const uint8_t *coefs,
+                     uint32_t nb_src, const uint8_t *const *src, size_t offset,
+                     uint8_t *dst, size_t begin, size_t len) {
+    for (size_t i = begin; i < len; i++) {
+        uint8_t acc = 0;
+        for (uint32_t j = 0; j < nb_src; j++) {
+            const uint8_t x = src[j][offset + i];
+            acc ^= gf.mul_lo[coefs[j]][x & 0xf] ^ gf.mul_hi[coefs[j]][x >> 4];
+        }
+        dst[i] = acc;
+    }
+}
+
+static void row_scalar(const gf_tables &gf, const uint8_t *coefs,
+                       uint32_t nb_src, const uint8_t *const *src,
+                       size_t offset, uint8_t *dst, size_t len) {
+    row_tail(gf, coefs, nb_src, src, offset, dst, 0, len);
+}
+
+#if defined(__x86_64__)
+__attribute__((target("avx2"))) static void
+row_avx2(const gf_tables &gf, const uint8_t *coefs, uint32_t nb_src,
+         const uint8_t *const *src, size_t offset, uint8_t *dst, size_t len) {
+    const __m256i mask = _mm256_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i acc = _mm256_setzero_si256();
+        for (uint32_t j = 0; j < nb_src; j++) {
+            const __m256i lo_table = _mm256_broadcastsi128_si256(
+                _mm_load_si128((const __m128i *)gf.mul_lo[coefs[j]]));
+            const __m256i hi_table = _mm256_broadcastsi128_si256(
+                _mm_load_si128((const __m128i *)gf.mul_hi[coefs[j]]));
+            const __m256i x =
+                _mm256_loadu_si256((const __m256i *)(src[j] + offset + i));
+            const __m256i lo = _mm256_and_si256(x, mask);
+            const __m256i hi = _mm256_and_si256(_mm256_srli_epi64(x, 4), mask);
+            acc = _mm256_xor_si256(
+                acc, _mm256_xor_si256(_mm256_shuffle_epi8(lo_table, lo),
+                                      _mm256_shuffle_epi8(hi_table, hi)));
+        }
+        _mm256_storeu_si256((__m256i *)(dst + i), acc);
+    }
+    row_tail(gf, coefs, nb_src, src, offset, dst, i, len);
+}
+
+__attribute__((target("avx512f,avx512bw"))) static void
+row_avx512(const gf_tables &gf, const uint8_t *coefs, uint32_t nb_src,
+           const uint8_t *const *src, size_t offset, uint8_t *dst,
+           size_t len) {
+    const __m512i mask = _mm512_set1_epi8(0x0f);
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        __m512i acc = _mm512_setzero_si512();
+        for (uint32_t j = 0; j < nb_src; j++) {
+            /* Zero-masked forms: the unmasked intrinsics pass an undefined
+             * vector through, which g++ -Wall flags as uninitialized */
+            const __m128i lo_lane =
+                _mm_loadu_si128((const __m128i *)gf.mul_lo[coefs[j]]);
+            const __m128i hi_lane =
+                _mm_loadu_si128((const __m128i *)gf.mul_hi[coefs[j]]);
+            const __m512i lo_table =
+                _mm512_maskz_broadcast_i32x4((__mmask16)0xffff, lo_lane);
+            const __m512i hi_table =
+                _mm512_maskz_broadcast_i32x4((__mmask16)0xffff, hi_lane);
+            const __m512i x = _mm512_loadu_si512(src[j] + offset + i);
+            const __m512i lo = _mm512_and_si512(x, mask);
+            const __m512i hi = _mm512_and_si512(
+                _mm512_maskz_srli_epi64((__mmask8)0xff, x, 4), mask);
+            acc = _mm512_xor_si512(
+                acc, _mm512_xor_si512(_mm512_shuffle_epi8(lo_table, lo),
+                                      _mm512_shuffle_epi8(hi_table, hi)));
+        }
+        _mm512_storeu_si512(dst + i, acc);
+    }
+    row_tail(gf, coefs, nb_src, src, offset, dst, i, len);
+}
+
+/* One affine instruction per source instead of two shuffles */
+__attribute__((target("gfni,avx512f,avx512bw"))) static void
+row_gfni(const gf_tables &gf, const uint8_t *coefs, uint32_t nb_src,
+         const uint8_t *const *src, size_t offset, uint8_t *dst, size_t len) {
+    size_t i = 0;
+    for (; i + 64 <= len; i += 64) {
+        __m512i acc = _mm512_setzero_si512();
+        for (uint32_t j = 0; j < nb_src; j++) {
+            const __m512i x = _mm512_loadu_si512(src[j] + offset + i);
+            acc = _mm512_xor_si512(
+                acc, _mm512_gf2p8affine_epi64_epi8(
+                         x, _mm512_set1_epi64(gf.affine[coefs[j]]), 0));
+        }
+        _mm512_storeu_si512(dst + i, acc);
+    }
+    row_tail(gf, coefs, nb_src, src, offset, dst, i, len);
+}
+#endif
+
+#if defined(__aarch64__)
+static void row_neon(const gf_tables &gf, const uint8_t *coefs,
+                     uint32_t nb_src, const uint8_t *const *src,
+                     size_t offset, uint8_t *dst, size_t len) {
+    const uint8x16_t mask = vdupq_n_u8(0x0f);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        uint8x16_t acc = vdupq_n_u8(0);
+        for (uint32_t j = 0; j < nb_src; j++) {
+            const uint8x16_t lo_table = vld1q_u8(gf.mul_lo[coefs[j]]);
+            const uint8x16_t hi_table = vld1q_u8(gf.mul_hi[coefs[j]]);
+            const uint8x16_t x = vld1q_u8(src[j] + offset + i);
+            acc = veorq_u8(
+                acc, veorq_u8(vqtbl1q_u8(lo_table, vandq_u8(x, mask)),
+                              vqtbl1q_u8(hi_table, vshrq_n_u8(x, 4))));
+        }
+        vst1q_u8(dst + i, acc);
+    }
+    row_tail(gf, coefs, nb_src, src, offset, dst, i, len);
+}
+#endif
+
+struct row_kernel {
+    const char *name;
+    row_kernel_t run;
+};
+
+static bool is_supported(const char *name) {
+#if defined(__x86_64__)
+    __builtin_cpu_init();
+    if (strcmp(name, "gfni") == 0) {
+        return __builtin_cpu_supports("gfni") &&
+               __builtin_cpu_supports("avx512bw");
+    }
+    if (strcmp(name, "avx512") == 0) {
+        return __builtin_cpu_supports("avx512bw");
+    }
+    if (strcmp(name, "avx2") == 0) {
+        return __builtin_cpu_supports("avx2");
+    }
+#endif
+    return strcmp(name, "neon") == 0 || strcmp(name, "scalar") == 0;
+}
+
+/* Best first */
+static const row_kernel kernels[] = {
+#if defined(__x86_64__)
+    {"gfni", row_gfni},
+    {"avx512", row_avx512},
+    {"avx2", row_avx2},
+#elif defined(__aarch64__)
+    {"neon", row_neon},
+#endif
+    {"scalar", row_scalar},
+};
+
+static const row_kernel &select_kernel() {
+    const char *forced = getenv(CPU_EC_KERNEL_ENV);
+    for (const row_kernel &kernel : kernels) {
+        if ((forced == nullptr || strcmp(forced, kernel.name) == 0) &&
+            is_supported(kernel.name)) {
+            return kernel;
+        }
+    }
+    /* Forced to one this CPU or build lacks */
+    return kernels[sizeof(kernels) / sizeof(kernels[0]) - 1];
+}
+
+static const row_kernel &kernel() {
+    static const row_kernel &selected = select_kernel();
+    return selected;
+}
+
+const char *cpu_ec_kernel_name() { return kernel().name; }
+
+void cpu_ec_apply(const uint8_t *coefs, uint32_t nb_src, uint32_t nb_dst,
+                  size_t len, const uint8_t *const *src, uint8_t *const *dst) {
+    const gf_tables &gf = tables();
+    const row_kernel_t run = kernel().run;
+    for (size_t offset = 0; offset < len; offset += CPU_EC_CHUNK_SIZE) {
+        const size_t chunk = std::min(CPU_EC_CHUNK_SIZE, len - offset);
+        for (uint32_t r = 0; r < nb_dst; r++) {
+            run(gf, coefs + r * nb_src, nb_src, src, offset, dst[r] + offset,
+                chunk);
+        }
+    }
+}
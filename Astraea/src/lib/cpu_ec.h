@@ -0,0 +1,57 @@
+#ifndef CPU_EC_H__
+#define CPU_EC_H__
+
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Software Reed-Solomon over GF(2^8), polynomial 0x11d
+ *
+ * The Cauchy matrix is built like ISA-L's gf_gen_cauchy1_matrix, the layout
+ * DOCA_EC_MATRIX_TYPE_CAUCHY follows: rdnc row r, data column j holds
+ * 1 / ((k + r) ^ j). Every op is a matrix applied to the source blocks:
+ *   create:  nb_rdnc x k Cauchy rows
+ *   recover: rows of the missing blocks over the first k available ones
+ *   update:  c * original + c * updated + old rdnc, per rdnc row
+ * Blocks are processed in cache sized chunks by the best kernel the CPU
+ * supports, ASTRAEA_CPU_EC_KERNEL=scalar|avx2|avx512|gfni|neon forces one.
+ * No DOCA dependency, so profiling can run it on any host.
+ */
+
+constexpr char CPU_EC_KERNEL_ENV[] = "ASTRAEA_CPU_EC_KERNEL";
+/* Cauchy rows need distinct k + r and j below 256 */
+constexpr uint32_t CPU_EC_MAX_NB_BLOCKS = 256;
+
+uint8_t gf_mul(uint8_t a, uint8_t b);
+
+/* 0 has no inverse and maps to 0 */
+uint8_t gf_inv(uint8_t a);
+
+/* nb_rdnc x nb_data coefficients, false if the shape is too large */
+bool cpu_ec_cauchy_matrix(uint32_t nb_data, uint32_t nb_rdnc, uint8_t *coefs);
+
+/**
+ * n_missing x nb_data rows rebuilding the blocks at missing_indices, data
+ * blocks first then rdnc blocks, from the first nb_data blocks not missing.
+ * False if an index is out of range or too few blocks are left
+ */
+bool cpu_ec_recover_matrix(const uint8_t *coding, uint32_t nb_data,
+                           uint32_t nb_rdnc, const uint32_t *missing_indices,
+                           uint32_t n_missing, uint8_t *coefs);
+
+/**
+ * nb_rdnc x (2 * n_updates + nb_rdnc) rows reading (original, updated)
+ * pairs of the data blocks at update_indices, then the old rdnc blocks
+ */
+bool cpu_ec_update_matrix(const uint8_t *coding, uint32_t nb_data,
+                          uint32_t nb_rdnc, const uint32_t *update_indices,
+                          uint32_t n_updates, uint8_t *coefs);
+
+/* dst[r] = sum over j of coefs[r * nb_src + j] * src[j], len bytes each */
+void cpu_ec_apply(const uint8_t *coefs, uint32_t nb_src, uint32_t nb_dst,
+                  size_t len, const uint8_t *const *src, uint8_t *const *dst);
+
+/* Kernel cpu_ec_apply runs */
+const char *cpu_ec_kernel_name();
+
+#endif
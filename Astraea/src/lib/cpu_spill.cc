@@ -0,0 +1,93 @@
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <stop_token>
+#include <thread>
+#include <vector>
+
+#include <doca_error.h>
+
+#include "astraea_ec.h"
+#include "astraea_pe.h"
+#include "cpu_spill.h"
+
+static void spill_worker(std::stop_token stoken, cpu_spill_pool *pool) {
+    std::unique_lock<std::mutex> guard{pool->lock};
+    while (true) {
+        /* Wakes on stop too, cpu_spill_stop fails the leftovers */
+        if (!pool->queued_cv.wait(guard, stoken,
+                                  [pool]() { return !pool->queued.empty(); })) {
+            return;
+        }
+        _astraea_ec_subtask *subtask = pool->queued.front();
+        pool->queued.pop_front();
+
+        guard.unlock();
+        const doca_error_t status = run_cpu_subtask(subtask);
+        guard.lock();
+
+        pool->done.push_back({subtask, status});
+        pool->nb_done.fetch_add(1, std::memory_order_release);
+    }
+}
+
+void cpu_spill_start(cpu_spill_pool *pool, uint32_t nb_threads) {
+    pool->nb_inflight.store(0, std::memory_order_relaxed);
+    pool->nb_done.store(0, std::memory_order_relaxed);
+    pool->done.reserve(nb_threads * MAX_NB_SPILLS_PER_THREAD);
+    pool->collected.reserve(nb_threads * MAX_NB_SPILLS_PER_THREAD);
+    for (uint32_t i = 0; i < nb_threads; i++) {
+        pool->threads.emplace_back(spill_worker, pool);
+    }
+}
+
+void cpu_spill_stop(cpu_spill_pool *pool) {
+    for (std::jthread &thread : pool->threads) {
+        thread.request_stop();
+    }
+    pool->threads.clear();
+    for (const cpu_strip &strip : pool->done) {
+        finish_cpu_subtask(strip.subtask, strip.status);
+    }
+    for (_astraea_ec_subtask *subtask : pool->queued) {
+        finish_cpu_subtask(subtask, DOCA_ERROR_BAD_STATE);
+    }
+    pool->queued.clear();
+    pool->done.clear();
+    pool->collected.clear();
+    pool->nb_inflight.store(0, std::memory_order_relaxed);
+    pool->nb_done.store(0, std::memory_order_relaxed);
+}
+
+bool cpu_spill_push(cpu_spill_pool *pool, _astraea_ec_subtask *subtask) {
+    const uint32_t nb_threads = pool->threads.size();
+    if (pool->nb_inflight.load(std::memory_order_relaxed) >=
+        nb_threads * MAX_NB_SPILLS_PER_THREAD) {
+        return false;
+    }
+    pool->nb_inflight.fetch_add(1, std::memory_order_relaxed);
+    pool->nb_spilled_strips.fetch_add(1, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> guard{pool->lock};
+        pool->queued.push_back(subtask);
+    }
+    pool->queued_cv.notify_one();
+    return true;
+}
+
+void cpu_spill_collect(cpu_spill_pool *pool) {
+    if (pool->nb_done.load(std::memory_order_acquire) == 0) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard{pool->lock};
+        pool->collected.swap(pool->done);
+        pool->nb_done.store(0, std::memory_order_relaxed);
+    }
+    pool->nb_inflight.fetch_sub(pool->collected.size(),
+                                std::memory_order_relaxed);
+    for (const cpu_strip &strip : pool->collected) {
+        finish_cpu_subtask(strip.subtask, strip.status);
+    }
+    pool->collected.clear();
+}
@@ -0,0 +1,60 @@
+#ifndef CPU_SPILL_H__
+#define CPU_SPILL_H__
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "astraea_pe.h"
+
+/**
+ * Pool of CPU encoder threads a ctx spills strips to when out of tokens
+ *
+ * The submitter pushes a strip whose task would otherwise miss its expected
+ * time waiting for the next grants. A pool thread runs it with the CPU
+ * backend's kernel and parks the result; the pe's next progress completes
+ * it like an engine strip, so a task split over both engines still ends in
+ * one completion. Strips are coarse, one lock per strip is cheap next to
+ * encoding it.
+ */
+
+/* Strips queued or running per thread, more would only queue behind them */
+constexpr uint32_t MAX_NB_SPILLS_PER_THREAD = 4;
+
+struct cpu_spill_pool {
+    std::vector<std::jthread> threads;
+    std::mutex lock;
+    std::condition_variable_any queued_cv;
+    /* Guarded by lock */
+    std::deque<_astraea_ec_subtask *> queued;
+    std::vector<cpu_strip> done;
+    /* Owner only, swapped with done to complete outside the lock */
+    std::vector<cpu_strip> collected;
+    /* Pushed and not collected yet, lets the submitter skip a full pool */
+    std::atomic<uint32_t> nb_inflight;
+    /* Lets progress skip the lock when nothing is done */
+    std::atomic<uint32_t> nb_done;
+    std::atomic<uint64_t> nb_spilled_strips;
+};
+
+/* No-op for 0 threads, the ctx then never spills */
+void cpu_spill_start(cpu_spill_pool *pool, uint32_t nb_threads);
+
+/**
+ * Joins the threads and completes what they left, like DOCA flushes its
+ * tasks on stop: strips they ran with their status, queued ones with
+ * DOCA_ERROR_BAD_STATE. pe owner only
+ */
+void cpu_spill_stop(cpu_spill_pool *pool);
+
+/* False if the pool is stopped or has enough strips in flight already */
+bool cpu_spill_push(cpu_spill_pool *pool, _astraea_ec_subtask *subtask);
+
+/* Completes the strips the pool ran, pe owner only */
+void cpu_spill_collect(cpu_spill_pool *pool);
+
+#endif
@@ -0,0 +1,10 @@
+#ifndef EC_LIMITS_H__
+#define EC_LIMITS_H__
+
+#include <cstdint>
+
+/* Largest stripe an ec task takes, the cost table is sized by it too */
+constexpr uint32_t MAX_NB_DATA_BLOCKS = 128;
+constexpr uint32_t MAX_NB_RDNC_BLOCKS = 32;
+
+#endif
@@ -0,0 +1,174 @@
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+#include "astraea_ec.h"
+#include "cost_table.h"
+#include "granularity.h"
+#include "resource_mgmt.h"
+
+/* Strip layout and costs of one candidate size */
+static granularity_decision layout(const ec_cost_table *table,
+                                   const granularity_inputs &inputs,
+                                   size_t strip_size) {
+    granularity_decision decision;
+    decision.strip_size = strip_size;
+    decision.nb_strips = (inputs.block_size + strip_size - 1) / strip_size;
+    decision.tail_size =
+        inputs.block_size - (decision.nb_strips - 1) * strip_size;
+    decision.strip_token_cost = ec_cost_table_lookup(
+        table, inputs.nb_data_blocks, inputs.nb_rdnc_blocks, strip_size);
+    decision.tail_token_cost =
+        ec_cost_table_lookup(table, inputs.nb_data_blocks,
+                             inputs.nb_rdnc_blocks, decision.tail_size);
+    return decision;
+}
+
+/**
+ * Replay the token stream: queued strips are served first, then ours, each
+ * within a single period. A strip costing more than a grant takes a whole
+ * fresh period, see the submitter
+ */
+static int64_t predict(const ec_cost_table *table,
+                       const granularity_inputs &inputs,
+                       const granularity_decision &decision) {
+    const uint64_t avail = inputs.nb_avail_tokens;
+    const uint64_t grant =
+        inputs.nb_granted_tokens ? inputs.nb_granted_tokens : avail;
+    if (grant == 0) {
+        return std::numeric_limits<int64_t>::max();
+    }
+
+    uint64_t period;
+    uint64_t left;
+    if (inputs.nb_queued_tokens < avail) {
+        period = 0;
+        left = avail - inputs.nb_queued_tokens;
+    } else {
+        const uint64_t rest = inputs.nb_queued_tokens - avail;
+        period = 1 + rest / grant;
+        left = grant - rest % grant;
+    }
+
+    const uint64_t strip_cost =
+        std::min<uint64_t>(decision.strip_token_cost, grant);
+    const uint64_t nb_first = left / strip_cost;
+    if (decision.nb_strips > nb_first) {
+        const uint64_t nb_per_period = grant / strip_cost;
+        period += (decision.nb_strips - nb_first + nb_per_period - 1) /
+                  nb_per_period;
+    }
+
+    /* The engine runs strips one after another, pacing may hide part of it */
+    const double total_cost =
+        (double)(decision.nb_strips - 1) * decision.strip_token_cost +
+        decision.tail_token_cost;
+    const int64_t device_time = std::max(
+        (int64_t)(period * inputs.period_in_ns +
+                  decision.tail_token_cost * table->token_time_in_ns),
+        (int64_t)(total_cost * table->token_time_in_ns));
+    return device_time + decision.nb_strips * inputs.strip_overhead_in_ns;
+}
+
+/* Strips costing more than a grant overdraw the tenant, only a last resort */
+static bool fits_grant(const granularity_inputs &inputs,
+                       const granularity_decision &decision) {
+    return inputs.nb_granted_tokens == 0 ||
+           decision.strip_token_cost <= inputs.nb_granted_tokens;
+}
+
+granularity_decision choose_granularity(const ec_cost_table *table,
+                                        const granularity_inputs &inputs) {
+    granularity_decision candidate = layout(table, inputs, inputs.block_size);
+    candidate.predicted_in_ns = predict(table, inputs, candidate);
+    candidate.reason = GRANULARITY_WHOLE;
+    if (inputs.block_size <= MIN_STRIP_SIZE ||
+        (fits_grant(inputs, candidate) &&
+         candidate.predicted_in_ns <= inputs.budget_in_ns)) {
+        return candidate;
+    }
+
+    granularity_decision best = candidate;
+    bool has_fitting = fits_grant(inputs, candidate);
+
+    /* Power of two strips, largest first */
+    size_t strip_size = 1UL << (63 - __builtin_clzll(inputs.block_size));
+    if (strip_size == inputs.block_size) {
+        strip_size /= 2;
+    }
+    for (; strip_size >= MIN_STRIP_SIZE &&
+           inputs.block_size <= strip_size * MAX_NB_SUBTASKS_PER_TASK;
+         strip_size /= 2) {
+        candidate = layout(table, inputs, strip_size);
+        candidate.predicted_in_ns = predict(table, inputs, candidate);
+        if (!fits_grant(inputs, candidate)) {
+            /* Keep shrinking, the smallest one is used if nothing fits */
+            if (!has_fitting) {
+                best = candidate;
+            }
+            continue;
+        }
+        if (candidate.predicted_in_ns <= inputs.budget_in_ns) {
+            candidate.reason = GRANULARITY_SPLIT_FOR_SLA;
+            return candidate;
+        }
+        if (!has_fitting || candidate.predicted_in_ns < best.predicted_in_ns) {
+            best = candidate;
+            has_fitting = true;
+        }
+    }
+
+    best.reason = GRANULARITY_BEST_EFFORT;
+    return best;
+}
+
+void granularity_stats_record(granularity_stats *stats,
+                              const granularity_inputs &inputs,
+                              const granularity_decision &decision) {
+    stats->nb_decisions.fetch_add(1, std::memory_order_relaxed);
+    stats->nb_reasons[decision.reason].fetch_add(1, std::memory_order_relaxed);
+    if (decision.nb_strips > 1 && decision.tail_size != decision.strip_size) {
+        stats->nb_partial_tails.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    uint32_t seq = stats->last_seq.load(std::memory_order_relaxed);
+    if ((seq & 1) != 0 ||
+        !stats->last_seq.compare_exchange_strong(seq, seq + 1,
+                                                 std::memory_order_relaxed)) {
+        return;
+    }
+    std::atomic_thread_fence(std::memory_order_release);
+    const granularity_snapshot snapshot = {.inputs = inputs,
+                                           .decision = decision};
+    uint64_t words[NB_GRANULARITY_SNAPSHOT_WORDS] = {};
+    memcpy(words, &snapshot, sizeof(snapshot));
+    for (size_t i = 0; i < NB_GRANULARITY_SNAPSHOT_WORDS; i++) {
+        stats->last_words[i].store(words[i], std::memory_order_relaxed);
+    }
+    stats->last_seq.store(seq + 2, std::memory_order_release);
+}
+
+bool granularity_stats_last(const granularity_stats *stats,
+                            granularity_snapshot *snapshot) {
+    uint64_t words[NB_GRANULARITY_SNAPSHOT_WORDS];
+    uint32_t seq;
+    do {
+        seq = stats->last_seq.load(std::memory_order_acquire);
+        if ((seq & 1) != 0) {
+            continue;
+        }
+        for (size_t i = 0; i < NB_GRANULARITY_SNAPSHOT_WORDS; i++) {
+            words[i] = stats->last_words[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+    } while ((seq & 1) != 0 ||
+             stats->last_seq.load(std::memory_order_relaxed) != seq);
+    if (seq == 0) {
+        return false;
+    }
+    memcpy(snapshot, words, sizeof(*snapshot));
+    return true;
+}
@@ -0,0 +1,98 @@
+#ifndef GRANULARITY_H__
+#define GRANULARITY_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Forward declarations
+ */
+struct ec_cost_table;
+
+/**
+ * Strip size controller for ec create tasks
+ *
+ * A strip is only submitted whole within one token period, so small strips
+ * use the tokens left in the current period but pay a fixed per strip cost,
+ * while large strips waste leftovers and may wait for the next grants.
+ * Every candidate size is replayed against the token stream (tokens left
+ * now, then the grant of each later period, queued strips served first) and
+ * the largest one whose predicted completion fits the latency budget wins.
+ * If none fits, the fastest one is used.
+ */
+
+constexpr size_t MIN_STRIP_SIZE = 1024;
+
+enum granularity_reason {
+    /* The whole block meets the budget */
+    GRANULARITY_WHOLE,
+    /* The largest split meeting the budget */
+    GRANULARITY_SPLIT_FOR_SLA,
+    /* Nothing meets the budget, the fastest candidate */
+    GRANULARITY_BEST_EFFORT,
+    NB_GRANULARITY_REASONS,
+};
+
+struct granularity_inputs {
+    size_t block_size;
+    uint32_t nb_data_blocks;
+    uint32_t nb_rdnc_blocks;
+    /* Tokens left in the current period, granted per period and its length */
+    uint32_t nb_avail_tokens;
+    uint32_t nb_granted_tokens;
+    int64_t period_in_ns;
+    /* Tokens of strips queued ahead and not yet submitted */
+    uint64_t nb_queued_tokens;
+    /* Time left until the task's expected completion */
+    int64_t budget_in_ns;
+    /* Measured host side cost of submitting one strip */
+    uint64_t strip_overhead_in_ns;
+};
+
+struct granularity_decision {
+    size_t strip_size;
+    uint32_t nb_strips;
+    /* Size of the last strip, equals strip_size if it divides the block */
+    size_t tail_size;
+    uint32_t strip_token_cost;
+    uint32_t tail_token_cost;
+    int64_t predicted_in_ns;
+    granularity_reason reason;
+};
+
+/* The last decision and what it was made of, replayable offline */
+struct granularity_snapshot {
+    granularity_inputs inputs;
+    granularity_decision decision;
+};
+
+constexpr size_t NB_GRANULARITY_SNAPSHOT_WORDS =
+    (sizeof(granularity_snapshot) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+struct granularity_stats {
+    std::atomic<uint64_t> nb_decisions;
+    std::atomic<uint64_t> nb_reasons[NB_GRANULARITY_REASONS];
+    /* Split tasks whose last strip is shorter than the others */
+    std::atomic<uint64_t> nb_partial_tails;
+    /**
+     * Seqlock over the last snapshot, odd while it is written. Allocating
+     * threads racing to record skip, the snapshot is one of theirs
+     */
+    std::atomic<uint32_t> last_seq;
+    std::atomic<uint64_t> last_words[NB_GRANULARITY_SNAPSHOT_WORDS];
+};
+
+/* Pure function of its inputs, so it can be replayed offline */
+granularity_decision choose_granularity(const ec_cost_table *table,
+                                        const granularity_inputs &inputs);
+
+void granularity_stats_record(granularity_stats *stats,
+                              const granularity_inputs &inputs,
+                              const granularity_decision &decision);
+
+/* From any thread, false if no decision was recorded yet */
+bool granularity_stats_last(const granularity_stats *stats,
+                            granularity_snapshot *snapshot);
+
+#endif
@@ -0,0 +1,45 @@
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+
+#include "latency_hist.h"
+
+/* Smallest value of a bucket, the one past the last bucket is its bound */
+static uint64_t bucket_floor(uint32_t bucket) {
+    const uint32_t group = bucket >> LATENCY_HIST_SUB_BITS;
+    const uint64_t sub = bucket & ((1U << LATENCY_HIST_SUB_BITS) - 1);
+    if (group == 0) {
+        return sub;
+    }
+    return ((1UL << LATENCY_HIST_SUB_BITS) + sub) << (group - 1);
+}
+
+uint64_t latency_hist_count(const latency_hist *hist) {
+    uint64_t count = 0;
+    for (uint32_t i = 0; i < NB_LATENCY_HIST_BUCKETS; i++) {
+        count += hist->counts[i].load(std::memory_order_relaxed);
+    }
+    return count;
+}
+
+uint64_t latency_hist_percentile(const latency_hist *hist, double q) {
+    const uint64_t count = latency_hist_count(hist);
+    if (count == 0) {
+        return 0;
+    }
+
+    /* Rank of the sample, 1 based */
+    uint64_t rank = (uint64_t)std::ceil(q * count);
+    if (rank == 0) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (uint32_t i = 0; i < NB_LATENCY_HIST_BUCKETS; i++) {
+        seen += hist->counts[i].load(std::memory_order_relaxed);
+        if (seen >= rank) {
+            return bucket_floor(i + 1) - 1;
+        }
+    }
+    return bucket_floor(NB_LATENCY_HIST_BUCKETS) - 1;
+}
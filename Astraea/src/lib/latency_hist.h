@@ -0,0 +1,51 @@
+#ifndef LATENCY_HIST_H__
+#define LATENCY_HIST_H__
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Log-linear latency histogram in nanoseconds
+ *
+ * Values below 2^LATENCY_HIST_SUB_BITS get a bucket each, every larger
+ * power of two is split into 2^LATENCY_HIST_SUB_BITS linear buckets, so a
+ * percentile is off by at most 1/8 of its value. Recording is a bit scan and
+ * one relaxed add, cheap enough for the submit path.
+ */
+
+constexpr uint32_t LATENCY_HIST_SUB_BITS = 3;
+/* Longer values land in the last bucket, ~18 minutes */
+constexpr uint32_t LATENCY_HIST_MAX_LOG2 = 40;
+constexpr uint32_t NB_LATENCY_HIST_BUCKETS =
+    (LATENCY_HIST_MAX_LOG2 - LATENCY_HIST_SUB_BITS + 1)
+    << LATENCY_HIST_SUB_BITS;
+
+struct latency_hist {
+    std::atomic<uint64_t> counts[NB_LATENCY_HIST_BUCKETS];
+};
+
+inline uint32_t latency_hist_bucket(uint64_t value_in_ns) {
+    if (value_in_ns < (1UL << LATENCY_HIST_SUB_BITS)) {
+        return value_in_ns;
+    }
+    if (value_in_ns >= (1UL << LATENCY_HIST_MAX_LOG2)) {
+        return NB_LATENCY_HIST_BUCKETS - 1;
+    }
+    const uint32_t msb = 63 - __builtin_clzll(value_in_ns);
+    const uint32_t group = msb - LATENCY_HIST_SUB_BITS + 1;
+    const uint32_t sub = (value_in_ns >> (msb - LATENCY_HIST_SUB_BITS)) &
+                         ((1U << LATENCY_HIST_SUB_BITS) - 1);
+    return (group << LATENCY_HIST_SUB_BITS) + sub;
+}
+
+inline void latency_hist_record(latency_hist *hist, uint64_t value_in_ns) {
+    hist->counts[latency_hist_bucket(value_in_ns)].fetch_add(
+        1, std::memory_order_relaxed);
+}
+
+uint64_t latency_hist_count(const latency_hist *hist);
+
+/* Upper bound of the bucket holding the q quantile, 0 if nothing recorded */
+uint64_t latency_hist_percentile(const latency_hist *hist, double q);
+
+#endif
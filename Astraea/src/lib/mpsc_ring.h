@@ -0,0 +1,103 @@
+#ifndef MPSC_RING_H__
+#define MPSC_RING_H__
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+/**
+ * Bounded lock-free multi-producer/single-consumer ring of pointers
+ *
+ * Producers reserve a contiguous range of slots with a CAS on tail, so all
+ * strips of one task are published together and a full ring never leaves a
+ * task half queued. A slot holding nullptr is empty, the consumer clears a
+ * slot before advancing head, so producers only need head to know a slot is
+ * reusable. Nothing ever blocks: a full ring makes push fail and an
+ * unpublished slot makes front return nullptr.
+ */
+template <typename T> class mpsc_ring {
+  private:
+    static constexpr size_t CACHE_LINE_SIZE = 64;
+    static_assert(std::atomic<T *>::is_always_lock_free);
+
+    std::atomic<T *> *slots = nullptr;
+    uint64_t mask = 0;
+
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> tail{0};
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> head{0};
+
+  public:
+    mpsc_ring() = default;
+    mpsc_ring(const mpsc_ring &) = delete;
+    mpsc_ring &operator=(const mpsc_ring &) = delete;
+
+    ~mpsc_ring() { free(slots); }
+
+    /**
+     * Capacity is rounded up to a power of two
+     * calloc keeps untouched slots out of RSS for huge rings
+     */
+    bool init(uint64_t capacity) {
+        uint64_t size = 1;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        slots = static_cast<std::atomic<T *> *>(
+            calloc(size, sizeof(std::atomic<T *>)));
+        if (slots == nullptr) {
+            return false;
+        }
+        mask = size - 1;
+        return true;
+    }
+
+    uint64_t capacity() const { return mask + 1; }
+
+    /* Approximate, only exact when called by the consumer with no producer */
+    uint64_t size() const {
+        return tail.load(std::memory_order_relaxed) -
+               head.load(std::memory_order_relaxed);
+    }
+
+    bool empty() const { return front() == nullptr; }
+
+    /**
+     * Reserve n slots and fill them with get_item(0) ... get_item(n - 1)
+     * Returns false without side effects if the ring can't hold all of them
+     */
+    template <typename F> bool push_n(uint32_t n, F &&get_item) {
+        uint64_t pos = tail.load(std::memory_order_relaxed);
+        do {
+            if (pos + n - head.load(std::memory_order_acquire) > mask + 1) {
+                return false;
+            }
+        } while (!tail.compare_exchange_weak(pos, pos + n,
+                                             std::memory_order_relaxed));
+
+        for (uint32_t i = 0; i < n; i++) {
+            slots[(pos + i) & mask].store(get_item(i),
+                                          std::memory_order_release);
+        }
+        return true;
+    }
+
+    bool push(T *item) {
+        return push_n(1, [item](uint32_t) { return item; });
+    }
+
+    /* Consumer only */
+    T *front() const {
+        return slots[head.load(std::memory_order_relaxed) & mask].load(
+            std::memory_order_acquire);
+    }
+
+    /* Consumer only, must follow a front() that returned non-null */
+    void pop() {
+        const uint64_t pos = head.load(std::memory_order_relaxed);
+        slots[pos & mask].store(nullptr, std::memory_order_relaxed);
+        head.store(pos + 1, std::memory_order_release);
+    }
+};
+
+#endif
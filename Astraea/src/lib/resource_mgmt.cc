@@ -9,27 +9,84 @@
 
 #include "doca_error.h"
 #include "resource_mgmt.h"
+#include "task_stats.h"
 
 DOCA_LOG_REGISTER(RESOURCE_MGMT);
 
 /* Per app global variables */
 sem_t *metadata_sem = nullptr;
-sem_t *ec_token_sem = nullptr;
-sem_t *ec_deficit_sem = nullptr;
 int shm_fd = -1;
 shared_resources *shm_data = nullptr;
 uint32_t app_id = -1;
 std::chrono::microseconds latency_sla;
 
+/* Per app state starts from scratch, whoever had the slot before */
+static void clear_app_slot(shared_resources *shm, uint32_t slot) {
+    for (uint32_t half = 0; half < 2; half++) {
+        shm->ec_tokens[half][slot].store(0, std::memory_order_relaxed);
+        shm->ec_grants[half][slot].store(0, std::memory_order_relaxed);
+    }
+    shm->borrowed_tokens[slot].store(0, std::memory_order_relaxed);
+    shm->cpu_tokens[slot].store(0, std::memory_order_relaxed);
+    shm->deficits[slot].store(0, std::memory_order_relaxed);
+}
+
+uint32_t app_slot_register(shared_resources *shm, pid_t pid,
+                           const tenant_params &params) {
+    if (shm->nb_apps >= MAX_NB_APPS) {
+        return MAX_NB_APPS;
+    }
+    /* Registrations are rare, a scan keeps the registry to two arrays */
+    uint32_t slot = 0;
+    while (shm->pids[slot] != FREE_APP_SLOT) {
+        slot++;
+    }
+    clear_app_slot(shm, slot);
+    shm->slot_gens[slot].fetch_add(1, std::memory_order_relaxed);
+    shm->pids[slot] = pid;
+    shm->latency_slas_in_us[slot] = params.latency_sla_in_us;
+    shm->weights[slot] = params.weight;
+    shm->slo_classes[slot] = params.slo_class;
+    shm->active_pos[slot] = shm->nb_apps;
+    shm->active_slots[shm->nb_apps++] = slot;
+    return slot;
+}
+
+void app_slot_deregister(shared_resources *shm, uint32_t slot) {
+    /* The last active slot fills the hole */
+    const uint32_t pos = shm->active_pos[slot];
+    const uint32_t last_slot = shm->active_slots[--shm->nb_apps];
+    shm->active_slots[pos] = last_slot;
+    shm->active_pos[last_slot] = pos;
+    shm->pids[slot] = FREE_APP_SLOT;
+    clear_app_slot(shm, slot);
+}
+
 /**
  * This function not only register this app in shared memory
  * But also set output parameters for the app to check status
  */
 astraea_authenticator::astraea_authenticator(uint32_t latency,
+                                             doca_error_t *status)
+    : astraea_authenticator(
+          tenant_params{.latency_sla_in_us = latency,
+                        .weight = ASTRAEA_DEFAULT_TENANT_WEIGHT,
+                        .slo_class = ASTRAEA_SLO_THROUGHPUT},
+          status) {}
+
+astraea_authenticator::astraea_authenticator(const tenant_params &params,
                                              doca_error_t *status) {
-    latency_sla = std::chrono::microseconds(latency);
+    latency_sla = std::chrono::microseconds(params.latency_sla_in_us);
     *status = DOCA_SUCCESS;
 
+    if (params.weight == 0 || params.weight > ASTRAEA_MAX_TENANT_WEIGHT ||
+        params.slo_class > ASTRAEA_SLO_BEST_EFFORT) {
+        DOCA_LOG_ERR("Invalid tenant weight %u or SLO class %d",
+                     params.weight, (int)params.slo_class);
+        *status = DOCA_ERROR_INVALID_VALUE;
+        return;
+    }
+
     pid_t pid = getpid();
 
     metadata_sem = sem_open(METADATA_SEM_NAME, 0);
@@ -60,33 +117,53 @@ astraea_authenticator::astraea_authenticator(uint32_t latency,
         return;
     }
 
-    ec_token_sem = sem_open(EC_TOKEN_SEM_NAMES[shm_data->nb_apps], 0);
-    if (ec_token_sem == SEM_FAILED) {
-        DOCA_LOG_ERR("Failed to open corresbonding token sem");
+    if (shm_data->max_nb_apps != MAX_NB_APPS) {
+        DOCA_LOG_ERR("Scheduler has %u app slots, this app was built for %u",
+                     shm_data->max_nb_apps, MAX_NB_APPS);
         sem_post(metadata_sem);
-        *status = DOCA_ERROR_IO_FAILED;
+        *status = DOCA_ERROR_NOT_SUPPORTED;
         return;
     }
 
-    ec_deficit_sem = sem_open(EC_DEFICIT_SEM_NAMES[shm_data->nb_apps], 0);
-    if (ec_deficit_sem == SEM_FAILED) {
-        DOCA_LOG_ERR("Failed to open corresbonding deficit sem");
+    app_id = app_slot_register(shm_data, pid, params);
+    if (app_id == MAX_NB_APPS) {
+        DOCA_LOG_ERR("No room for more than %u apps", MAX_NB_APPS);
+        app_id = -1;
         sem_post(metadata_sem);
-        *status = DOCA_ERROR_IO_FAILED;
+        *status = DOCA_ERROR_FULL;
         return;
     }
 
-    app_id = shm_data->nb_apps;
-    shm_data->pids[shm_data->nb_apps++] = pid;
-
     if (sem_post(metadata_sem) == -1) {
         DOCA_LOG_ERR("Failed to release metadata_sem");
         *status = DOCA_ERROR_IO_FAILED;
         return;
     }
+
+    /* The app runs without latency stats rather than not at all */
+    if (task_stats_create() != DOCA_SUCCESS) {
+        DOCA_LOG_WARN("Task latency stats are not exported");
+    }
 }
 
 astraea_authenticator::~astraea_authenticator() {
+    task_stats_destroy();
+
+    /* Unless registration failed, or the scheduler reaped the slot */
+    if (app_id != (uint32_t)-1) {
+        if (sem_wait(metadata_sem) == -1) {
+            DOCA_LOG_ERR("Failed to access metadata_sem");
+        } else {
+            if (shm_data->pids[app_id] == getpid()) {
+                app_slot_deregister(shm_data, app_id);
+            }
+            if (sem_post(metadata_sem) == -1) {
+                DOCA_LOG_ERR("Failed to release metadata_sem");
+            }
+        }
+        app_id = -1;
+    }
+
     if (shm_data) {
         munmap(shm_data, SHM_SIZE);
         shm_data = nullptr;
@@ -97,13 +174,41 @@ astraea_authenticator::~astraea_authenticator() {
         shm_fd = -1;
     }
 
-    if (ec_token_sem) {
-        sem_close(ec_token_sem);
-        ec_token_sem = nullptr;
-    }
-
     if (metadata_sem) {
         sem_close(metadata_sem);
         metadata_sem = nullptr;
     }
+}
+
+/* C apps can't hold the RAII object, so it lives here between the calls */
+static astraea_authenticator *c_authenticator = nullptr;
+
+doca_error_t astraea_register(uint32_t latency_in_us) {
+    return astraea_register_tenant(latency_in_us,
+                                   ASTRAEA_DEFAULT_TENANT_WEIGHT,
+                                   ASTRAEA_SLO_THROUGHPUT);
+}
+
+doca_error_t astraea_register_tenant(uint32_t latency_in_us, uint32_t weight,
+                                     enum astraea_slo_class slo_class) {
+    if (c_authenticator) {
+        DOCA_LOG_ERR("App is already registered");
+        return DOCA_ERROR_BAD_STATE;
+    }
+
+    doca_error_t status;
+    c_authenticator = new astraea_authenticator(
+        tenant_params{.latency_sla_in_us = latency_in_us,
+                      .weight = weight,
+                      .slo_class = slo_class},
+        &status);
+    if (status != DOCA_SUCCESS) {
+        astraea_deregister();
+    }
+    return status;
+}
+
+void astraea_deregister(void) {
+    delete c_authenticator;
+    c_authenticator = nullptr;
 }
\ No newline at end of file
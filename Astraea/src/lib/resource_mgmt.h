@@ -1,50 +1,132 @@
 #ifndef RESOURCE_MGMT_H__
 #define RESOURCE_MGMT_H__
 
+#include <atomic>
 #include <cstddef>
 #include <cstdint>
 #include <sys/types.h>
 
 #include <doca_error.h>
 
-/**
- * Forward declarations
- */
-struct astraea_ec_task_create;
+#include "astraea.h"
+#include "latency_hist.h"
+#include "wakeup.h"
 
 /**
  * An ec create task takes 25us
  * So the ec ctx can run 40 1024B tasks per ms
  */
 
-static constexpr uint32_t MAX_SEM_NAME_LEN = 256;
-constexpr uint32_t MAX_NB_APPS = 2;
+/**
+ * The scheduler grants tokens once per period, set when it starts
+ * Apps read the period in use from refresh_period_in_ns
+ */
+constexpr uint32_t TOKEN_REFRESH_PERIOD_IN_US = 1000;
+constexpr uint32_t MIN_TOKEN_REFRESH_PERIOD_IN_US = 100;
+constexpr uint32_t MAX_TOKEN_REFRESH_PERIOD_IN_US = 10000;
+
+/* App slots in shared memory, set with meson's max_nb_apps option */
+#ifndef ASTRAEA_MAX_NB_APPS
+#define ASTRAEA_MAX_NB_APPS 256
+#endif
+constexpr uint32_t MAX_NB_APPS = ASTRAEA_MAX_NB_APPS;
+constexpr pid_t FREE_APP_SLOT = -1;
 
-/* Guard nb_apps and pids*/
+/**
+ * Guard the slot registry: nb_apps, active_slots, active_pos and pids
+ * The only semaphore apps and scheduler share, the scheduler never waits
+ * for it
+ */
 constexpr char METADATA_SEM_NAME[] = "/metadata_sem";
 
-/* Guard ec_tokens */
-constexpr char EC_TOKEN_SEM_NAMES[MAX_NB_APPS][MAX_SEM_NAME_LEN] = {
-    "/ec_token_sem1", "/ec_token_sem2"};
+constexpr char SHM_NAME[] = "/shm";
 
-/* Guard deficits */
-constexpr char EC_DEFICIT_SEM_NAMES[MAX_NB_APPS][MAX_SEM_NAME_LEN] = {
-    "/ec_deficit_sem1", "/ec_deficit_sem2"};
+/**
+ * An app's token pool is one word: the refill seq of the period it was
+ * granted in, then the tokens left. A claim is one compare and swap that
+ * can't go below zero nor take tokens of a period it didn't see
+ */
+inline uint64_t token_word(uint32_t epoch, uint32_t nb_tokens) {
+    return (uint64_t)epoch << 32 | nb_tokens;
+}
 
-constexpr char SHM_NAME[] = "/shm";
+inline uint32_t token_word_epoch(uint64_t word) { return word >> 32; }
+
+inline uint32_t token_word_tokens(uint64_t word) { return (uint32_t)word; }
 
-/* This locates on shared memory */
+/**
+ * This locates on shared memory
+ * An app owns a slot from registration to deregistration, and the per app
+ * arrays are indexed by it. Slots in use are kept dense in active_slots, so
+ * the scheduler's work follows the apps running, not MAX_NB_APPS
+ */
 struct shared_resources {
+    /* The scheduler's MAX_NB_APPS, apps built with another can't register */
+    uint32_t max_nb_apps;
     uint32_t nb_apps;
-    /* Available ec tokens for rate limiting */
-    uint32_t ec_tokens[MAX_NB_APPS];
-    /* Deficits for scheduling */
-    uint32_t deficits[MAX_NB_APPS];
+    uint32_t active_slots[MAX_NB_APPS];
+    /* Where each slot in use sits in active_slots */
+    uint32_t active_pos[MAX_NB_APPS];
+    /* Bumped by each registration, tells the scheduler a slot was reused */
+    std::atomic<uint32_t> slot_gens[MAX_NB_APPS];
+    /**
+     * Double buffered by period: apps spend half [seq & 1] while the
+     * scheduler fills the other half for the next period, then bumps
+     * refill_wakeup's seq so every app switches at once. Nobody waits
+     */
+    /* Available ec tokens for rate limiting, see token_word */
+    std::atomic<uint64_t> ec_tokens[2][MAX_NB_APPS];
+    /* Tokens granted for the period, lets apps plan the next periods */
+    std::atomic<uint32_t> ec_grants[2][MAX_NB_APPS];
+    /**
+     * Tokens the scheduler took from apps idle in the last period, same
+     * word and halves as ec_tokens. Any app out of its own claims from it
+     */
+    std::atomic<uint64_t> lent_tokens[2];
+    /* Tokens each app borrowed from lent_tokens since the last refresh */
+    std::atomic<uint32_t> borrowed_tokens[MAX_NB_APPS];
+    /* Tokens worth of strips spilled to the CPU since the last refresh */
+    std::atomic<uint32_t> cpu_tokens[MAX_NB_APPS];
+    /* Tasks that missed their expected time since the last refresh */
+    std::atomic<uint32_t> deficits[MAX_NB_APPS];
+    /* FREE_APP_SLOT if nobody registered the slot */
     pid_t pids[MAX_NB_APPS];
+    /* What each app registered with, for the scheduler's policy */
+    uint32_t latency_slas_in_us[MAX_NB_APPS];
+    uint32_t weights[MAX_NB_APPS];
+    astraea_slo_class slo_classes[MAX_NB_APPS];
+    /* Posted by every refresh, its seq numbers the token periods */
+    wakeup refill_wakeup;
+    /* Written before apps start, the scheduler's tick */
+    int64_t refresh_period_in_ns;
+    /* How late each tick woke past its deadline, read by astraea_stats */
+    latency_hist tick_jitter;
+    /* Deadlines passed by more than a period, their refresh was merged */
+    std::atomic<uint64_t> nb_missed_ticks;
+    /* Since the scheduler started, read by astraea_stats */
+    std::atomic<uint64_t> nb_lent_tokens_total;
+    std::atomic<uint64_t> nb_borrowed_tokens_total;
 };
 
+static_assert(std::atomic<uint64_t>::is_always_lock_free,
+              "token words are shared between processes");
+
 constexpr size_t SHM_SIZE = sizeof(shared_resources);
 
+/* A tenant's terms with the scheduler, see astraea_register_tenant */
+struct tenant_params {
+    uint32_t latency_sla_in_us;
+    uint32_t weight;
+    astraea_slo_class slo_class;
+};
+
+/* Slot taken for pid, MAX_NB_APPS if all are in use. Under metadata_sem */
+uint32_t app_slot_register(shared_resources *shm, pid_t pid,
+                           const tenant_params &params);
+
+/* Frees a slot in use, its tokens go with it. Under metadata_sem */
+void app_slot_deregister(shared_resources *shm, uint32_t slot);
+
 /**
  * A RAII class to register app
  * And pre-allocate global vars(shared memory and semaphore)
@@ -52,6 +134,7 @@ constexpr size_t SHM_SIZE = sizeof(shared_resources);
 class astraea_authenticator {
   public:
     astraea_authenticator(uint32_t latency, doca_error_t *status);
+    astraea_authenticator(const tenant_params &params, doca_error_t *status);
     ~astraea_authenticator();
 };
 
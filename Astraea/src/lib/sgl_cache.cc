@@ -0,0 +1,222 @@
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+#include <doca_buf.h>
+#include <doca_buf_inventory.h>
+#include <doca_error.h>
+#include <doca_log.h>
+#include <doca_mmap.h>
+
+#include "sgl_cache.h"
+
+DOCA_LOG_REGISTER(ASTRAEA : SGL_CACHE);
+
+static void push_idle(sgl_cache *cache, sgl_entry *entry) {
+    sgl_entry *&head = cache->idle_heads[entry->key.geometry()];
+    entry->idle_prev = nullptr;
+    entry->idle_next = head;
+    if (head) {
+        head->idle_prev = entry;
+    }
+    head = entry;
+}
+
+static void remove_idle(sgl_cache *cache, sgl_entry *entry) {
+    if (entry->idle_prev) {
+        entry->idle_prev->idle_next = entry->idle_next;
+    } else {
+        cache->idle_heads[entry->key.geometry()] = entry->idle_next;
+    }
+    if (entry->idle_next) {
+        entry->idle_next->idle_prev = entry->idle_prev;
+    }
+    entry->idle_prev = nullptr;
+    entry->idle_next = nullptr;
+}
+
+static void release_entry(sgl_cache *cache, sgl_entry &entry) {
+    for (doca_buf *strip : entry.strips) {
+        /* Releasing the head releases the whole list */
+        doca_buf_dec_refcount(strip, nullptr);
+    }
+    cache->nb_bufs -= entry.strips.size() * entry.key.nb_blocks;
+    entry.strips.clear();
+}
+
+/* Point every buf of an idle entry to the same strips of another stripe */
+static doca_error_t retarget_entry(sgl_entry &entry, uint8_t *base_addr) {
+    const sgl_key &key = entry.key;
+    for (uint32_t i = 0; i < entry.strips.size(); i++) {
+        doca_buf *buf = entry.strips[i];
+        for (uint32_t j = 0; j < key.nb_blocks; j++) {
+            doca_error_t status = doca_buf_set_data(
+                buf, base_addr + j * key.block_size + i * key.sub_block_size,
+                key.strip_size(i));
+            if (status != DOCA_SUCCESS) {
+                DOCA_LOG_ERR("Failed to set buf data: %s",
+                             doca_error_get_descr(status));
+                return status;
+            }
+
+            status = doca_buf_get_next_in_list(buf, &buf);
+            if (status != DOCA_SUCCESS) {
+                DOCA_LOG_ERR("Failed to get next buf: %s",
+                             doca_error_get_descr(status));
+                return status;
+            }
+        }
+    }
+    entry.key.base_addr = base_addr;
+    return DOCA_SUCCESS;
+}
+
+static doca_error_t build_entry(sgl_cache *cache, sgl_entry &entry) {
+    const sgl_key &key = entry.key;
+
+    void *mmap_addr;
+    size_t mmap_len;
+    doca_error_t status =
+        doca_mmap_get_memrange(key.mmap, &mmap_addr, &mmap_len);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to get mmap memrange: %s",
+                     doca_error_get_descr(status));
+        return status;
+    }
+
+    const uint32_t nb_strips = key.nb_strips();
+    for (uint32_t i = 0; i < nb_strips && status == DOCA_SUCCESS; i++) {
+        doca_buf *strip = nullptr;
+        for (uint32_t j = 0; j < key.nb_blocks; j++) {
+            doca_buf *buf;
+            /* Span the whole mmap so the buf can be re-targeted later */
+            status = doca_buf_inventory_buf_get_by_addr(
+                cache->buf_inventory, key.mmap, mmap_addr, mmap_len, &buf);
+            if (status != DOCA_SUCCESS) {
+                DOCA_LOG_ERR("Failed to alloc buf for data blocks: %s",
+                             doca_error_get_descr(status));
+                break;
+            }
+
+            if (strip == nullptr) {
+                strip = buf;
+                entry.strips.push_back(strip);
+            } else {
+                status = doca_buf_chain_list(strip, buf);
+                if (status != DOCA_SUCCESS) {
+                    DOCA_LOG_ERR("Failed to chain list: %s",
+                                 doca_error_get_descr(status));
+                    doca_buf_dec_refcount(buf, nullptr);
+                    break;
+                }
+            }
+        }
+    }
+
+    if (status != DOCA_SUCCESS) {
+        for (doca_buf *strip : entry.strips) {
+            doca_buf_dec_refcount(strip, nullptr);
+        }
+        entry.strips.clear();
+        return status;
+    }
+    cache->nb_bufs += entry.strips.size() * key.nb_blocks;
+
+    status = retarget_entry(entry, key.base_addr);
+    if (status != DOCA_SUCCESS) {
+        release_entry(cache, entry);
+    }
+    return status;
+}
+
+/* Evict idle entries until nb_bufs more bufs fit */
+static bool make_room(sgl_cache *cache, size_t nb_bufs) {
+    for (auto it = cache->idle_heads.begin();
+         it != cache->idle_heads.end() &&
+         cache->nb_bufs + nb_bufs > cache->max_nb_bufs;
+         it++) {
+        while (it->second &&
+               cache->nb_bufs + nb_bufs > cache->max_nb_bufs) {
+            sgl_entry *entry = it->second;
+            it->second = entry->idle_next;
+            if (it->second) {
+                it->second->idle_prev = nullptr;
+            }
+            release_entry(cache, *entry);
+            /* The key lives in the entry erase destroys */
+            const sgl_key key = entry->key;
+            cache->entries.erase(key);
+        }
+    }
+    return cache->nb_bufs + nb_bufs <= cache->max_nb_bufs;
+}
+
+void sgl_cache_init(sgl_cache *cache, doca_buf_inventory *buf_inventory,
+                    size_t max_nb_bufs) {
+    cache->buf_inventory = buf_inventory;
+    cache->nb_bufs = 0;
+    cache->max_nb_bufs = max_nb_bufs;
+}
+
+void sgl_cache_destroy(sgl_cache *cache) {
+    for (auto &[key, entry] : cache->entries) {
+        release_entry(cache, *entry);
+    }
+    cache->entries.clear();
+    cache->idle_heads.clear();
+}
+
+doca_error_t sgl_cache_get(sgl_cache *cache, const sgl_key &key,
+                           sgl_entry **entry) {
+    *entry = nullptr;
+
+    auto it = cache->entries.find(key);
+    if (it != cache->entries.end()) {
+        if (it->second->nb_users == 0) {
+            remove_idle(cache, it->second.get());
+        }
+    } else {
+        /* Re-target an idle stripe of the same shape */
+        auto idle_it = cache->idle_heads.find(key.geometry());
+        if (idle_it != cache->idle_heads.end() && idle_it->second) {
+            sgl_entry *idle_entry = idle_it->second;
+            remove_idle(cache, idle_entry);
+            auto node = cache->entries.extract(idle_entry->key);
+            doca_error_t status =
+                retarget_entry(*node.mapped(), key.base_addr);
+            if (status != DOCA_SUCCESS) {
+                release_entry(cache, *node.mapped());
+                return status;
+            }
+            node.key() = key;
+            it = cache->entries.insert(std::move(node)).position;
+        } else {
+            const size_t nb_bufs = (size_t)key.nb_strips() * key.nb_blocks;
+            if (!make_room(cache, nb_bufs)) {
+                DOCA_LOG_ERR("No idle sgl to evict");
+                return DOCA_ERROR_NO_MEMORY;
+            }
+
+            std::unique_ptr<sgl_entry> new_entry{new sgl_entry};
+            new_entry->key = key;
+            new_entry->nb_users = 0;
+            new_entry->idle_prev = nullptr;
+            new_entry->idle_next = nullptr;
+            doca_error_t status = build_entry(cache, *new_entry);
+            if (status != DOCA_SUCCESS) {
+                return status;
+            }
+            it = cache->entries.emplace(key, std::move(new_entry)).first;
+        }
+    }
+
+    it->second->nb_users++;
+    *entry = it->second.get();
+    return DOCA_SUCCESS;
+}
+
+void sgl_cache_put(sgl_cache *cache, sgl_entry *entry) {
+    if (--entry->nb_users == 0) {
+        push_idle(cache, entry);
+    }
+}
@@ -0,0 +1,124 @@
+#ifndef SGL_CACHE_H__
+#define SGL_CACHE_H__
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#include <doca_buf.h>
+#include <doca_buf_inventory.h>
+#include <doca_error.h>
+#include <doca_mmap.h>
+
+/**
+ * Cache of scatter gather lists for the data blocks of split tasks
+ *
+ * Strip i of a stripe is a buf list taking sub_block_size bytes at offset
+ * i * sub_block_size of every data block, or what is left for the last one.
+ * Building it costs three DOCA calls per block, so the lists of a stripe are
+ * kept and shared by every task encoding the same stripe geometry. Each buf
+ * spans its whole mmap, which lets an idle entry be re-targeted to another
+ * base address with doca_buf_set_data alone. Idle entries are listed by
+ * geometry, so a miss finds one to re-target without a scan.
+ * Not thread safe, gets and puts run owning the ec's pe.
+ */
+
+/* What an entry can be re-targeted across: all of its key but the address */
+struct sgl_geometry {
+    doca_mmap *mmap;
+    size_t block_size;
+    size_t sub_block_size;
+    uint32_t nb_blocks;
+
+    bool operator==(const sgl_geometry &other) const = default;
+};
+
+struct sgl_geometry_hash {
+    size_t operator()(const sgl_geometry &geometry) const {
+        size_t hash = std::hash<const void *>{}(geometry.mmap);
+        hash = hash * 31 + geometry.block_size;
+        hash = hash * 31 + geometry.sub_block_size;
+        return hash * 31 + geometry.nb_blocks;
+    }
+};
+
+struct sgl_key {
+    doca_mmap *mmap;
+    uint8_t *base_addr;
+    size_t block_size;
+    size_t sub_block_size;
+    uint32_t nb_blocks;
+
+    bool operator==(const sgl_key &other) const = default;
+
+    uint32_t nb_strips() const {
+        return (block_size + sub_block_size - 1) / sub_block_size;
+    }
+
+    size_t strip_size(uint32_t strip_id) const {
+        const size_t offset = strip_id * sub_block_size;
+        return block_size - offset < sub_block_size ? block_size - offset
+                                                     : sub_block_size;
+    }
+
+    sgl_geometry geometry() const {
+        return {.mmap = mmap,
+                .block_size = block_size,
+                .sub_block_size = sub_block_size,
+                .nb_blocks = nb_blocks};
+    }
+};
+
+struct sgl_key_hash {
+    size_t operator()(const sgl_key &key) const {
+        size_t hash = std::hash<const void *>{}(key.mmap);
+        hash = hash * 31 + std::hash<const void *>{}(key.base_addr);
+        hash = hash * 31 + key.block_size;
+        hash = hash * 31 + key.sub_block_size;
+        return hash * 31 + key.nb_blocks;
+    }
+};
+
+struct sgl_entry {
+    sgl_key key;
+    /* Head of the buf list of every strip */
+    std::vector<doca_buf *> strips;
+    /* Tasks between allocate and completion that read these lists */
+    uint32_t nb_users;
+    /* Neighbours in its geometry's idle list, while nb_users is 0 */
+    sgl_entry *idle_prev;
+    sgl_entry *idle_next;
+};
+
+struct sgl_cache {
+    doca_buf_inventory *buf_inventory;
+    std::unordered_map<sgl_key, std::unique_ptr<sgl_entry>, sgl_key_hash>
+        entries;
+    /* Most recently idle entry of each geometry seen, null if none is idle */
+    std::unordered_map<sgl_geometry, sgl_entry *, sgl_geometry_hash>
+        idle_heads;
+    /* Bufs held by all entries, idle entries are evicted above max */
+    size_t nb_bufs;
+    size_t max_nb_bufs;
+};
+
+void sgl_cache_init(sgl_cache *cache, doca_buf_inventory *buf_inventory,
+                    size_t max_nb_bufs);
+
+/* Release every cached buf, no task may still use them */
+void sgl_cache_destroy(sgl_cache *cache);
+
+/**
+ * Get the strip lists of a stripe and take a reference on them
+ * Hit: no DOCA call. Idle entry of the same geometry: re-targeted with
+ * doca_buf_set_data only. Otherwise built from the inventory.
+ */
+doca_error_t sgl_cache_get(sgl_cache *cache, const sgl_key &key,
+                           sgl_entry **entry);
+
+/* Drop the reference, the last one lists the entry as idle */
+void sgl_cache_put(sgl_cache *cache, sgl_entry *entry);
+
+#endif
@@ -0,0 +1,158 @@
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <doca_error.h>
+#include <doca_log.h>
+
+#include "latency_hist.h"
+#include "task_stats.h"
+
+DOCA_LOG_REGISTER(ASTRAEA : TASK_STATS);
+
+/**
+ * Cleared by destroy, but the mapping stays until the process exits:
+ * submitter and spill threads of ctxs still running may be recording
+ */
+static std::atomic<task_stats *> stats_data{nullptr};
+/* Slot of stats_data, claimed on the first record */
+static thread_local uint32_t stats_slot = UINT32_MAX;
+
+static void shm_name(pid_t pid, char *name, size_t len) {
+    snprintf(name, len, "%s%d", TASK_STATS_SHM_PREFIX, (int)pid);
+}
+
+doca_error_t task_stats_create() {
+    char name[64];
+    const pid_t pid = getpid();
+    shm_name(pid, name, sizeof(name));
+
+    const long nb_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    const uint32_t nb_slots =
+        NB_STATS_THREADS_PER_CPU * (uint32_t)(nb_cpus > 0 ? nb_cpus : 1);
+    const size_t size = task_stats_size(nb_slots);
+
+    int fd = shm_open(name, O_CREAT | O_RDWR, 0666);
+    if (fd == -1) {
+        DOCA_LOG_ERR("Failed to open task stats shared memory");
+        return DOCA_ERROR_IO_FAILED;
+    }
+    /* Zeroes a segment left behind by an earlier process with this pid */
+    if (ftruncate(fd, 0) == -1 || ftruncate(fd, size) == -1) {
+        DOCA_LOG_ERR("Failed to size task stats shared memory");
+        close(fd);
+        shm_unlink(name);
+        return DOCA_ERROR_IO_FAILED;
+    }
+
+    void *addr =
+        mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        DOCA_LOG_ERR("Failed to map task stats shared memory");
+        shm_unlink(name);
+        return DOCA_ERROR_IO_FAILED;
+    }
+
+    task_stats *stats = static_cast<task_stats *>(addr);
+    stats->version = TASK_STATS_VERSION;
+    stats->pid = pid;
+    stats->nb_slots = nb_slots;
+    stats->nb_threads.store(0, std::memory_order_relaxed);
+    /* Last, so a reader seeing it sees the rest */
+    stats->magic.store(TASK_STATS_MAGIC, std::memory_order_release);
+    stats_data.store(stats, std::memory_order_release);
+    return DOCA_SUCCESS;
+}
+
+void task_stats_destroy() {
+    task_stats *stats =
+        stats_data.exchange(nullptr, std::memory_order_relaxed);
+    if (stats == nullptr) {
+        return;
+    }
+    char name[64];
+    shm_name(stats->pid, name, sizeof(name));
+    shm_unlink(name);
+}
+
+void task_stats_record(task_type type, size_t block_size, uint32_t nb_strips,
+                       task_phase phase, int64_t latency_in_ns) {
+    task_stats *stats = stats_data.load(std::memory_order_acquire);
+    if (stats == nullptr) {
+        return;
+    }
+    if (stats_slot == UINT32_MAX) {
+        stats_slot = stats->nb_threads.fetch_add(1, std::memory_order_relaxed);
+    }
+    const uint32_t slot =
+        stats_slot < stats->nb_slots ? stats_slot : stats->nb_slots - 1;
+    latency_hist_record(
+        &task_stats_slot(stats, slot)
+             ->hists[type][task_stats_size_class(block_size)]
+                   [task_stats_strip_class(nb_strips)][phase],
+        latency_in_ns > 0 ? latency_in_ns : 0);
+}
+
+doca_error_t task_stats_open(pid_t pid, const task_stats **stats) {
+    char name[64];
+    shm_name(pid, name, sizeof(name));
+
+    int fd = shm_open(name, O_RDONLY, 0);
+    if (fd == -1) {
+        return DOCA_ERROR_NOT_FOUND;
+    }
+    /* Slots are sized by the recording process, the file tells how many */
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return DOCA_ERROR_IO_FAILED;
+    }
+    const size_t size = st.st_size;
+    if (size < sizeof(task_stats)) {
+        close(fd);
+        return DOCA_ERROR_NOT_SUPPORTED;
+    }
+    void *addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return DOCA_ERROR_IO_FAILED;
+    }
+
+    const task_stats *mapped = static_cast<const task_stats *>(addr);
+    if (mapped->magic.load(std::memory_order_acquire) != TASK_STATS_MAGIC ||
+        mapped->version != TASK_STATS_VERSION ||
+        task_stats_size(mapped->nb_slots) != size) {
+        munmap(addr, size);
+        return DOCA_ERROR_NOT_SUPPORTED;
+    }
+    *stats = mapped;
+    return DOCA_SUCCESS;
+}
+
+void task_stats_close(const task_stats *stats) {
+    const size_t size = task_stats_size(stats->nb_slots);
+    munmap(const_cast<task_stats *>(stats), size);
+}
+
+void task_stats_merge(const task_stats *stats, task_type type,
+                      uint32_t size_class, uint32_t strip_class,
+                      task_phase phase, latency_hist *out) {
+    for (uint32_t i = 0; i < NB_LATENCY_HIST_BUCKETS; i++) {
+        out->counts[i].store(0, std::memory_order_relaxed);
+    }
+    for (uint32_t t = 0; t < stats->nb_slots; t++) {
+        const task_stats_thread *slot = task_stats_slot(stats, t);
+        const latency_hist &hist =
+            slot->hists[type][size_class][strip_class][phase];
+        for (uint32_t i = 0; i < NB_LATENCY_HIST_BUCKETS; i++) {
+            out->counts[i].fetch_add(
+                hist.counts[i].load(std::memory_order_relaxed),
+                std::memory_order_relaxed);
+        }
+    }
+}
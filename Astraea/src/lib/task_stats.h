@@ -0,0 +1,126 @@
+#ifndef TASK_STATS_H__
+#define TASK_STATS_H__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+
+#include <doca_error.h>
+
+#include "astraea_pe.h"
+#include "latency_hist.h"
+
+/**
+ * Per task latency histograms, exported through shared memory
+ *
+ * A registered app maps /astraea_stats_<pid>, split into one slot per
+ * recording thread: the submitter records when a task's first strip rang
+ * its doorbell, the thread progressing the pe records when its last strip
+ * completed. A thread claims its slot on its first record, so recording is
+ * a relaxed add to lines no other thread writes. There are slots for a
+ * submitter and a progressing thread per online CPU, threads past the last
+ * slot share it, the adds stay correct, only slower.
+ * Another process maps the segment read only and sums the slots, counts
+ * may be a few records apart between histograms but never torn.
+ * Histograms are keyed by op, block size class and strip count class.
+ */
+
+constexpr char TASK_STATS_SHM_PREFIX[] = "/astraea_stats_";
+constexpr uint32_t TASK_STATS_MAGIC = 0x41535453; /* "ASTS" */
+constexpr uint32_t TASK_STATS_VERSION = 2;
+/* A submitter and a thread progressing its pe */
+constexpr uint32_t NB_STATS_THREADS_PER_CPU = 2;
+
+enum task_phase {
+    /* astraea_task_submit to the doorbell of the first strip */
+    TASK_PHASE_QUEUED,
+    /* First doorbell to the completion of the last strip */
+    TASK_PHASE_DEVICE,
+    /* astraea_task_submit to the completion of the last strip */
+    TASK_PHASE_TOTAL,
+    NB_TASK_PHASES,
+};
+
+/* Blocks up to 4KiB, 32KiB, 256KiB and larger */
+constexpr uint32_t NB_TASK_SIZE_CLASSES = 4;
+/* 1 strip, up to 7, up to 63 and more */
+constexpr uint32_t NB_TASK_STRIP_CLASSES = 4;
+
+struct task_stats_thread {
+    latency_hist hists[NB_TASK_TYPES][NB_TASK_SIZE_CLASSES]
+                      [NB_TASK_STRIP_CLASSES][NB_TASK_PHASES];
+};
+
+/**
+ * Header of the segment, readers check magic and version first. A line of
+ * its own, so slots start aligned and apart from it
+ */
+struct alignas(64) task_stats {
+    /* Stored last at create */
+    std::atomic<uint32_t> magic;
+    uint32_t version;
+    pid_t pid;
+    /* Slots following the header, sized at create */
+    uint32_t nb_slots;
+    /* Slots claimed so far, may exceed nb_slots */
+    std::atomic<uint32_t> nb_threads;
+};
+
+inline size_t task_stats_size(uint32_t nb_slots) {
+    return sizeof(task_stats) + nb_slots * sizeof(task_stats_thread);
+}
+
+inline const task_stats_thread *task_stats_slot(const task_stats *stats,
+                                                uint32_t slot) {
+    return reinterpret_cast<const task_stats_thread *>(stats + 1) + slot;
+}
+
+inline task_stats_thread *task_stats_slot(task_stats *stats, uint32_t slot) {
+    return reinterpret_cast<task_stats_thread *>(stats + 1) + slot;
+}
+
+inline uint32_t task_stats_size_class(size_t block_size) {
+    if (block_size <= 4096) {
+        return 0;
+    }
+    if (block_size <= 32768) {
+        return 1;
+    }
+    return block_size <= 262144 ? 2 : 3;
+}
+
+inline uint32_t task_stats_strip_class(uint32_t nb_strips) {
+    if (nb_strips <= 1) {
+        return 0;
+    }
+    if (nb_strips < 8) {
+        return 1;
+    }
+    return nb_strips < 64 ? 2 : 3;
+}
+
+/* Create this process's segment, called at registration */
+doca_error_t task_stats_create();
+
+/**
+ * Unlink it, records afterwards are dropped. Threads still recording may
+ * hold the mapping, it is left to process exit
+ */
+void task_stats_destroy();
+
+/* No op if the segment could not be created */
+void task_stats_record(task_type type, size_t block_size, uint32_t nb_strips,
+                       task_phase phase, int64_t latency_in_ns);
+
+/* Map the segment of another process read only */
+doca_error_t task_stats_open(pid_t pid, const task_stats **stats);
+
+void task_stats_close(const task_stats *stats);
+
+/* Sum one histogram over every thread slot into out */
+void task_stats_merge(const task_stats *stats, task_type type,
+                      uint32_t size_class, uint32_t strip_class,
+                      task_phase phase, latency_hist *out);
+
+#endif
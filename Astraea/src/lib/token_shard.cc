@@ -0,0 +1,222 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+
+#include "resource_mgmt.h"
+#include "token_shard.h"
+#include "wakeup.h"
+
+extern shared_resources *shm_data;
+extern uint32_t app_id;
+
+static std::atomic<uint32_t> nb_token_shards{0};
+
+uint32_t token_shard_count() {
+    return nb_token_shards.load(std::memory_order_relaxed);
+}
+
+void token_shard_join(token_shard *shard) {
+    shard->nb_tokens.store(0, std::memory_order_relaxed);
+    shard->nb_debt_tokens.store(0, std::memory_order_relaxed);
+    shard->epoch.store(wakeup_prepare(&shm_data->refill_wakeup),
+                       std::memory_order_relaxed);
+    nb_token_shards.fetch_add(1, std::memory_order_relaxed);
+}
+
+void token_shard_leave(token_shard *shard) {
+    token_shard_release(shard);
+    nb_token_shards.fetch_sub(1, std::memory_order_relaxed);
+}
+
+/* The scheduler bumps the seq once the period's half of the table is set */
+static uint32_t current_epoch() {
+    return wakeup_prepare(&shm_data->refill_wakeup);
+}
+
+/* Drop a slice of an older period, the scheduler granted afresh */
+static void expire(token_shard *shard, uint32_t epoch) {
+    if (shard->epoch.load(std::memory_order_relaxed) != epoch) {
+        shard->nb_tokens.store(0, std::memory_order_relaxed);
+        shard->epoch.store(epoch, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * From what apps idle in the last period lent, all or nothing: a borrowed
+ * token is spent right away, never handed back to this app's pool
+ */
+static bool borrow(uint32_t epoch, uint32_t nb_wanted_tokens) {
+    std::atomic<uint64_t> &pool = shm_data->lent_tokens[epoch & 1];
+    uint64_t word = pool.load(std::memory_order_acquire);
+    do {
+        if (token_word_epoch(word) != epoch ||
+            token_word_tokens(word) < nb_wanted_tokens) {
+            return false;
+        }
+    } while (!pool.compare_exchange_weak(word, word - nb_wanted_tokens,
+                                         std::memory_order_acquire,
+                                         std::memory_order_acquire));
+    shm_data->borrowed_tokens[app_id].fetch_add(nb_wanted_tokens,
+                                                std::memory_order_relaxed);
+    return true;
+}
+
+bool token_shard_take(token_shard *shard, uint32_t cost,
+                      token_receipt *receipt) {
+    uint32_t epoch = current_epoch();
+    expire(shard, epoch);
+    uint32_t nb_tokens = shard->nb_tokens.load(std::memory_order_relaxed);
+    uint32_t nb_debt_tokens =
+        shard->nb_debt_tokens.load(std::memory_order_relaxed);
+    if (nb_tokens >= cost + nb_debt_tokens) {
+        shard->nb_tokens.store(nb_tokens - cost - nb_debt_tokens,
+                               std::memory_order_relaxed);
+        shard->nb_debt_tokens.store(0, std::memory_order_relaxed);
+        *receipt = {.epoch = epoch, .nb_tokens = cost, .nb_debt_tokens = 0};
+        return true;
+    }
+
+    const uint32_t nb_shards = std::max(token_shard_count(), 1U);
+    uint32_t nb_granted_tokens = 0;
+    bool is_overdrawn = false;
+    uint32_t nb_claimed = 0;
+    while (true) {
+        std::atomic<uint64_t> &pool = shm_data->ec_tokens[epoch & 1][app_id];
+        uint64_t word = pool.load(std::memory_order_acquire);
+        if (token_word_epoch(word) != epoch) {
+            /* The half was refilled for a later period meanwhile */
+            const uint32_t new_epoch = current_epoch();
+            if (new_epoch != epoch) {
+                epoch = new_epoch;
+                expire(shard, epoch);
+                continue;
+            }
+            /* The slot was registered after the period was published */
+            nb_tokens = shard->nb_tokens.load(std::memory_order_relaxed);
+            break;
+        }
+
+        nb_granted_tokens = shm_data->ec_grants[epoch & 1][app_id].load(
+            std::memory_order_relaxed);
+        nb_tokens = shard->nb_tokens.load(std::memory_order_relaxed);
+        const uint32_t nb_pool_tokens = token_word_tokens(word);
+        if (cost > nb_granted_tokens) {
+            /* Overdraw a period with at least this shard's share left */
+            /* Never on a grant of 0, policies may leave an app out */
+            is_overdrawn = nb_debt_tokens == 0 &&
+                           nb_pool_tokens + nb_tokens >=
+                               std::max(nb_granted_tokens / nb_shards, 1U);
+            /* In debt, whatever is left goes to pay it off */
+            nb_claimed =
+                is_overdrawn || nb_debt_tokens > 0 ? nb_pool_tokens : 0;
+        } else {
+            nb_claimed = std::min(
+                std::max(cost + nb_debt_tokens - nb_tokens,
+                         nb_granted_tokens / (nb_shards * NB_SLICES_PER_SHARE)),
+                nb_pool_tokens);
+        }
+        /* A failed swap rereads the word, it may be of a later period */
+        if (nb_claimed == 0 ||
+            pool.compare_exchange_strong(word, word - nb_claimed,
+                                         std::memory_order_acquire,
+                                         std::memory_order_relaxed)) {
+            break;
+        }
+        is_overdrawn = false;
+    }
+
+    nb_tokens += nb_claimed;
+    const uint32_t nb_paid_tokens = std::min(nb_tokens, nb_debt_tokens);
+    nb_tokens -= nb_paid_tokens;
+    nb_debt_tokens -= nb_paid_tokens;
+
+    bool is_taken = false;
+    if (is_overdrawn) {
+        /* The strip runs now, what the shard lacks is paid later */
+        const uint32_t nb_debited_tokens = std::min(nb_tokens, cost);
+        *receipt = {.epoch = epoch,
+                    .nb_tokens = nb_debited_tokens,
+                    .nb_debt_tokens = cost - nb_debited_tokens};
+        nb_tokens -= nb_debited_tokens;
+        nb_debt_tokens += cost - nb_debited_tokens;
+        is_taken = true;
+    } else if (nb_debt_tokens > 0) {
+        /* Still in debt, the strip waits for later periods */
+    } else if (cost <= nb_granted_tokens && nb_tokens >= cost) {
+        *receipt = {.epoch = epoch, .nb_tokens = cost, .nb_debt_tokens = 0};
+        nb_tokens -= cost;
+        is_taken = true;
+    } else if (nb_tokens < cost && borrow(epoch, cost - nb_tokens)) {
+        /* Short of its own tokens, the rest comes from the lent pool */
+        *receipt = {.epoch = epoch, .nb_tokens = cost, .nb_debt_tokens = 0};
+        nb_tokens = 0;
+        is_taken = true;
+    }
+    shard->nb_tokens.store(nb_tokens, std::memory_order_relaxed);
+    shard->nb_debt_tokens.store(nb_debt_tokens, std::memory_order_relaxed);
+    return is_taken;
+}
+
+/* Borrowed tokens stay charged to the app, they come back as its own */
+void token_shard_refund(token_shard *shard, const token_receipt &receipt) {
+    const uint32_t nb_debt_tokens =
+        shard->nb_debt_tokens.load(std::memory_order_relaxed);
+    shard->nb_debt_tokens.store(
+        nb_debt_tokens - std::min(receipt.nb_debt_tokens, nb_debt_tokens),
+        std::memory_order_relaxed);
+    if (shard->epoch.load(std::memory_order_relaxed) == receipt.epoch) {
+        shard->nb_tokens.fetch_add(receipt.nb_tokens,
+                                   std::memory_order_relaxed);
+    }
+}
+
+void token_shard_release(token_shard *shard) {
+    const uint32_t nb_tokens =
+        shard->nb_tokens.exchange(0, std::memory_order_relaxed);
+    if (nb_tokens == 0) {
+        return;
+    }
+    /* Back to the period they were claimed in, dropped if it ended */
+    const uint32_t epoch = shard->epoch.load(std::memory_order_relaxed);
+    std::atomic<uint64_t> &pool = shm_data->ec_tokens[epoch & 1][app_id];
+    uint64_t word = pool.load(std::memory_order_relaxed);
+    while (token_word_epoch(word) == epoch &&
+           !pool.compare_exchange_weak(word, word + nb_tokens,
+                                       std::memory_order_relaxed)) {
+    }
+}
+
+void token_shard_charge_spill(uint32_t nb_tokens) {
+    shm_data->cpu_tokens[app_id].fetch_add(nb_tokens,
+                                           std::memory_order_relaxed);
+}
+
+void token_shard_estimate(const token_shard *shard, uint32_t *nb_avail_tokens,
+                          uint32_t *nb_granted_tokens) {
+    /* Racy reads, the controller only needs the order of magnitude */
+    const uint32_t nb_shards = std::max(token_shard_count(), 1U);
+    const uint32_t epoch = current_epoch();
+    const uint32_t nb_local_tokens =
+        shard->epoch.load(std::memory_order_relaxed) == epoch
+            ? shard->nb_tokens.load(std::memory_order_relaxed)
+            : 0;
+    const uint64_t word =
+        shm_data->ec_tokens[epoch & 1][app_id].load(std::memory_order_relaxed);
+    const uint64_t lent_word =
+        shm_data->lent_tokens[epoch & 1].load(std::memory_order_relaxed);
+    const uint32_t nb_tokens =
+        nb_local_tokens +
+        ((token_word_epoch(word) == epoch ? token_word_tokens(word) : 0) +
+         (token_word_epoch(lent_word) == epoch ? token_word_tokens(lent_word)
+                                               : 0)) /
+            nb_shards;
+    /* Debt is paid before anything else */
+    *nb_avail_tokens =
+        nb_tokens -
+        std::min(nb_tokens,
+                 shard->nb_debt_tokens.load(std::memory_order_relaxed));
+    *nb_granted_tokens =
+        shm_data->ec_grants[epoch & 1][app_id].load(
+            std::memory_order_relaxed) /
+        nb_shards;
+}
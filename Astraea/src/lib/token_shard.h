@@ -0,0 +1,82 @@
+#ifndef TOKEN_SHARD_H__
+#define TOKEN_SHARD_H__
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Per ctx slice of the app's ec tokens
+ *
+ * Every started ctx has its own submitter, so an app running one pe per core
+ * would hit the app's shared token word for every batch of every core. A
+ * shard instead claims a slice of the app's tokens at once and spends it
+ * without touching shared memory. Slices are the grant split over the
+ * active shards, divided by NB_SLICES_PER_SHARE, so busy shards come back
+ * for more while idle ones hand their leftover back: the split follows
+ * demand. A slice expires with
+ * the period it was claimed in, see shared_resources::refill_wakeup.
+ */
+
+/* Claims per fair share and period, bounds what an idle shard strands */
+constexpr uint32_t NB_SLICES_PER_SHARE = 4;
+
+struct token_shard {
+    /* Left in the slice, spent by the shard's submitter only */
+    std::atomic<uint32_t> nb_tokens;
+    /* Refill seq of the period the slice belongs to */
+    std::atomic<uint32_t> epoch;
+    /**
+     * What overdrawn strips cost past the tokens they got, paid off the
+     * next claims before any strip runs. Spent by the submitter only
+     */
+    std::atomic<uint32_t> nb_debt_tokens;
+};
+
+/* What a take debited, so a strip the engine refused gets exactly it back */
+struct token_receipt {
+    /* Refill seq of the period the tokens belong to */
+    uint32_t epoch;
+    /* Off the shard's slice, own and borrowed alike */
+    uint32_t nb_tokens;
+    /* Added to the shard's debt by an overdrawn strip */
+    uint32_t nb_debt_tokens;
+};
+
+/* Started ctxs in this process */
+uint32_t token_shard_count();
+
+void token_shard_join(token_shard *shard);
+
+/* Hands the leftover back to the app */
+void token_shard_leave(token_shard *shard);
+
+/**
+ * Spend cost tokens, claiming a new slice if the current one is short.
+ * A strip costing more than a whole grant takes all of a fresh period and
+ * owes the rest, the shard takes nothing until it is paid off.
+ * Out of the app's tokens, the strip borrows what idle apps lent.
+ * Only called by the shard's submitter
+ */
+bool token_shard_take(token_shard *shard, uint32_t cost,
+                      token_receipt *receipt);
+
+/**
+ * Gives a take's tokens back to the shard, those of an ended period are
+ * dropped like any leftover. Only called by the shard's submitter
+ */
+void token_shard_refund(token_shard *shard, const token_receipt &receipt);
+
+/* An idle shard returns its slice so busy ones can claim it */
+void token_shard_release(token_shard *shard);
+
+/* Tokens worth of strips encoded on the CPU, counted by the scheduler */
+void token_shard_charge_spill(uint32_t nb_tokens);
+
+/**
+ * Tokens the shard may still get this period, lent ones included, and
+ * per period, estimates
+ */
+void token_shard_estimate(const token_shard *shard, uint32_t *nb_avail_tokens,
+                          uint32_t *nb_granted_tokens);
+
+#endif
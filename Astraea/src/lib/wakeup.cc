@@ -0,0 +1,55 @@
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "wakeup.h"
+
+static long futex(std::atomic<uint32_t> *word, int op, uint32_t val,
+                  const timespec *timeout) {
+    return syscall(SYS_futex, reinterpret_cast<uint32_t *>(word), op, val,
+                   timeout, nullptr, 0);
+}
+
+void wakeup_post(wakeup *event, bool is_shared) {
+    /* Pairs with the sleeper count taken before the futex compares seq */
+    event->seq.fetch_add(1, std::memory_order_seq_cst);
+    if (event->nb_sleepers.load(std::memory_order_seq_cst) > 0) {
+        (void)futex(&event->seq,
+                    is_shared ? FUTEX_WAKE : FUTEX_WAKE_PRIVATE, INT_MAX,
+                    nullptr);
+    }
+}
+
+bool wakeup_wait(wakeup *event, uint32_t seq, int64_t timeout_in_ns,
+                 bool is_shared) {
+    const timespec timeout = {.tv_sec = timeout_in_ns / 1000000000,
+                              .tv_nsec = timeout_in_ns % 1000000000};
+
+    event->nb_sleepers.fetch_add(1, std::memory_order_seq_cst);
+    const long ret =
+        futex(&event->seq, is_shared ? FUTEX_WAIT : FUTEX_WAIT_PRIVATE, seq,
+              &timeout);
+    event->nb_sleepers.fetch_sub(1, std::memory_order_relaxed);
+
+    return ret == 0 || errno != ETIMEDOUT;
+}
+
+bool wakeup_spin(const wakeup *event, uint32_t seq, int64_t spin_in_ns) {
+    const auto deadline = std::chrono::steady_clock::now() +
+                          std::chrono::nanoseconds(spin_in_ns);
+    do {
+        for (uint32_t i = 0; i < 64; i++) {
+            if (event->seq.load(std::memory_order_acquire) != seq) {
+                return true;
+            }
+            cpu_relax();
+        }
+    } while (std::chrono::steady_clock::now() < deadline);
+    return false;
+}
@@ -0,0 +1,46 @@
+#ifndef WAKEUP_H__
+#define WAKEUP_H__
+
+#include <atomic>
+#include <cstdint>
+
+/**
+ * Futex backed event, posted by producers and waited on by the submitter
+ *
+ * A waiter reads the sequence, checks its condition, then sleeps only while
+ * the sequence is unchanged, so a post between the check and the sleep is
+ * never lost. Posters skip the syscall while nobody sleeps.
+ * Shared events live in the scheduler's shared memory and wake other
+ * processes, private ones only this process.
+ */
+
+struct wakeup {
+    std::atomic<uint32_t> seq;
+    std::atomic<uint32_t> nb_sleepers;
+};
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+              "futex words are 32 bits");
+
+inline uint32_t wakeup_prepare(const wakeup *event) {
+    return event->seq.load(std::memory_order_acquire);
+}
+
+void wakeup_post(wakeup *event, bool is_shared);
+
+/* Sleep until a post after prepare returned seq, false on timeout */
+bool wakeup_wait(wakeup *event, uint32_t seq, int64_t timeout_in_ns,
+                 bool is_shared);
+
+inline void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+/* Busy wait up to spin_in_ns for a post, true if one came */
+bool wakeup_spin(const wakeup *event, uint32_t seq, int64_t spin_in_ns);
+
+#endif
@@ -0,0 +1,157 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+#include <doca_error.h>
+
+#include "astraea_scheduler.h"
+#include "resource_mgmt.h"
+#include "scheduler_policy.h"
+#include "token_shard.h"
+#include "wakeup.h"
+
+/**
+ * Device utilization with one idle and one saturated tenant
+ * The real scheduler hands out tokens to two registered tenants: the idle
+ * one never submits, the saturated one spends tokens as fast as it gets
+ * them through token_shard_take and sleeps on the refill otherwise. Tokens
+ * spent over what the scheduler grants per ms is the utilization, with and
+ * without idle tokens lent, under every policy
+ */
+
+constexpr uint32_t REFRESH_PERIOD_IN_US = 1000;
+constexpr uint32_t WARMUP_IN_MS = 200;
+constexpr uint32_t MEASURE_IN_MS = 1000;
+/* A 1MiB stripe costs about this much */
+constexpr uint32_t TASK_COST = 50;
+constexpr uint32_t TENANT_LATENCY_IN_US = 1000;
+
+extern bool scheduler_force_quit;
+extern shared_resources *shm_data;
+
+struct bench_shm {
+    std::atomic<uint32_t> nb_ready;
+    std::atomic<bool> is_done;
+    std::atomic<uint64_t> nb_spent_tokens;
+};
+
+static void run_tenant(bench_shm *shm, bool is_saturated) {
+    doca_error_t status;
+    astraea_authenticator authenticator{
+        tenant_params{.latency_sla_in_us = TENANT_LATENCY_IN_US,
+                      .weight = ASTRAEA_DEFAULT_TENANT_WEIGHT,
+                      .slo_class = ASTRAEA_SLO_THROUGHPUT},
+        &status};
+    if (status != DOCA_SUCCESS) {
+        printf("Failed to register tenant: %s\n", doca_error_get_descr(status));
+        _exit(EXIT_FAILURE);
+    }
+    shm->nb_ready.fetch_add(1, std::memory_order_relaxed);
+
+    if (!is_saturated) {
+        while (!shm->is_done.load(std::memory_order_relaxed)) {
+            std::this_thread::sleep_for(
+                std::chrono::microseconds(REFRESH_PERIOD_IN_US));
+        }
+        return;
+    }
+
+    token_shard shard;
+    token_receipt receipt;
+    token_shard_join(&shard);
+    while (!shm->is_done.load(std::memory_order_relaxed)) {
+        const uint32_t seq = wakeup_prepare(&shm_data->refill_wakeup);
+        if (token_shard_take(&shard, TASK_COST, &receipt)) {
+            shm->nb_spent_tokens.fetch_add(TASK_COST,
+                                           std::memory_order_relaxed);
+        } else {
+            wakeup_wait(&shm_data->refill_wakeup, seq,
+                        REFRESH_PERIOD_IN_US * 1000, true);
+        }
+    }
+    token_shard_leave(&shard);
+}
+
+/* Tokens spent over tokens granted in the measured window */
+static double run(bench_shm *shm, const char *policy, bool is_lending) {
+    scheduler_config cfg = {.refresh_period_in_us = REFRESH_PERIOD_IN_US,
+                            .fifo_priority = 0,
+                            .core = -1,
+                            .policy = {},
+                            .lend_idle_tokens = is_lending};
+    strcpy(cfg.policy, policy);
+    doca_error_t status;
+    astraea_scheduler scheduler{cfg, &status};
+    if (status != DOCA_SUCCESS) {
+        printf("Failed to init scheduler: %s\n", doca_error_get_descr(status));
+        exit(EXIT_FAILURE);
+    }
+
+    shm->nb_ready.store(0, std::memory_order_relaxed);
+    shm->is_done.store(false, std::memory_order_relaxed);
+    shm->nb_spent_tokens.store(0, std::memory_order_relaxed);
+    pid_t pids[2];
+    for (uint32_t tenant = 0; tenant < 2; tenant++) {
+        pids[tenant] = fork();
+        if (pids[tenant] == -1) {
+            printf("Failed to fork tenant %u\n", tenant);
+            exit(EXIT_FAILURE);
+        }
+        if (pids[tenant] == 0) {
+            /* Leaves the shared memory to the parent's scheduler */
+            run_tenant(shm, tenant == 1);
+            _exit(EXIT_SUCCESS);
+        }
+    }
+    while (shm->nb_ready.load(std::memory_order_relaxed) < 2) {
+        std::this_thread::yield();
+    }
+
+    scheduler_force_quit = false;
+    std::thread ticker([&scheduler]() { scheduler.run(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(WARMUP_IN_MS));
+    const uint64_t nb_begin_tokens =
+        shm->nb_spent_tokens.load(std::memory_order_relaxed);
+    std::this_thread::sleep_for(std::chrono::milliseconds(MEASURE_IN_MS));
+    const uint64_t nb_end_tokens =
+        shm->nb_spent_tokens.load(std::memory_order_relaxed);
+
+    shm->is_done.store(true, std::memory_order_relaxed);
+    for (pid_t pid : pids) {
+        waitpid(pid, nullptr, 0);
+    }
+    scheduler_force_quit = true;
+    ticker.join();
+    return (double)(nb_end_tokens - nb_begin_tokens) /
+           ((double)MAX_TOKENS_PER_MS * MEASURE_IN_MS);
+}
+
+int main() {
+    bench_shm *shm = static_cast<bench_shm *>(
+        mmap(nullptr, sizeof(bench_shm), PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    if (shm == MAP_FAILED) {
+        printf("Failed to map shared memory\n");
+        return EXIT_FAILURE;
+    }
+
+    const char *policies[] = {"ewma_deficit", "fair_share", "strict_priority",
+                              "sla_proportional"};
+    for (const char *policy : policies) {
+        const double kept_util = run(shm, policy, false);
+        const double lent_util = run(shm, policy, true);
+        printf("%-17s idle + saturated tenant: utilization %.1f%% without "
+               "lending, %.1f%% with\n",
+               policy, kept_util * 100, lent_util * 100);
+    }
+
+    munmap(shm, sizeof(bench_shm));
+    return EXIT_SUCCESS;
+}
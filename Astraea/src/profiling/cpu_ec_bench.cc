@@ -0,0 +1,87 @@
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+#include "cpu_ec.h"
+
+/**
+ * Software baseline of ec_create_doca: the same shapes encoded by the CPU
+ * backend's kernel, written in the cost table format, so the hardware
+ * offload gain of a shape is the ratio of the two tables' time_us
+ */
+
+constexpr char DEFAULT_CPU_TABLE_PATH[] = "./out/ec_cpu_table.csv";
+constexpr uint32_t NB_TASKS_PER_SHAPE = 32;
+constexpr uint32_t nb_data_blocks_arr[] = {1, 2, 4, 8, 16, 32, 64, 128};
+constexpr uint32_t nb_rdnc_blocks_arr[] = {1, 2, 4, 8, 16, 32};
+constexpr size_t block_size_arr[] = {1024,   2048,   4096,   8192,
+                                     16384,  32768,  65536,  131072,
+                                     262144, 524288, 1048576};
+
+static double encode_time_in_us(uint32_t nb_data_blocks,
+                                uint32_t nb_rdnc_blocks, size_t block_size,
+                                std::vector<uint8_t> &memory) {
+    std::vector<uint8_t> coefs(nb_rdnc_blocks * nb_data_blocks);
+    cpu_ec_cauchy_matrix(nb_data_blocks, nb_rdnc_blocks, coefs.data());
+
+    std::vector<const uint8_t *> src(nb_data_blocks);
+    std::vector<uint8_t *> dst(nb_rdnc_blocks);
+    for (uint32_t i = 0; i < nb_data_blocks; i++) {
+        src[i] = memory.data() + i * block_size;
+    }
+    for (uint32_t i = 0; i < nb_rdnc_blocks; i++) {
+        dst[i] = memory.data() + (nb_data_blocks + i) * block_size;
+    }
+
+    using clock = std::chrono::steady_clock;
+    const auto begin_time = clock::now();
+    for (uint32_t i = 0; i < NB_TASKS_PER_SHAPE; i++) {
+        cpu_ec_apply(coefs.data(), nb_data_blocks, nb_rdnc_blocks, block_size,
+                     src.data(), dst.data());
+    }
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() -
+                                                                begin_time)
+               .count() /
+           1000.0 / NB_TASKS_PER_SHAPE;
+}
+
+int main(int argc, char **argv) {
+    const char *path = argc > 1 ? argv[1] : DEFAULT_CPU_TABLE_PATH;
+    std::filesystem::path table_path{path};
+    if (table_path.has_parent_path()) {
+        std::filesystem::create_directories(table_path.parent_path());
+    }
+    std::ofstream table{table_path};
+    if (!table) {
+        printf("Failed to open %s\n", path);
+        return EXIT_FAILURE;
+    }
+    table << "nb_data_blocks,nb_rdnc_blocks,block_size,time_us\n";
+
+    /* Sized for the largest shape, the data is never looked at */
+    std::vector<uint8_t> memory((128 + 32) * 1048576, 0x5a);
+    printf("Kernel %s\n", cpu_ec_kernel_name());
+    for (uint32_t nb_data_blocks : nb_data_blocks_arr) {
+        for (uint32_t nb_rdnc_blocks : nb_rdnc_blocks_arr) {
+            for (size_t block_size : block_size_arr) {
+                const double time_in_us = encode_time_in_us(
+                    nb_data_blocks, nb_rdnc_blocks, block_size, memory);
+                table << nb_data_blocks << ',' << nb_rdnc_blocks << ','
+                      << block_size << ',' << time_in_us << '\n';
+            }
+        }
+        printf("Done with %u data blocks\n", nb_data_blocks);
+    }
+
+    if (!table.flush()) {
+        printf("Failed to write %s\n", path);
+        return EXIT_FAILURE;
+    }
+    printf("CPU table written to %s\n", path);
+    return EXIT_SUCCESS;
+}
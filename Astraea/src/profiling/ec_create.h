@@ -50,4 +50,6 @@ class ec_create_resources {
     doca_error_t open_dev();
 };
 
-doca_error_t ec_create(const ec_create_config &cfg);
+/* Run cfg.nb_tasks tasks and report the mean device time per task */
+doca_error_t ec_create(const ec_create_config &cfg,
+                       double *per_task_time_in_us);
@@ -39,7 +39,8 @@ void ec_create_error_cb(doca_ec_task_create *task, doca_data task_user_data,
     DOCA_LOG_ERR("EC create task failed");
 }
 
-doca_error_t ec_create(const ec_create_config &cfg) {
+doca_error_t ec_create(const ec_create_config &cfg,
+                       double *per_task_time_in_us) {
     doca_error_t status;
 
     ec_create_resources rscs;
@@ -122,6 +123,7 @@ doca_error_t ec_create(const ec_create_config &cfg) {
                   "%u, block_size = %lu, per_task_time = %fus",
                   cfg.nb_data_blocks, cfg.nb_rdnc_blocks, cfg.block_size,
                   time_cost_in_us / cfg.nb_tasks);
+    *per_task_time_in_us = time_cost_in_us / cfg.nb_tasks;
 
     return DOCA_SUCCESS;
 }
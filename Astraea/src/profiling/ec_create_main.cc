@@ -2,11 +2,14 @@
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <filesystem>
+#include <fstream>
 #include <vector>
 
 #include <doca_error.h>
 #include <doca_log.h>
 
+#include "cost_table.h"
 #include "ec_create.h"
 
 DOCA_LOG_REGISTER(EC_CREATE : MAIN);
@@ -17,7 +20,19 @@ constexpr size_t block_size_arr[] = {1024,   2048,   4096,   8192,
                                      16384,  32768,  65536,  131072,
                                      262144, 524288, 1048576};
 
-static doca_error_t profile() {
+/* Sweep every shape and write one "k,m,block_size,time_us" line per shape */
+static doca_error_t profile(const char *path) {
+    std::filesystem::path table_path{path};
+    if (table_path.has_parent_path()) {
+        std::filesystem::create_directories(table_path.parent_path());
+    }
+    std::ofstream table{table_path};
+    if (!table) {
+        DOCA_LOG_ERR("Failed to open %s", path);
+        return DOCA_ERROR_IO_FAILED;
+    }
+    table << "nb_data_blocks,nb_rdnc_blocks,block_size,time_us\n";
+
     doca_error_t status;
     for (uint32_t i = 0; i < sizeof(nb_data_blocks_arr) / sizeof(uint32_t);
          i++) {
@@ -32,14 +47,25 @@ static doca_error_t profile() {
                                         .nb_rdnc_blocks = nb_rdnc_blocks,
                                         .block_size = block_size,
                                         .nb_tasks = 32};
-                status = ec_create(cfg);
+                double per_task_time_in_us;
+                status = ec_create(cfg, &per_task_time_in_us);
                 if (status != DOCA_SUCCESS) {
-                    DOCA_LOG_ERR("EC create failed when ");
+                    DOCA_LOG_ERR("EC create failed when nb_data_blocks = %u, "
+                                 "nb_rdnc_blocks = %u, block_size = %lu",
+                                 nb_data_blocks, nb_rdnc_blocks, block_size);
                     return status;
                 }
+                table << nb_data_blocks << ',' << nb_rdnc_blocks << ','
+                      << block_size << ',' << per_task_time_in_us << '\n';
             }
         }
     }
+
+    if (!table.flush()) {
+        DOCA_LOG_ERR("Failed to write %s", path);
+        return DOCA_ERROR_IO_FAILED;
+    }
+    DOCA_LOG_INFO("Cost table written to %s", path);
     return DOCA_SUCCESS;
 }
 
@@ -69,7 +95,8 @@ int main(int argc, char **argv) {
         return EXIT_FAILURE;
     }
 
-    status = profile();
+    /* Astraea loads this file, see ASTRAEA_EC_COST_TABLE */
+    status = profile(argc > 1 ? argv[1] : DEFAULT_EC_COST_TABLE_PATH);
     if (status != DOCA_SUCCESS) {
         DOCA_LOG_ERR("Profiling failed");
         return EXIT_FAILURE;
@@ -0,0 +1,166 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include <doca_error.h>
+
+#include "astraea_scheduler.h"
+#include "latency_hist.h"
+#include "resource_mgmt.h"
+#include "token_shard.h"
+
+/**
+ * App-side latency of a token claim while the scheduler refreshes
+ * The real scheduler ticks every period for registered tenants, each a
+ * process timing token_shard_take in a loop. Claims that cross a refresh
+ * meet the seq bump and the half being refilled, so the tail is what a
+ * refresh costs apps. Tenants and scheduler share the cores they get,
+ * preemption shows up in the tail unless they are pinned apart
+ */
+
+constexpr uint32_t REFRESH_PERIOD_IN_US = 1000;
+constexpr uint32_t WARMUP_IN_MS = 100;
+constexpr uint32_t MEASURE_IN_MS = 500;
+constexpr uint32_t TASK_COST = 1;
+/* Tenants do work between claims, leaves the cores to the scheduler */
+constexpr uint32_t CLAIM_PERIOD_IN_US = 10;
+constexpr uint32_t TENANT_LATENCY_IN_US = 1000;
+constexpr uint32_t nb_tenants_arr[] = {2, 64};
+
+extern bool scheduler_force_quit;
+
+struct bench_shm {
+    std::atomic<uint32_t> nb_ready;
+    std::atomic<bool> is_measuring;
+    std::atomic<bool> is_done;
+    std::atomic<uint64_t> max_stall_in_ns;
+    latency_hist stalls;
+};
+
+static uint64_t now_in_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+static void run_tenant(bench_shm *shm) {
+    doca_error_t status;
+    astraea_authenticator authenticator{
+        tenant_params{.latency_sla_in_us = TENANT_LATENCY_IN_US,
+                      .weight = ASTRAEA_DEFAULT_TENANT_WEIGHT,
+                      .slo_class = ASTRAEA_SLO_THROUGHPUT},
+        &status};
+    if (status != DOCA_SUCCESS) {
+        printf("Failed to register tenant: %s\n", doca_error_get_descr(status));
+        _exit(EXIT_FAILURE);
+    }
+    shm->nb_ready.fetch_add(1, std::memory_order_relaxed);
+
+    token_shard shard;
+    token_receipt receipt;
+    uint64_t max_stall_in_ns = 0;
+    token_shard_join(&shard);
+    while (!shm->is_done.load(std::memory_order_relaxed)) {
+        const uint64_t begin_time = now_in_ns();
+        /* Out of tokens is as good as taken, only the wait counts */
+        token_shard_take(&shard, TASK_COST, &receipt);
+        const uint64_t stall_in_ns = now_in_ns() - begin_time;
+        if (shm->is_measuring.load(std::memory_order_relaxed)) {
+            latency_hist_record(&shm->stalls, stall_in_ns);
+            max_stall_in_ns = std::max(max_stall_in_ns, stall_in_ns);
+        }
+        std::this_thread::sleep_for(
+            std::chrono::microseconds(CLAIM_PERIOD_IN_US));
+    }
+    token_shard_leave(&shard);
+
+    uint64_t old_max = shm->max_stall_in_ns.load(std::memory_order_relaxed);
+    while (old_max < max_stall_in_ns &&
+           !shm->max_stall_in_ns.compare_exchange_weak(
+               old_max, max_stall_in_ns, std::memory_order_relaxed)) {
+    }
+}
+
+static void run(bench_shm *shm, uint32_t nb_tenants) {
+    scheduler_config cfg = {.refresh_period_in_us = REFRESH_PERIOD_IN_US,
+                            .fifo_priority = 0,
+                            .core = -1,
+                            .policy = "ewma_deficit",
+                            .lend_idle_tokens = false};
+    doca_error_t status;
+    astraea_scheduler scheduler{cfg, &status};
+    if (status != DOCA_SUCCESS) {
+        printf("Failed to init scheduler: %s\n", doca_error_get_descr(status));
+        exit(EXIT_FAILURE);
+    }
+
+    shm->nb_ready.store(0, std::memory_order_relaxed);
+    shm->is_measuring.store(false, std::memory_order_relaxed);
+    shm->is_done.store(false, std::memory_order_relaxed);
+    shm->max_stall_in_ns.store(0, std::memory_order_relaxed);
+    for (uint32_t i = 0; i < NB_LATENCY_HIST_BUCKETS; i++) {
+        shm->stalls.counts[i].store(0, std::memory_order_relaxed);
+    }
+
+    std::vector<pid_t> pids;
+    for (uint32_t tenant = 0; tenant < nb_tenants; tenant++) {
+        const pid_t pid = fork();
+        if (pid == -1) {
+            printf("Failed to fork tenant %u\n", tenant);
+            exit(EXIT_FAILURE);
+        }
+        if (pid == 0) {
+            /* Leaves the shared memory to the parent's scheduler */
+            run_tenant(shm);
+            _exit(EXIT_SUCCESS);
+        }
+        pids.push_back(pid);
+    }
+    while (shm->nb_ready.load(std::memory_order_relaxed) < nb_tenants) {
+        std::this_thread::yield();
+    }
+
+    scheduler_force_quit = false;
+    std::thread ticker([&scheduler]() { scheduler.run(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(WARMUP_IN_MS));
+    shm->is_measuring.store(true, std::memory_order_relaxed);
+    std::this_thread::sleep_for(std::chrono::milliseconds(MEASURE_IN_MS));
+    shm->is_done.store(true, std::memory_order_relaxed);
+    for (pid_t pid : pids) {
+        waitpid(pid, nullptr, 0);
+    }
+    scheduler_force_quit = true;
+    ticker.join();
+
+    printf("%u tenants: token_shard_take p50 %.1fus, p99 %.1fus, worst "
+           "%.1fus over %lu claims\n",
+           nb_tenants, latency_hist_percentile(&shm->stalls, 0.5) / 1000.0,
+           latency_hist_percentile(&shm->stalls, 0.99) / 1000.0,
+           shm->max_stall_in_ns.load(std::memory_order_relaxed) / 1000.0,
+           latency_hist_count(&shm->stalls));
+}
+
+int main() {
+    bench_shm *shm = static_cast<bench_shm *>(
+        mmap(nullptr, sizeof(bench_shm), PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    if (shm == MAP_FAILED) {
+        printf("Failed to map shared memory\n");
+        return EXIT_FAILURE;
+    }
+
+    for (uint32_t nb_tenants : nb_tenants_arr) {
+        run(shm, nb_tenants);
+    }
+
+    munmap(shm, sizeof(bench_shm));
+    return EXIT_SUCCESS;
+}
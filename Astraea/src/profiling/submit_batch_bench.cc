@@ -0,0 +1,170 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include <doca_ctx.h>
+#include <doca_erasure_coding.h>
+#include <doca_error.h>
+#include <doca_log.h>
+#include <doca_pe.h>
+#include <doca_types.h>
+
+#include "ec_create.h"
+
+DOCA_LOG_REGISTER(SUBMIT_BATCH_BENCH);
+
+/**
+ * Strip throughput as the submitter's doorbell batch grows
+ * Strips are submitted with DOCA_TASK_SUBMIT_FLAG_NONE and one
+ * doca_ctx_flush_tasks per batch, like the Astraea submitter worker
+ */
+
+constexpr uint32_t NB_STRIPS = 4096;
+constexpr uint32_t batch_size_arr[] = {1, 8, 32, 128};
+/* A small strip, so the doorbell cost is not hidden by the engine */
+constexpr ec_create_config strip_cfg = {.nb_data_blocks = 4,
+                                        .nb_rdnc_blocks = 2,
+                                        .block_size = 1024,
+                                        .nb_tasks = NB_STRIPS};
+
+static void strip_done_cb(doca_ec_task_create *task, doca_data task_user_data,
+                          doca_data ctx_user_data) {
+    (void)task;
+    (void)ctx_user_data;
+    (*static_cast<uint32_t *>(task_user_data.ptr))++;
+}
+
+struct batch_result {
+    double strips_per_s;
+    double submit_ns_per_strip;
+};
+
+static doca_error_t run(uint32_t batch_size, batch_result *result) {
+    ec_create_resources rscs;
+
+    doca_error_t status = rscs.open_dev();
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to open device");
+        return status;
+    }
+
+    status = doca_pe_create(&rscs.pe);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to create pe: %s", doca_error_get_descr(status));
+        return status;
+    }
+
+    status = rscs.setup_ec_ctx(strip_done_cb, strip_done_cb);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to setup ec ctx");
+        return status;
+    }
+
+    status = rscs.prepare_memory(strip_cfg);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to prepare bufs");
+        return status;
+    }
+
+    status = doca_ec_matrix_create(rscs.ec, DOCA_EC_MATRIX_TYPE_CAUCHY,
+                                   strip_cfg.nb_data_blocks,
+                                   strip_cfg.nb_rdnc_blocks, &rscs.matrix);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to create ec matrix: %s",
+                     doca_error_get_descr(status));
+        return status;
+    }
+
+    uint32_t nb_finished = 0;
+    for (uint32_t i = 0; i < NB_STRIPS; i++) {
+        doca_ec_task_create *task;
+        status = doca_ec_task_create_allocate_init(
+            rscs.ec, rscs.matrix, rscs.src_buf, rscs.dst_bufs[i],
+            {.ptr = &nb_finished}, &task);
+        if (status != DOCA_SUCCESS) {
+            DOCA_LOG_ERR("Failed to allocate and init ec task: %s",
+                         doca_error_get_descr(status));
+            return status;
+        }
+        rscs.tasks.push_back(task);
+    }
+
+    using clock = std::chrono::high_resolution_clock;
+    clock::duration submit_time{0};
+    const auto begin_time = clock::now();
+
+    for (uint32_t i = 0; i < NB_STRIPS; i += batch_size) {
+        const auto submit_begin = clock::now();
+        const uint32_t end = std::min(i + batch_size, NB_STRIPS);
+        for (uint32_t j = i; j < end; j++) {
+            status = doca_task_submit_ex(
+                doca_ec_task_create_as_task(rscs.tasks[j]),
+                DOCA_TASK_SUBMIT_FLAG_NONE);
+            if (status != DOCA_SUCCESS) {
+                DOCA_LOG_ERR("Failed to submit task: %s",
+                             doca_error_get_descr(status));
+                return status;
+            }
+        }
+        doca_ctx_flush_tasks(rscs.ctx);
+        submit_time += clock::now() - submit_begin;
+
+        /* The submitter polls completions between batches too */
+        (void)doca_pe_progress(rscs.pe);
+    }
+
+    while (nb_finished < NB_STRIPS) {
+        (void)doca_pe_progress(rscs.pe);
+    }
+
+    const double time_cost_in_s =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() -
+                                                             begin_time)
+            .count() /
+        (double)1000000000;
+    result->strips_per_s = NB_STRIPS / time_cost_in_s;
+    result->submit_ns_per_strip =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(submit_time)
+            .count() /
+        (double)NB_STRIPS;
+    return DOCA_SUCCESS;
+}
+
+int main() {
+    doca_log_backend *sdk_log;
+    doca_error_t status = doca_log_backend_create_standard();
+    if (status != DOCA_SUCCESS) {
+        printf("Failed to create log standard backend: %s\n",
+               doca_error_get_descr(status));
+        return EXIT_FAILURE;
+    }
+
+    status = doca_log_backend_create_with_file_sdk(stderr, &sdk_log);
+    if (status != DOCA_SUCCESS) {
+        printf("Failed to create log backend with file sdk: %s\n",
+               doca_error_get_descr(status));
+        return EXIT_FAILURE;
+    }
+
+    status = doca_log_backend_set_sdk_level(sdk_log, DOCA_LOG_LEVEL_WARNING);
+    if (status != DOCA_SUCCESS) {
+        printf("Failed to set log backend level: %s",
+               doca_error_get_descr(status));
+        return EXIT_FAILURE;
+    }
+
+    printf("%-12s%-20s%-20s\n", "batch", "Kstrips/s", "submit ns/strip");
+    for (uint32_t batch_size : batch_size_arr) {
+        batch_result result;
+        status = run(batch_size, &result);
+        if (status != DOCA_SUCCESS) {
+            DOCA_LOG_ERR("Batch size %u failed", batch_size);
+            return EXIT_FAILURE;
+        }
+        printf("%-12u%-20.2f%-20.2f\n", batch_size, result.strips_per_s / 1000,
+               result.submit_ns_per_strip);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,105 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "mpsc_ring.h"
+
+/**
+ * Submit throughput of the sub task queue as producer threads scale
+ * Producers mimic astraea_task_submit and push strips, one consumer mimics
+ * the submitter worker and drains them
+ */
+
+constexpr uint32_t NB_ITEMS_PER_PRODUCER = 1 << 22;
+constexpr uint64_t RING_SIZE = 1 << 20;
+constexpr uint32_t nb_producers_arr[] = {1, 2, 4, 8};
+
+struct fake_subtask {};
+static fake_subtask subtask;
+
+/* The queue in front of the submitter before it became lock free */
+class locked_queue {
+  private:
+    std::queue<fake_subtask *> tasks;
+    std::mutex lock;
+
+  public:
+    bool push(fake_subtask *item) {
+        std::lock_guard<std::mutex> guard{lock};
+        tasks.push(item);
+        return true;
+    }
+
+    fake_subtask *front() {
+        std::lock_guard<std::mutex> guard{lock};
+        return tasks.empty() ? nullptr : tasks.front();
+    }
+
+    void pop() {
+        std::lock_guard<std::mutex> guard{lock};
+        tasks.pop();
+    }
+};
+
+template <typename Q> static double run(Q &queue, uint32_t nb_producers) {
+    const uint64_t nb_items = (uint64_t)nb_producers * NB_ITEMS_PER_PRODUCER;
+    std::atomic<bool> start{false};
+
+    std::vector<std::thread> producers;
+    for (uint32_t i = 0; i < nb_producers; i++) {
+        producers.emplace_back([&queue, &start]() {
+            while (!start.load(std::memory_order_acquire))
+                ;
+            for (uint32_t j = 0; j < NB_ITEMS_PER_PRODUCER; j++) {
+                while (!queue.push(&subtask))
+                    ;
+            }
+        });
+    }
+
+    auto begin_time = std::chrono::high_resolution_clock::now();
+    start.store(true, std::memory_order_release);
+
+    for (uint64_t nb_drained = 0; nb_drained < nb_items;) {
+        if (queue.front() != nullptr) {
+            queue.pop();
+            nb_drained++;
+        }
+    }
+
+    auto end_time = std::chrono::high_resolution_clock::now();
+    for (std::thread &producer : producers) {
+        producer.join();
+    }
+
+    double time_cost_in_s =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end_time -
+                                                             begin_time)
+            .count() /
+        (double)1000000000;
+    return nb_items / time_cost_in_s / 1000000;
+}
+
+int main() {
+    printf("%-12s%-20s%-20s\n", "producers", "mutex (Mstrips/s)",
+           "ring (Mstrips/s)");
+    for (uint32_t nb_producers : nb_producers_arr) {
+        locked_queue locked;
+        mpsc_ring<fake_subtask> ring;
+        if (!ring.init(RING_SIZE)) {
+            printf("Failed to alloc ring\n");
+            return EXIT_FAILURE;
+        }
+
+        double locked_mops = run(locked, nb_producers);
+        double ring_mops = run(ring, nb_producers);
+        printf("%-12u%-20.2f%-20.2f\n", nb_producers, locked_mops, ring_mops);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,199 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include <doca_error.h>
+
+#include "astraea_scheduler.h"
+#include "resource_mgmt.h"
+#include "token_shard.h"
+
+/**
+ * Tasks per second of the shared memory token path as apps scale
+ * Every app is a process running one thread per pe, every task takes its
+ * tokens with token_shard_take and charges them with
+ * token_shard_charge_spill, against the scheduler's shared memory. No
+ * scheduler runs: each app seeds the first period of its slot with a pool
+ * that never runs dry and a period's grant, so slices are claimed at their
+ * real size and this is the overhead of the path, not the rate limit.
+ * The semaphores are the path before it became lock free
+ */
+
+constexpr uint32_t NB_TASKS_PER_THREAD = 1 << 20;
+constexpr uint32_t NB_THREADS_PER_APP = 4;
+constexpr uint32_t TASK_COST = 1;
+constexpr uint32_t nb_apps_arr[] = {1, 2, 8};
+constexpr uint32_t MAX_NB_BENCH_APPS = 8;
+constexpr uint32_t TENANT_LATENCY_IN_US = 1000;
+
+extern shared_resources *shm_data;
+extern uint32_t app_id;
+
+struct bench_shm {
+    std::atomic<uint32_t> nb_ready;
+    /* The token path before it became lock free, one semaphore per array */
+    uint32_t locked_tokens[MAX_NB_BENCH_APPS];
+    uint32_t locked_deficits[MAX_NB_BENCH_APPS];
+    sem_t token_sems[MAX_NB_BENCH_APPS];
+    sem_t deficit_sems[MAX_NB_BENCH_APPS];
+};
+
+static void run_locked(bench_shm *shm, uint32_t app) {
+    for (uint32_t i = 0; i < NB_TASKS_PER_THREAD; i++) {
+        sem_wait(&shm->token_sems[app]);
+        shm->locked_tokens[app] -= TASK_COST;
+        sem_post(&shm->token_sems[app]);
+
+        sem_wait(&shm->deficit_sems[app]);
+        shm->locked_deficits[app]++;
+        sem_post(&shm->deficit_sems[app]);
+    }
+}
+
+static void run_atomic() {
+    token_shard shard;
+    token_receipt receipt;
+    token_shard_join(&shard);
+    for (uint32_t i = 0; i < NB_TASKS_PER_THREAD; i++) {
+        if (!token_shard_take(&shard, TASK_COST, &receipt)) {
+            printf("App %u ran out of tokens\n", app_id);
+            _exit(EXIT_FAILURE);
+        }
+        token_shard_charge_spill(TASK_COST);
+    }
+    token_shard_leave(&shard);
+}
+
+/* Period 0 is the current one until a scheduler refreshes */
+static void seed_tokens() {
+    shm_data->ec_grants[0][app_id].store(MAX_TOKENS_PER_MS,
+                                         std::memory_order_relaxed);
+    shm_data->ec_tokens[0][app_id].store(token_word(0, UINT32_MAX),
+                                         std::memory_order_release);
+}
+
+static void run_app(bench_shm *shm, uint32_t app, uint32_t nb_threads,
+                    bool is_atomic) {
+    doca_error_t status;
+    astraea_authenticator authenticator{
+        tenant_params{.latency_sla_in_us = TENANT_LATENCY_IN_US,
+                      .weight = ASTRAEA_DEFAULT_TENANT_WEIGHT,
+                      .slo_class = ASTRAEA_SLO_THROUGHPUT},
+        &status};
+    if (status != DOCA_SUCCESS) {
+        printf("Failed to register app: %s\n", doca_error_get_descr(status));
+        _exit(EXIT_FAILURE);
+    }
+    seed_tokens();
+
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < NB_THREADS_PER_APP; i++) {
+        threads.emplace_back([shm, app, nb_threads, is_atomic]() {
+            /* Every thread of every app starts at once */
+            shm->nb_ready.fetch_add(1, std::memory_order_relaxed);
+            while (shm->nb_ready.load(std::memory_order_relaxed) <
+                   nb_threads) {
+                std::this_thread::yield();
+            }
+            if (is_atomic) {
+                run_atomic();
+            } else {
+                run_locked(shm, app);
+            }
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+}
+
+/* Millions of tasks per second over all apps */
+static double run(bench_shm *shm, uint32_t nb_apps, bool is_atomic) {
+    const uint32_t nb_threads = nb_apps * NB_THREADS_PER_APP;
+    shm->nb_ready.store(0, std::memory_order_relaxed);
+    for (uint32_t app = 0; app < MAX_NB_BENCH_APPS; app++) {
+        shm->locked_tokens[app] = UINT32_MAX;
+        shm->locked_deficits[app] = 0;
+    }
+
+    std::vector<pid_t> pids;
+    for (uint32_t app = 0; app < nb_apps; app++) {
+        const pid_t pid = fork();
+        if (pid == -1) {
+            printf("Failed to fork app %u\n", app);
+            exit(EXIT_FAILURE);
+        }
+        if (pid == 0) {
+            /* Leaves the shared memory to the parent's scheduler */
+            run_app(shm, app, nb_threads, is_atomic);
+            _exit(EXIT_SUCCESS);
+        }
+        pids.push_back(pid);
+    }
+
+    while (shm->nb_ready.load(std::memory_order_relaxed) < nb_threads) {
+        std::this_thread::yield();
+    }
+    const auto begin_time = std::chrono::steady_clock::now();
+    for (pid_t pid : pids) {
+        waitpid(pid, nullptr, 0);
+    }
+    const double time_in_s =
+        std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                      begin_time)
+            .count();
+    return (double)nb_threads * NB_TASKS_PER_THREAD / time_in_s / 1e6;
+}
+
+int main() {
+    /* Creates the shared memory and registry apps register in, never runs */
+    scheduler_config cfg = {.refresh_period_in_us = TOKEN_REFRESH_PERIOD_IN_US,
+                            .fifo_priority = 0,
+                            .core = -1,
+                            .policy = "ewma_deficit",
+                            .lend_idle_tokens = false};
+    doca_error_t status;
+    astraea_scheduler scheduler{cfg, &status};
+    if (status != DOCA_SUCCESS) {
+        printf("Failed to init scheduler: %s\n", doca_error_get_descr(status));
+        return EXIT_FAILURE;
+    }
+
+    bench_shm *shm = static_cast<bench_shm *>(
+        mmap(nullptr, sizeof(bench_shm), PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+    if (shm == MAP_FAILED) {
+        printf("Failed to map shared memory\n");
+        return EXIT_FAILURE;
+    }
+    for (uint32_t app = 0; app < MAX_NB_BENCH_APPS; app++) {
+        if (sem_init(&shm->token_sems[app], 1, 1) ||
+            sem_init(&shm->deficit_sems[app], 1, 1)) {
+            printf("Failed to init semaphores\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (uint32_t nb_apps : nb_apps_arr) {
+        const double locked_mtps = run(shm, nb_apps, false);
+        const double atomic_mtps = run(shm, nb_apps, true);
+        printf("%u apps x %u pes: semaphores %.2f Mtasks/s, token_shard %.2f "
+               "Mtasks/s\n",
+               nb_apps, NB_THREADS_PER_APP, locked_mtps, atomic_mtps);
+    }
+
+    for (uint32_t app = 0; app < MAX_NB_BENCH_APPS; app++) {
+        sem_destroy(&shm->token_sems[app]);
+        sem_destroy(&shm->deficit_sems[app]);
+    }
+    munmap(shm, sizeof(bench_shm));
+    return EXIT_SUCCESS;
+}
@@ -1,44 +1,51 @@
-#include <chrono>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <csignal>
 #include <cstdint>
 #include <cstring>
+#include <ctime>
 #include <fcntl.h>
+#include <sched.h>
 #include <semaphore.h>
 #include <sys/mman.h>
-#include <thread>
 #include <unistd.h>
 #include <utility>
-#include <vector>
 
 #include <doca_error.h>
 #include <doca_log.h>
 
 #include "astraea_scheduler.h"
 #include "doca_error.h"
+#include "latency_hist.h"
 #include "resource_mgmt.h"
+#include "wakeup.h"
 
 DOCA_LOG_REGISTER(ASTRAEA:SCHEDULER : CORE);
 
-astraea_scheduler::astraea_scheduler(doca_error_t *status) {
-    /* Init semaphores */
-    for (uint32_t i = 0; i < MAX_NB_APPS; i++) {
-        sem_t *sem = sem_open(EC_TOKEN_SEM_NAMES[i], O_CREAT, 0666, 1);
-        if (sem == SEM_FAILED) {
-            DOCA_LOG_ERR("Failed to create token_sems[%u]", i);
-            *status = DOCA_ERROR_OPERATING_SYSTEM;
-            return;
-        }
-        ec_token_sems.push_back(sem);
-
-        sem = sem_open(EC_DEFICIT_SEM_NAMES[i], O_CREAT, 0666, 1);
-        if (sem == SEM_FAILED) {
-            DOCA_LOG_ERR("Failed to create deficit_sems[%u]", i);
-            *status = DOCA_ERROR_OPERATING_SYSTEM;
-            return;
-        }
-        ec_deficit_sems.push_back(sem);
+astraea_scheduler::astraea_scheduler(const scheduler_config &cfg,
+                                     doca_error_t *status)
+    : cfg(cfg) {
+    if (cfg.refresh_period_in_us < MIN_TOKEN_REFRESH_PERIOD_IN_US ||
+        cfg.refresh_period_in_us > MAX_TOKEN_REFRESH_PERIOD_IN_US) {
+        DOCA_LOG_ERR("Refresh period %uus is out of [%u, %u]us",
+                     cfg.refresh_period_in_us, MIN_TOKEN_REFRESH_PERIOD_IN_US,
+                     MAX_TOKEN_REFRESH_PERIOD_IN_US);
+        *status = DOCA_ERROR_INVALID_VALUE;
+        return;
     }
+    policy = find_scheduler_policy(cfg.policy);
+    if (policy == nullptr) {
+        DOCA_LOG_ERR("Unknown scheduler policy %s, one of %s", cfg.policy,
+                     scheduler_policy_names());
+        *status = DOCA_ERROR_INVALID_VALUE;
+        return;
+    }
+    policy->init(&policy_data);
+    period_in_ns = (int64_t)cfg.refresh_period_in_us * 1000;
+    reap_period_in_refreshes = REAP_PERIOD_IN_NS / period_in_ns;
 
+    /* Init semaphore, tokens and deficits are atomics in shm */
     metadata_sem = sem_open(METADATA_SEM_NAME, O_CREAT, 0666, 1);
     if (metadata_sem == SEM_FAILED) {
         DOCA_LOG_ERR("Failed to create nb_apps_sem");
@@ -73,15 +80,39 @@ astraea_scheduler::astraea_scheduler(doca_error_t *status) {
      * So we don't use semphore to lock shm here
      */
     shm_data = static_cast<shared_resources *>(shm_addr);
+    shm_data->max_nb_apps = MAX_NB_APPS;
     shm_data->nb_apps = 0;
     for (uint32_t i = 0; i < MAX_NB_APPS; i++) {
-        shm_data->ec_tokens[i] = 0;
-        shm_data->pids[i] = -1;
+        for (uint32_t half = 0; half < 2; half++) {
+            shm_data->ec_tokens[half][i].store(0, std::memory_order_relaxed);
+            shm_data->ec_grants[half][i].store(0, std::memory_order_relaxed);
+        }
+        shm_data->borrowed_tokens[i].store(0, std::memory_order_relaxed);
+        shm_data->cpu_tokens[i].store(0, std::memory_order_relaxed);
+        shm_data->deficits[i].store(0, std::memory_order_relaxed);
+        shm_data->slot_gens[i].store(0, std::memory_order_relaxed);
+        shm_data->latency_slas_in_us[i] = 0;
+        shm_data->weights[i] = ASTRAEA_DEFAULT_TENANT_WEIGHT;
+        shm_data->slo_classes[i] = ASTRAEA_SLO_THROUGHPUT;
+        shm_data->pids[i] = FREE_APP_SLOT;
+    }
+    shm_data->lent_tokens[0].store(0, std::memory_order_relaxed);
+    shm_data->lent_tokens[1].store(0, std::memory_order_relaxed);
+    shm_data->refill_wakeup.seq.store(0, std::memory_order_relaxed);
+    shm_data->refill_wakeup.nb_sleepers.store(0, std::memory_order_relaxed);
+    shm_data->refresh_period_in_ns = period_in_ns;
+    for (uint32_t i = 0; i < NB_LATENCY_HIST_BUCKETS; i++) {
+        shm_data->tick_jitter.counts[i].store(0, std::memory_order_relaxed);
     }
+    shm_data->nb_missed_ticks.store(0, std::memory_order_relaxed);
+    shm_data->nb_lent_tokens_total.store(0, std::memory_order_relaxed);
+    shm_data->nb_borrowed_tokens_total.store(0, std::memory_order_relaxed);
 
     memset(allocated_ec_tokens, 0, sizeof(allocated_ec_tokens));
+    memset(slot_gens, 0, sizeof(slot_gens));
+    memset(is_registered, 0, sizeof(is_registered));
 
-    *status = DOCA_SUCCESS;
+    *status = set_realtime();
 }
 
 astraea_scheduler::~astraea_scheduler() {
@@ -97,15 +128,7 @@ astraea_scheduler::~astraea_scheduler() {
         shm_fd = -1;
     }
 
-    /* Release semaphores */
-    for (uint32_t i = 0; i < ec_token_sems.size(); i++) {
-        sem_close(ec_token_sems[i]);
-        sem_unlink(EC_TOKEN_SEM_NAMES[i]);
-        sem_close(ec_deficit_sems[i]);
-        sem_unlink(EC_DEFICIT_SEM_NAMES[i]);
-    }
-    ec_token_sems.clear();
-
+    /* Release semaphore */
     if (metadata_sem) {
         sem_close(metadata_sem);
         sem_unlink(METADATA_SEM_NAME);
@@ -122,75 +145,324 @@ static void signal_handler(int signum) {
     }
 }
 
-uint32_t pred_tokens[MAX_NB_APPS];
-void astraea_scheduler::refresh_tokens() {
-    /**
-     * This operation should always finish without any wait
-     * As there won't be so many new apps
-     */
-    if (sem_wait(metadata_sem) == -1) {
-        DOCA_LOG_ERR("Failed to access metadata_sem");
+/* Instead of taskset and chrt, so the tick's settings live in its config */
+doca_error_t astraea_scheduler::set_realtime() {
+    if (cfg.core >= 0) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(cfg.core, &cpus);
+        if (sched_setaffinity(0, sizeof(cpus), &cpus) == -1) {
+            DOCA_LOG_ERR("Failed to pin the scheduler to core %d: %s",
+                         cfg.core, strerror(errno));
+            return DOCA_ERROR_OPERATING_SYSTEM;
+        }
+    }
+    if (cfg.fifo_priority > 0) {
+        sched_param param = {.sched_priority = (int)cfg.fifo_priority};
+        if (sched_setscheduler(0, SCHED_FIFO, &param) == -1) {
+            DOCA_LOG_ERR("Failed to run the scheduler as SCHED_FIFO %u: %s",
+                         cfg.fifo_priority, strerror(errno));
+            return DOCA_ERROR_OPERATING_SYSTEM;
+        }
+    }
+    return DOCA_SUCCESS;
+}
+
+/* Apps killed before deregistering, their slots are freed for reuse */
+void astraea_scheduler::reap_dead_apps() {
+    /* Backwards, a freed slot is replaced by the last active one */
+    for (uint32_t k = shm_data->nb_apps; k-- > 0;) {
+        const uint32_t slot = shm_data->active_slots[k];
+        if (kill(shm_data->pids[slot], 0) == -1 && errno == ESRCH) {
+            DOCA_LOG_INFO("App %d exited without deregistering",
+                          (int)shm_data->pids[slot]);
+            app_slot_deregister(shm_data, slot);
+        }
+    }
+}
+
+/**
+ * Never waits: while an app holds metadata_sem to (de)register, the
+ * refresh serves the apps it saw last, the newcomer is served a period later
+ */
+void astraea_scheduler::snapshot_apps() {
+    if (sem_trywait(metadata_sem) == -1) {
+        if (errno != EAGAIN) {
+            DOCA_LOG_ERR("Failed to access metadata_sem");
+        }
         return;
     }
 
-    for (uint32_t i = 0; i < shm_data->nb_apps; i++) {
-        if (sem_wait(ec_token_sems[i]) == -1) {
-            DOCA_LOG_ERR("Failed to access token_sems[%d]", i);
-            continue;
+    if (nb_refreshes % reap_period_in_refreshes == 0) {
+        reap_dead_apps();
+    }
+    uint32_t old_slots[MAX_NB_APPS];
+    const uint32_t nb_old_apps = nb_active_apps;
+    memcpy(old_slots, active_slots, nb_old_apps * sizeof(active_slots[0]));
+    nb_active_apps = shm_data->nb_apps;
+    memcpy(active_slots, shm_data->active_slots,
+           nb_active_apps * sizeof(active_slots[0]));
+    sync_policy(old_slots, nb_old_apps);
+
+    if (sem_post(metadata_sem) == -1) {
+        DOCA_LOG_ERR("Failed to release metadata_sem");
+    }
+}
+
+/* Tells the policy which apps came and went since the last snapshot */
+void astraea_scheduler::sync_policy(const uint32_t *old_slots,
+                                    uint32_t nb_old_apps) {
+    for (uint32_t k = 0; k < nb_active_apps; k++) {
+        const uint32_t i = active_slots[k];
+        /* A reused slot starts over, like the first app in it */
+        const uint32_t gen =
+            shm_data->slot_gens[i].load(std::memory_order_relaxed);
+        if (is_registered[i] && slot_gens[i] != gen) {
+            policy->on_deregister(&policy_data, i);
+            is_registered[i] = false;
         }
-        if (sem_wait(ec_deficit_sems[i])) {
-            DOCA_LOG_ERR("Failed to get ec_token_sem");
-            continue;
+        if (!is_registered[i]) {
+            slot_gens[i] = gen;
+            allocated_ec_tokens[i] = 0;
+            policy->on_register(&policy_data, i);
+            is_registered[i] = true;
         }
     }
 
-    double pred_sum = 0;
-    double deficit_sum = 0;
-    for (uint32_t i = 0; i < shm_data->nb_apps; i++) {
-        uint32_t nb_used_tokens =
-            allocated_ec_tokens[i] - shm_data->ec_tokens[i];
-        pred_tokens[i] = EWMA_COEFF * nb_used_tokens +
-                         (1 - EWMA_COEFF) * allocated_ec_tokens[i];
-        pred_sum += pred_tokens[i];
-        deficit_sum += shm_data->deficits[i];
-        /* Clear deficits */
-        shm_data->deficits[i] = 0;
-    }
-
-    for (uint32_t i = 0; i < shm_data->nb_apps; i++) {
-        uint32_t nb_allocated_tokens =
-            deficit_sum == 0 ? pred_tokens[i] / pred_sum * MAX_TOKENS_PER_MS
-                             : pred_tokens[i] / pred_sum * AVAIL_TOKENS_PER_MS +
-                                   shm_data->deficits[i] / deficit_sum *
-                                       RESERVED_TOKENS_PER_MS;
-        /* Deal with initial state */
-        if (nb_allocated_tokens == 0) {
-            nb_allocated_tokens = MAX_TOKENS_PER_MS / shm_data->nb_apps;
+    /* Left out of the snapshot, the slot was freed */
+    for (uint32_t k = 0; k < nb_old_apps; k++) {
+        const uint32_t i = old_slots[k];
+        if (is_registered[i] && shm_data->pids[i] == FREE_APP_SLOT) {
+            policy->on_deregister(&policy_data, i);
+            is_registered[i] = false;
         }
-        allocated_ec_tokens[i] = nb_allocated_tokens;
-        shm_data->ec_tokens[i] = nb_allocated_tokens;
     }
+}
 
-    for (uint32_t i = 0; i < shm_data->nb_apps; i++) {
-        if (sem_post(ec_token_sems[i]) == -1) {
-            DOCA_LOG_ERR("Failed to release token_sems[%d]", i);
+void astraea_scheduler::refresh_tokens(int64_t elapsed_in_ns) {
+    nb_refreshes++;
+    snapshot_apps();
+    const uint32_t nb_apps = nb_active_apps;
+    max_nb_apps_seen = std::max(max_nb_apps_seen, nb_apps);
+
+    /**
+     * Apps spend the half of seq & 1, the other one is closed: it served
+     * the period before and is filled here for the next one. Apps still
+     * on the old seq claim from the open half, so no claim is ever lost
+     */
+    const uint32_t epoch = wakeup_prepare(&shm_data->refill_wakeup) + 1;
+    const uint32_t half = epoch & 1;
+
+    /* What nobody borrowed of the closed period is lost, like leftovers */
+    shm_data->lent_tokens[half].exchange(token_word(epoch - 2, 0),
+                                         std::memory_order_relaxed);
+
+    /* Taken and cleared at once, so reports racing the refresh carry over */
+    uint32_t nb_cpu_tokens[MAX_NB_APPS];
+    /* The app's own pool, less what it lent */
+    uint32_t nb_pool_grants[MAX_NB_APPS];
+    uint32_t nb_pool_used_tokens[MAX_NB_APPS];
+    uint32_t nb_borrowed_tokens[MAX_NB_APPS];
+    uint64_t nb_borrowed_sum = 0;
+    app_view apps[MAX_NB_APPS];
+    for (uint32_t k = 0; k < nb_apps; k++) {
+        const uint32_t i = active_slots[k];
+        nb_cpu_tokens[i] =
+            shm_data->cpu_tokens[i].exchange(0, std::memory_order_relaxed);
+        nb_borrowed_tokens[i] =
+            shm_data->borrowed_tokens[i].exchange(0, std::memory_order_relaxed);
+        nb_borrowed_sum += nb_borrowed_tokens[i];
+        /**
+         * Usage of the closed period, one period behind the grants: the
+         * open one is still being spent. Its leftovers are taken at once,
+         * so stragglers' claims either count or fail
+         */
+        const uint64_t word = shm_data->ec_tokens[half][i].exchange(
+            token_word(epoch - 2, 0), std::memory_order_relaxed);
+        nb_pool_grants[i] =
+            shm_data->ec_grants[half][i].load(std::memory_order_relaxed);
+        const uint32_t nb_closed_tokens =
+            token_word_epoch(word) == epoch - 2
+                ? nb_pool_grants[i] -
+                      std::min(token_word_tokens(word), nb_pool_grants[i])
+                : 0;
+        nb_pool_used_tokens[i] = nb_closed_tokens;
+        const astraea_slo_class slo_class = shm_data->slo_classes[i];
+        apps[k] = {
+            .slot = i,
+            .latency_sla_in_us = shm_data->latency_slas_in_us[i],
+            .slo_class = slo_class,
+            .weight = slo_class == ASTRAEA_SLO_BEST_EFFORT
+                          ? shm_data->weights[i] * BEST_EFFORT_WEIGHT_RATIO
+                          : shm_data->weights[i],
+            .nb_granted_tokens = allocated_ec_tokens[i],
+            /**
+             * Strips spilled to the CPU are demand the device didn't serve,
+             * borrowed tokens are the borrower's use. A lender's use leaves
+             * out what it lent, so its next share shrinks
+             */
+            .nb_used_tokens =
+                nb_closed_tokens + nb_cpu_tokens[i] + nb_borrowed_tokens[i],
+            .nb_deficits =
+                shm_data->deficits[i].exchange(0, std::memory_order_relaxed)};
+    }
+
+    /* The tick may have come late, grants follow the time that passed */
+    const double nb_tokens = (double)MAX_TOKENS_PER_MS * elapsed_in_ns / 1e6;
+    /**
+     * Latency critical apps are guaranteed their weight's share whatever
+     * the policy, which splits the rest between all apps
+     */
+    double weight_sum = 0;
+    double critical_weight_sum = 0;
+    for (uint32_t k = 0; k < nb_apps; k++) {
+        weight_sum += apps[k].weight;
+        if (apps[k].slo_class == ASTRAEA_SLO_LATENCY_CRITICAL) {
+            critical_weight_sum += apps[k].weight;
         }
-        if (sem_post(ec_deficit_sems[i])) {
-            DOCA_LOG_ERR("Failed to post ec_token_sem");
+    }
+    const double nb_reserved_tokens =
+        critical_weight_sum == 0
+            ? 0
+            : nb_tokens * std::min(critical_weight_sum / weight_sum,
+                                   MAX_RESERVED_TOKENS_RATIO);
+    const tick_view view = {.apps = apps,
+                            .nb_apps = nb_apps,
+                            .nb_tokens = nb_tokens - nb_reserved_tokens};
+    uint32_t nb_shares[MAX_NB_APPS];
+    policy->on_tick(&policy_data, view, nb_shares);
+    for (uint32_t k = 0; k < nb_apps; k++) {
+        if (apps[k].slo_class == ASTRAEA_SLO_LATENCY_CRITICAL) {
+            nb_shares[k] +=
+                nb_reserved_tokens * apps[k].weight / critical_weight_sum;
         }
     }
 
-    if (sem_post(metadata_sem) == -1) {
-        DOCA_LOG_ERR("Failed to release metadata_sem");
+    uint64_t nb_shares_sum = 0;
+    uint64_t nb_charged_sum = 0;
+    for (uint32_t k = 0; k < nb_apps; k++) {
+        const uint32_t i = active_slots[k];
+        uint32_t nb_allocated_tokens = nb_shares[k];
+        nb_shares_sum += nb_allocated_tokens;
+        /**
+         * Both engines count as service: the CPU work comes off the device
+         * share, down to half of it so a spilling app keeps the device
+         */
+        nb_allocated_tokens -=
+            std::min(nb_cpu_tokens[i], nb_allocated_tokens / 2);
+        nb_charged_sum += nb_allocated_tokens;
+        allocated_ec_tokens[i] = nb_allocated_tokens;
+    }
+
+    /**
+     * What came off spilling apps is spread over all by their share
+     * Published into the closed half, the post below opens it
+     */
+    uint64_t nb_lent_sum = 0;
+    for (uint32_t k = 0; k < nb_apps; k++) {
+        const uint32_t i = active_slots[k];
+        const uint32_t nb_allocated_tokens =
+            nb_charged_sum == 0
+                ? allocated_ec_tokens[i]
+                : allocated_ec_tokens[i] * nb_shares_sum / nb_charged_sum;
+        allocated_ec_tokens[i] = nb_allocated_tokens;
+
+        /**
+         * An app idle in the closed period lends what it won't need in
+         * this one, the grant it is charged for stays whole. Never a
+         * latency critical app's, its reserve holds for bursts
+         */
+        uint32_t nb_lent_tokens = 0;
+        if (cfg.lend_idle_tokens &&
+            apps[k].slo_class != ASTRAEA_SLO_LATENCY_CRITICAL &&
+            apps[k].nb_deficits == 0 && nb_borrowed_tokens[i] == 0 &&
+            nb_cpu_tokens[i] == 0 &&
+            nb_pool_used_tokens[i] < nb_pool_grants[i] * LEND_IDLE_RATIO) {
+            const uint32_t nb_kept_tokens =
+                std::max(nb_pool_used_tokens[i] * LEND_HEADROOM,
+                         nb_allocated_tokens * MIN_KEPT_RATIO);
+            nb_lent_tokens = nb_allocated_tokens -
+                             std::min(nb_kept_tokens, nb_allocated_tokens);
+        }
+        nb_lent_sum += nb_lent_tokens;
+
+        shm_data->ec_grants[half][i].store(
+            nb_allocated_tokens - nb_lent_tokens, std::memory_order_relaxed);
+        shm_data->ec_tokens[half][i].store(
+            token_word(epoch, nb_allocated_tokens - nb_lent_tokens),
+            std::memory_order_release);
     }
+    /* Published with the grants, claimable by any app from the post on */
+    shm_data->lent_tokens[half].store(
+        token_word(epoch, std::min(nb_lent_sum, (uint64_t)UINT32_MAX)),
+        std::memory_order_release);
+    shm_data->nb_lent_tokens_total.fetch_add(nb_lent_sum,
+                                             std::memory_order_relaxed);
+    shm_data->nb_borrowed_tokens_total.fetch_add(nb_borrowed_sum,
+                                                 std::memory_order_relaxed);
+
+    /* Every app switches halves, waiting submitters retry now */
+    wakeup_post(&shm_data->refill_wakeup, true);
+}
+
+static int64_t now_in_ns() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
 }
 
 void astraea_scheduler::run() {
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
 
-    do {
-        refresh_tokens();
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
-    } while (!scheduler_force_quit);
-}
\ No newline at end of file
+    /**
+     * Absolute deadlines, so neither the refresh nor the timer slack of
+     * a tick delays the next ones. The first tick is now
+     */
+    int64_t deadline_in_ns = now_in_ns();
+    int64_t last_tick_in_ns = deadline_in_ns - period_in_ns;
+    while (!scheduler_force_quit) {
+        const timespec deadline = {
+            .tv_sec = deadline_in_ns / 1000000000,
+            .tv_nsec = deadline_in_ns % 1000000000};
+        if (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline,
+                            nullptr) != 0) {
+            /* Interrupted, by the quit signal most likely */
+            continue;
+        }
+
+        const int64_t tick_in_ns = now_in_ns();
+        const int64_t jitter_in_ns = tick_in_ns - deadline_in_ns;
+        latency_hist_record(&shm_data->tick_jitter, jitter_in_ns);
+        deadline_in_ns += period_in_ns;
+        /* Ticks missed are merged into this one, not run back to back */
+        if (jitter_in_ns >= period_in_ns) {
+            const int64_t nb_missed_ticks = jitter_in_ns / period_in_ns;
+            shm_data->nb_missed_ticks.fetch_add(nb_missed_ticks,
+                                                std::memory_order_relaxed);
+            deadline_in_ns += nb_missed_ticks * period_in_ns;
+        }
+
+        refresh_tokens(std::min(tick_in_ns - last_tick_in_ns,
+                                MAX_NB_PERIODS_PER_TICK * period_in_ns));
+        last_tick_in_ns = tick_in_ns;
+        latency_hist_record(&refresh_latency, now_in_ns() - tick_in_ns);
+    }
+
+    DOCA_LOG_INFO("Refresh by %s over %lu periods of %uus with up to %u "
+                  "apps: p50 %luns, p99 %luns",
+                  policy->name, latency_hist_count(&refresh_latency),
+                  cfg.refresh_period_in_us, max_nb_apps_seen,
+                  latency_hist_percentile(&refresh_latency, 0.5),
+                  latency_hist_percentile(&refresh_latency, 0.99));
+    DOCA_LOG_INFO(
+        "Tick jitter p50 %luns, p99 %luns, p99.9 %luns, %lu ticks missed",
+        latency_hist_percentile(&shm_data->tick_jitter, 0.5),
+        latency_hist_percentile(&shm_data->tick_jitter, 0.99),
+        latency_hist_percentile(&shm_data->tick_jitter, 0.999),
+        shm_data->nb_missed_ticks.load(std::memory_order_relaxed));
+    DOCA_LOG_INFO(
+        "Lent %lu idle tokens, %lu borrowed",
+        shm_data->nb_lent_tokens_total.load(std::memory_order_relaxed),
+        shm_data->nb_borrowed_tokens_total.load(std::memory_order_relaxed));
+}
@@ -1,18 +1,42 @@
 #ifndef ASTRAEA_SCHEDULER_H__
 #define ASTRAEA_SCHEDULER_H__
 
+#include "latency_hist.h"
 #include "resource_mgmt.h"
+#include "scheduler_policy.h"
 #include <cstdint>
 #include <semaphore.h>
-#include <vector>
 
 #include <doca_error.h>
 
-constexpr double EWMA_COEFF = 0.5;
+/* Grants of a tick are scaled to the time since the last one */
 constexpr uint32_t MAX_TOKENS_PER_MS = 10000;
-constexpr uint32_t AVAIL_TOKENS_PER_MS = MAX_TOKENS_PER_MS * 0.9;
-constexpr uint32_t RESERVED_TOKENS_PER_MS =
-    MAX_TOKENS_PER_MS - AVAIL_TOKENS_PER_MS;
+/* Latency critical tenants' weight share comes first, up to this much */
+constexpr double MAX_RESERVED_TOKENS_RATIO = 0.5;
+constexpr double BEST_EFFORT_WEIGHT_RATIO = 0.125;
+/**
+ * An app that used less than this of its last grant lends what it won't
+ * need, keeping twice its use and at least MIN_KEPT_RATIO of its grant
+ */
+constexpr double LEND_IDLE_RATIO = 0.5;
+constexpr double LEND_HEADROOM = 2;
+constexpr double MIN_KEPT_RATIO = 0.125;
+/* A late tick makes up at most this many periods, not a burst */
+constexpr int64_t MAX_NB_PERIODS_PER_TICK = 2;
+/* Slots of apps that died unregistered are freed once a second */
+constexpr int64_t REAP_PERIOD_IN_NS = 1000000000;
+
+struct scheduler_config {
+    uint32_t refresh_period_in_us;
+    /* SCHED_FIFO priority, 0 keeps the default policy */
+    uint32_t fifo_priority;
+    /* Core the scheduler is pinned to, -1 to run anywhere */
+    int32_t core;
+    /* One of scheduler_policy_names() */
+    char policy[MAX_POLICY_NAME_LEN];
+    /* Idle apps' tokens go to a pool any app out of its own borrows from */
+    bool lend_idle_tokens;
+};
 
 /**
  * Forward declarations
@@ -21,9 +45,7 @@ struct shared_resources;
 
 class astraea_scheduler {
   private:
-    /* Semaphores */
-    std::vector<sem_t *> ec_token_sems;
-    std::vector<sem_t *> ec_deficit_sems;
+    /* Semaphore */
     sem_t *metadata_sem = nullptr;
 
     /* Shared memory */
@@ -31,11 +53,33 @@ class astraea_scheduler {
     shared_resources *shm_data = nullptr;
 
     uint32_t allocated_ec_tokens[MAX_NB_APPS];
+    /* slot_gens of the apps allocated_ec_tokens belongs to */
+    uint32_t slot_gens[MAX_NB_APPS];
+    /* The policy was told about the app in the slot */
+    bool is_registered[MAX_NB_APPS];
+
+    /* The registry as of the last refresh that got metadata_sem */
+    uint32_t active_slots[MAX_NB_APPS];
+    uint32_t nb_active_apps = 0;
+
+    const scheduler_policy *policy = nullptr;
+    policy_state policy_data;
+
+    scheduler_config cfg;
+    int64_t period_in_ns;
+    uint64_t nb_refreshes = 0;
+    uint64_t reap_period_in_refreshes;
+    uint32_t max_nb_apps_seen = 0;
+    latency_hist refresh_latency{};
 
-    void refresh_tokens();
+    doca_error_t set_realtime();
+    void reap_dead_apps();
+    void snapshot_apps();
+    void sync_policy(const uint32_t *old_slots, uint32_t nb_old_apps);
+    void refresh_tokens(int64_t elapsed_in_ns);
 
   public:
-    astraea_scheduler(doca_error_t *status);
+    astraea_scheduler(const scheduler_config &cfg, doca_error_t *status);
     ~astraea_scheduler();
 
     void run();
@@ -1,13 +1,126 @@
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 
+#include <doca_argp.h>
 #include <doca_error.h>
 #include <doca_log.h>
 
 #include "astraea_scheduler.h"
+#include "resource_mgmt.h"
 
 DOCA_LOG_REGISTER(ASTRAEA:SCHEDULER : MAIN);
 
+static doca_error_t register_param(const char *short_name,
+                                   const char *long_name,
+                                   const char *description,
+                                   doca_argp_param_cb_t callback,
+                                   doca_argp_type type) {
+    doca_error_t result;
+    doca_argp_param *param;
+    result = doca_argp_param_create(&param);
+    if (result != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to create argp param: %s",
+                     doca_error_get_descr(result));
+        return result;
+    }
+    doca_argp_param_set_short_name(param, short_name);
+    doca_argp_param_set_long_name(param, long_name);
+    doca_argp_param_set_description(param, description);
+    doca_argp_param_set_callback(param, callback);
+    doca_argp_param_set_type(param, type);
+    result = doca_argp_register_param(param);
+    if (result != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to register argp param: %s",
+                     doca_error_get_descr(result));
+    }
+
+    return result;
+}
+
+static doca_error_t register_scheduler_params() {
+    doca_error_t status;
+    status = register_param(
+        "p", "period", "token refresh period in us, 100 to 10000",
+        [](void *param, void *config) -> doca_error_t {
+            scheduler_config *cfg = static_cast<scheduler_config *>(config);
+            cfg->refresh_period_in_us = *static_cast<uint32_t *>(param);
+            return DOCA_SUCCESS;
+        },
+        DOCA_ARGP_TYPE_INT);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to register period param: %s",
+                     doca_error_get_descr(status));
+        return status;
+    }
+
+    status = register_param(
+        "f", "fifo", "run as SCHED_FIFO with this priority, 0 to not",
+        [](void *param, void *config) -> doca_error_t {
+            scheduler_config *cfg = static_cast<scheduler_config *>(config);
+            cfg->fifo_priority = *static_cast<uint32_t *>(param);
+            return DOCA_SUCCESS;
+        },
+        DOCA_ARGP_TYPE_INT);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to register fifo param: %s",
+                     doca_error_get_descr(status));
+        return status;
+    }
+
+    status = register_param(
+        "c", "core", "core to pin the scheduler to, -1 to not",
+        [](void *param, void *config) -> doca_error_t {
+            scheduler_config *cfg = static_cast<scheduler_config *>(config);
+            cfg->core = *static_cast<int32_t *>(param);
+            return DOCA_SUCCESS;
+        },
+        DOCA_ARGP_TYPE_INT);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to register core param: %s",
+                     doca_error_get_descr(status));
+        return status;
+    }
+
+    status = register_param(
+        "P", "policy",
+        "token policy: ewma_deficit, fair_share, strict_priority or "
+        "sla_proportional",
+        [](void *param, void *config) -> doca_error_t {
+            scheduler_config *cfg = static_cast<scheduler_config *>(config);
+            const char *policy = static_cast<const char *>(param);
+            if (strlen(policy) >= sizeof(cfg->policy)) {
+                DOCA_LOG_ERR("Policy name %s is too long", policy);
+                return DOCA_ERROR_INVALID_VALUE;
+            }
+            strcpy(cfg->policy, policy);
+            return DOCA_SUCCESS;
+        },
+        DOCA_ARGP_TYPE_STRING);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to register policy param: %s",
+                     doca_error_get_descr(status));
+        return status;
+    }
+
+    status = register_param(
+        "n", "no_lend", "keep idle apps' tokens from apps out of theirs",
+        [](void *param, void *config) -> doca_error_t {
+            scheduler_config *cfg = static_cast<scheduler_config *>(config);
+            cfg->lend_idle_tokens = !*static_cast<bool *>(param);
+            return DOCA_SUCCESS;
+        },
+        DOCA_ARGP_TYPE_BOOLEAN);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to register no_lend param: %s",
+                     doca_error_get_descr(status));
+        return status;
+    }
+
+    return DOCA_SUCCESS;
+}
+
 int main(int argc, char **argv) {
     doca_error_t status;
 
@@ -34,14 +147,45 @@ int main(int argc, char **argv) {
         return EXIT_FAILURE;
     }
 
-    astraea_scheduler scheduler{&status};
+    /* Setup argp */
+    scheduler_config cfg = {.refresh_period_in_us = TOKEN_REFRESH_PERIOD_IN_US,
+                            .fifo_priority = 0,
+                            .core = -1,
+                            .policy = {},
+                            .lend_idle_tokens = true};
+    strcpy(cfg.policy, DEFAULT_SCHEDULER_POLICY);
+
+    status = doca_argp_init("astraea_scheduler", &cfg);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to init argp: %s", doca_error_get_descr(status));
+        return EXIT_FAILURE;
+    }
+
+    status = register_scheduler_params();
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to register scheduler params");
+        doca_argp_destroy();
+        return EXIT_FAILURE;
+    }
+
+    status = doca_argp_start(argc, argv);
+    if (status != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to parse parameters: %s",
+                     doca_error_get_descr(status));
+        doca_argp_destroy();
+        return EXIT_FAILURE;
+    }
+
+    astraea_scheduler scheduler{cfg, &status};
     if (status != DOCA_SUCCESS) {
         DOCA_LOG_ERR("Failed to init scheduler");
+        doca_argp_destroy();
         return EXIT_FAILURE;
     }
 
     DOCA_LOG_INFO("Astraea scheduler started");
     scheduler.run();
 
+    doca_argp_destroy();
     return EXIT_SUCCESS;
-}
\ No newline at end of file
+}
@@ -0,0 +1,219 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "scheduler_policy.h"
+
+constexpr double EWMA_COEFF = 0.5;
+/* Of the tokens shared by prediction, the rest goes to apps with deficits */
+constexpr double AVAIL_TOKENS_RATIO = 0.9;
+/* An app using this much of its grant may want more than it got */
+constexpr double SATURATED_RATIO = 0.9;
+constexpr double DEMAND_PROBE_FACTOR = 2;
+
+static void clear_demands(policy_state *state) {
+    std::fill(std::begin(state->demands), std::end(state->demands), 0);
+}
+
+static void clear_demand(policy_state *state, uint32_t slot) {
+    state->demands[slot] = 0;
+}
+
+/**
+ * Smoothed usage, doubled while the app used its whole grant or missed
+ * deadlines: a capped app can't show it wants more by using more
+ */
+static double update_demand(policy_state *state, const app_view &app) {
+    double nb_wanted_tokens = app.nb_used_tokens;
+    if (app.nb_deficits > 0 ||
+        app.nb_used_tokens >= app.nb_granted_tokens * SATURATED_RATIO) {
+        nb_wanted_tokens = DEMAND_PROBE_FACTOR *
+                           std::max(nb_wanted_tokens,
+                                    (double)app.nb_granted_tokens);
+    }
+    double &demand = state->demands[app.slot];
+    demand = EWMA_COEFF * nb_wanted_tokens + (1 - EWMA_COEFF) * demand;
+    return std::max(demand, 1.0);
+}
+
+static double weight_sum(const tick_view &view) {
+    double sum = 0;
+    for (uint32_t k = 0; k < view.nb_apps; k++) {
+        sum += view.apps[k].weight;
+    }
+    return sum;
+}
+
+/* Tokens nobody asked for are split by weight, unclaimed they are lost */
+static void spread_left(const tick_view &view, double nb_left_tokens,
+                        double *shares, uint32_t *nb_shares) {
+    const double sum = weight_sum(view);
+    for (uint32_t k = 0; k < view.nb_apps; k++) {
+        nb_shares[k] =
+            shares[k] + nb_left_tokens * view.apps[k].weight / sum;
+    }
+}
+
+/**
+ * Weighted max-min fair: none gets more than its weight's part of the rest
+ * Returns the tokens left once every demand is met
+ */
+static double fill_by_weight(const tick_view &view, const double *demands,
+                             double nb_tokens, double *shares) {
+    uint32_t order[MAX_NB_APPS];
+    for (uint32_t k = 0; k < view.nb_apps; k++) {
+        order[k] = k;
+    }
+    /* Least demand per weight first, what it leaves goes to the others */
+    std::sort(order, order + view.nb_apps,
+              [demands, &view](uint32_t a, uint32_t b) {
+                  return demands[a] / view.apps[a].weight <
+                         demands[b] / view.apps[b].weight;
+              });
+
+    double nb_left_tokens = nb_tokens;
+    double left_weight_sum = weight_sum(view);
+    for (uint32_t n = 0; n < view.nb_apps; n++) {
+        const uint32_t k = order[n];
+        shares[k] = std::min(demands[k], nb_left_tokens * view.apps[k].weight /
+                                             left_weight_sum);
+        nb_left_tokens -= shares[k];
+        left_weight_sum -= view.apps[k].weight;
+    }
+    return nb_left_tokens;
+}
+
+/**
+ * Usage predicted from the last grant, unweighted: the grant already
+ * carries the weight. A new app asks for the whole tick, one that used its
+ * grant for more than it got
+ */
+static double predict_usage(const tick_view &view, const app_view &app) {
+    if (app.nb_granted_tokens == 0) {
+        return view.nb_tokens;
+    }
+    const double pred = EWMA_COEFF * app.nb_used_tokens +
+                        (1 - EWMA_COEFF) * app.nb_granted_tokens;
+    return app.nb_used_tokens >= app.nb_granted_tokens * SATURATED_RATIO
+               ? DEMAND_PROBE_FACTOR * pred
+               : pred;
+}
+
+/**
+ * Share by predicted usage, by weight when predictions don't fit, deficits
+ * get a reserve. Astraea's original rule, weighted once per tick
+ */
+static void ewma_deficit_tick(policy_state *, const tick_view &view,
+                              uint32_t *nb_shares) {
+    double preds[MAX_NB_APPS];
+    double deficit_sum = 0;
+    for (uint32_t k = 0; k < view.nb_apps; k++) {
+        preds[k] = predict_usage(view, view.apps[k]);
+        deficit_sum += view.apps[k].weight * view.apps[k].nb_deficits;
+    }
+
+    const double avail_tokens =
+        deficit_sum == 0 ? view.nb_tokens
+                         : view.nb_tokens * AVAIL_TOKENS_RATIO;
+    const double reserved_tokens = view.nb_tokens - avail_tokens;
+    double shares[MAX_NB_APPS];
+    const double nb_left_tokens =
+        fill_by_weight(view, preds, avail_tokens, shares);
+    for (uint32_t k = 0; k < view.nb_apps && deficit_sum > 0; k++) {
+        shares[k] += view.apps[k].weight * view.apps[k].nb_deficits /
+                     deficit_sum * reserved_tokens;
+    }
+    spread_left(view, nb_left_tokens, shares, nb_shares);
+}
+
+/* Weighted max-min fair over smoothed demands */
+static void fair_share_tick(policy_state *state, const tick_view &view,
+                            uint32_t *nb_shares) {
+    double demands[MAX_NB_APPS];
+    for (uint32_t k = 0; k < view.nb_apps; k++) {
+        demands[k] = update_demand(state, view.apps[k]);
+    }
+    double shares[MAX_NB_APPS];
+    const double nb_left_tokens =
+        fill_by_weight(view, demands, view.nb_tokens, shares);
+    spread_left(view, nb_left_tokens, shares, nb_shares);
+}
+
+/**
+ * By SLO class, then the tightest latency SLA first, each up to its demand
+ * Apps below may get nothing while those above are busy
+ */
+static void strict_priority_tick(policy_state *state, const tick_view &view,
+                                 uint32_t *nb_shares) {
+    double demands[MAX_NB_APPS];
+    uint32_t order[MAX_NB_APPS];
+    for (uint32_t k = 0; k < view.nb_apps; k++) {
+        demands[k] = update_demand(state, view.apps[k]);
+        order[k] = k;
+    }
+    std::sort(order, order + view.nb_apps, [&view](uint32_t a, uint32_t b) {
+        const app_view &app_a = view.apps[a];
+        const app_view &app_b = view.apps[b];
+        if (app_a.slo_class != app_b.slo_class) {
+            return app_a.slo_class < app_b.slo_class;
+        }
+        return app_a.latency_sla_in_us < app_b.latency_sla_in_us;
+    });
+
+    double shares[MAX_NB_APPS];
+    double nb_left_tokens = view.nb_tokens;
+    for (uint32_t n = 0; n < view.nb_apps; n++) {
+        const uint32_t k = order[n];
+        shares[k] = std::min(demands[k], nb_left_tokens);
+        nb_left_tokens -= shares[k];
+    }
+    spread_left(view, nb_left_tokens, shares, nb_shares);
+}
+
+/* Shares by weight over latency SLA, whatever the apps use */
+static void sla_proportional_tick(policy_state *, const tick_view &view,
+                                  uint32_t *nb_shares) {
+    double weights[MAX_NB_APPS];
+    double weight_sum = 0;
+    for (uint32_t k = 0; k < view.nb_apps; k++) {
+        weights[k] =
+            view.apps[k].weight / std::max(view.apps[k].latency_sla_in_us, 1U);
+        weight_sum += weights[k];
+    }
+    for (uint32_t k = 0; k < view.nb_apps; k++) {
+        nb_shares[k] = weights[k] / weight_sum * view.nb_tokens;
+    }
+}
+
+static const scheduler_policy policies[] = {
+    {"ewma_deficit", clear_demands, ewma_deficit_tick, clear_demand,
+     clear_demand},
+    {"fair_share", clear_demands, fair_share_tick, clear_demand,
+     clear_demand},
+    {"strict_priority", clear_demands, strict_priority_tick, clear_demand,
+     clear_demand},
+    {"sla_proportional", clear_demands, sla_proportional_tick, clear_demand,
+     clear_demand},
+};
+
+const scheduler_policy *find_scheduler_policy(const char *name) {
+    for (const scheduler_policy &policy : policies) {
+        if (strcmp(policy.name, name) == 0) {
+            return &policy;
+        }
+    }
+    return nullptr;
+}
+
+const char *scheduler_policy_names() {
+    static const std::string names = []() {
+        std::string names;
+        for (const scheduler_policy &policy : policies) {
+            names += names.empty() ? "" : " ";
+            names += policy.name;
+        }
+        return names;
+    }();
+    return names.c_str();
+}
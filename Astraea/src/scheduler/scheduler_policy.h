@@ -0,0 +1,67 @@
+#ifndef SCHEDULER_POLICY_H__
+#define SCHEDULER_POLICY_H__
+
+#include <cstdint>
+
+#include "resource_mgmt.h"
+
+/**
+ * How the scheduler splits a tick's tokens between apps
+ *
+ * Every tick the scheduler gathers what each app did in the closed period
+ * into a read only view and asks the policy for the apps' shares. Charging
+ * CPU spills and publishing the grants stay with the scheduler, so every
+ * policy is measured the same way. Picked by name at launch.
+ */
+
+constexpr char DEFAULT_SCHEDULER_POLICY[] = "ewma_deficit";
+constexpr uint32_t MAX_POLICY_NAME_LEN = 32;
+
+/* One app as the policy sees it, filled by the scheduler every tick */
+struct app_view {
+    uint32_t slot;
+    uint32_t latency_sla_in_us;
+    astraea_slo_class slo_class;
+    /* Registered weight, best effort apps' already scaled down */
+    double weight;
+    /* The app's last grant, before the scheduler charged its spills */
+    uint32_t nb_granted_tokens;
+    /* Of the closed period, on the device and spilled to the CPU */
+    uint32_t nb_used_tokens;
+    uint32_t nb_deficits;
+};
+
+struct tick_view {
+    const app_view *apps;
+    uint32_t nb_apps;
+    /**
+     * Tokens of this tick, scaled to the time since the last one, less
+     * what the scheduler reserved for latency critical apps
+     */
+    double nb_tokens;
+};
+
+/* Owned by the scheduler, policies keep what they need across ticks */
+struct policy_state {
+    /* Smoothed tokens a slot would use if it got them */
+    double demands[MAX_NB_APPS];
+};
+
+struct scheduler_policy {
+    const char *name;
+    void (*init)(policy_state *state);
+    /* Shares of view.apps[k] into nb_shares[k], apps given 0 wait a tick */
+    void (*on_tick)(policy_state *state, const tick_view &view,
+                    uint32_t *nb_shares);
+    /* A slot taken by a new app, or freed, before the tick it shows in */
+    void (*on_register)(policy_state *state, uint32_t slot);
+    void (*on_deregister)(policy_state *state, uint32_t slot);
+};
+
+/* nullptr if no built-in policy has this name */
+const scheduler_policy *find_scheduler_policy(const char *name);
+
+/* Names of the built-in policies, separated by spaces */
+const char *scheduler_policy_names();
+
+#endif
@@ -0,0 +1,88 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include "scheduler_policy.h"
+
+/**
+ * Saturated tenants under the weighted policies
+ * Every tenant spends whatever it was granted, reported one tick later as
+ * the scheduler sees it. Shares must settle at the weight ratio, never
+ * exceed the tick's tokens and never starve a tenant
+ */
+
+constexpr double NB_TICK_TOKENS = 10000;
+constexpr uint32_t NB_TICKS = 64;
+/* Ticks left to settle before shares are checked */
+constexpr uint32_t NB_SETTLE_TICKS = 16;
+constexpr double MAX_RATIO_ERROR = 0.02;
+
+static bool run(const char *name, const double *weights, uint32_t nb_apps) {
+    const scheduler_policy *policy = find_scheduler_policy(name);
+    if (policy == nullptr) {
+        printf("%s: no such policy\n", name);
+        return false;
+    }
+    policy_state state;
+    policy->init(&state);
+
+    app_view apps[MAX_NB_APPS];
+    double weight_sum = 0;
+    for (uint32_t k = 0; k < nb_apps; k++) {
+        policy->on_register(&state, k);
+        apps[k] = {.slot = k,
+                   .latency_sla_in_us = 1000,
+                   .slo_class = ASTRAEA_SLO_THROUGHPUT,
+                   .weight = weights[k],
+                   .nb_granted_tokens = 0,
+                   .nb_used_tokens = 0,
+                   .nb_deficits = 0};
+        weight_sum += weights[k];
+    }
+
+    uint32_t nb_shares[MAX_NB_APPS];
+    for (uint32_t tick = 0; tick < NB_TICKS; tick++) {
+        const tick_view view = {
+            .apps = apps, .nb_apps = nb_apps, .nb_tokens = NB_TICK_TOKENS};
+        policy->on_tick(&state, view, nb_shares);
+
+        uint64_t nb_shares_sum = 0;
+        for (uint32_t k = 0; k < nb_apps; k++) {
+            nb_shares_sum += nb_shares[k];
+            /* Saturated: the grant in use is spent, seen next tick */
+            apps[k].nb_used_tokens = apps[k].nb_granted_tokens;
+            apps[k].nb_granted_tokens = nb_shares[k];
+        }
+        if (nb_shares_sum > NB_TICK_TOKENS) {
+            printf("%s: tick %u grants %lu of %.0f tokens\n", name, tick,
+                   nb_shares_sum, NB_TICK_TOKENS);
+            return false;
+        }
+        for (uint32_t k = 0; k < nb_apps && tick >= NB_SETTLE_TICKS; k++) {
+            const double expected = NB_TICK_TOKENS * weights[k] / weight_sum;
+            if (std::fabs(nb_shares[k] - expected) >
+                expected * MAX_RATIO_ERROR) {
+                printf("%s: tick %u tenant %u of weight %.0f got %u tokens, "
+                       "expected %.0f\n",
+                       name, tick, k, weights[k], nb_shares[k], expected);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main() {
+    const char *policies[] = {"ewma_deficit", "fair_share",
+                              "sla_proportional"};
+    const double two_weights[] = {1, 2};
+    const double three_weights[] = {1, 1, 4};
+    bool is_passed = true;
+    for (const char *policy : policies) {
+        is_passed &= run(policy, two_weights, 2);
+        is_passed &= run(policy, three_weights, 3);
+    }
+    printf("%s\n", is_passed ? "passed" : "failed");
+    return is_passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
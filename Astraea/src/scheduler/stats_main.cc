@@ -0,0 +1,130 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+#include <doca_error.h>
+
+#include "latency_hist.h"
+#include "resource_mgmt.h"
+#include "task_stats.h"
+
+/**
+ * Print the live task latency histograms of Astraea apps
+ *   astraea_stats [pid...]
+ * Without pids, every app registered with the scheduler is printed
+ * The scheduler's tick jitter comes first when it is running
+ */
+
+static const char *const op_names[NB_TASK_TYPES] = {"create", "recover",
+                                                    "update"};
+static const char *const size_names[NB_TASK_SIZE_CLASSES] = {
+    "<=4K", "<=32K", "<=256K", ">256K"};
+static const char *const strip_names[NB_TASK_STRIP_CLASSES] = {"1", "<8",
+                                                               "<64", ">=64"};
+static const char *const phase_names[NB_TASK_PHASES] = {"queued", "device",
+                                                        "total"};
+
+/* The scheduler's shared memory, nullptr if it isn't running */
+static const shared_resources *open_shm() {
+    int fd = shm_open(SHM_NAME, O_RDONLY, 0);
+    if (fd == -1) {
+        return nullptr;
+    }
+    void *addr = mmap(nullptr, SHM_SIZE, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        return nullptr;
+    }
+    return static_cast<const shared_resources *>(addr);
+}
+
+/* Pids registered in the scheduler's shared memory */
+static std::vector<pid_t> registered_pids(const shared_resources *shm) {
+    std::vector<pid_t> pids;
+    for (uint32_t k = 0; k < shm->nb_apps && k < MAX_NB_APPS; k++) {
+        pids.push_back(shm->pids[shm->active_slots[k]]);
+    }
+    return pids;
+}
+
+static void print_tick_stats(const shared_resources *shm) {
+    printf("scheduler tick %.1fus, jitter p50 %.1fus, p99 %.1fus, p99.9 "
+           "%.1fus over %lu ticks, %lu missed\n",
+           shm->refresh_period_in_ns / 1000.0,
+           latency_hist_percentile(&shm->tick_jitter, 0.5) / 1000.0,
+           latency_hist_percentile(&shm->tick_jitter, 0.99) / 1000.0,
+           latency_hist_percentile(&shm->tick_jitter, 0.999) / 1000.0,
+           latency_hist_count(&shm->tick_jitter),
+           shm->nb_missed_ticks.load(std::memory_order_relaxed));
+    printf("idle tokens lent %lu, borrowed %lu\n",
+           shm->nb_lent_tokens_total.load(std::memory_order_relaxed),
+           shm->nb_borrowed_tokens_total.load(std::memory_order_relaxed));
+}
+
+static void print_stats(const task_stats *stats) {
+    printf("pid %d, %u recording threads\n", (int)stats->pid,
+           stats->nb_threads.load(std::memory_order_relaxed));
+    printf("%-9s%-8s%-7s%-8s%-12s%-12s%-12s%-12s\n", "op", "block", "strips",
+           "phase", "count", "p50 us", "p99 us", "p99.9 us");
+
+    latency_hist *hist = new latency_hist;
+    for (uint32_t type = 0; type < NB_TASK_TYPES; type++) {
+        for (uint32_t size = 0; size < NB_TASK_SIZE_CLASSES; size++) {
+            for (uint32_t strip = 0; strip < NB_TASK_STRIP_CLASSES; strip++) {
+                for (uint32_t phase = 0; phase < NB_TASK_PHASES; phase++) {
+                    task_stats_merge(stats, (task_type)type, size, strip,
+                                     (task_phase)phase, hist);
+                    const uint64_t count = latency_hist_count(hist);
+                    if (count == 0) {
+                        continue;
+                    }
+                    printf("%-9s%-8s%-7s%-8s%-12lu%-12.1f%-12.1f%-12.1f\n",
+                           op_names[type], size_names[size],
+                           strip_names[strip], phase_names[phase], count,
+                           latency_hist_percentile(hist, 0.5) / 1000.0,
+                           latency_hist_percentile(hist, 0.99) / 1000.0,
+                           latency_hist_percentile(hist, 0.999) / 1000.0);
+                }
+            }
+        }
+    }
+    delete hist;
+}
+
+int main(int argc, char **argv) {
+    std::vector<pid_t> pids;
+    for (int i = 1; i < argc; i++) {
+        pids.push_back((pid_t)atoi(argv[i]));
+    }
+    const shared_resources *shm = open_shm();
+    if (shm) {
+        print_tick_stats(shm);
+        if (pids.empty()) {
+            pids = registered_pids(shm);
+        }
+        munmap(const_cast<shared_resources *>(shm), SHM_SIZE);
+    }
+    if (pids.empty()) {
+        printf("No Astraea app is registered\n");
+        return EXIT_SUCCESS;
+    }
+
+    int ret = EXIT_SUCCESS;
+    for (pid_t pid : pids) {
+        const task_stats *stats;
+        doca_error_t status = task_stats_open(pid, &stats);
+        if (status != DOCA_SUCCESS) {
+            printf("No task stats for pid %d: %s\n", (int)pid,
+                   doca_error_get_descr(status));
+            ret = EXIT_FAILURE;
+            continue;
+        }
+        print_stats(stats);
+        task_stats_close(stats);
+    }
+    return ret;
+}
@@ -22,6 +22,10 @@
 
 #include "common.h"
 
+#ifdef USE_ASTRAEA
+#include <astraea.h>
+#endif
+
 DOCA_LOG_REGISTER(EC_RECOVER);
 
 int total_pos, total_time[10];
@@ -76,7 +80,13 @@ struct ec_sample_objects {
         *src_doca_buf; /* Source doca buffer as input for the task */
     struct doca_buf
         *dst_doca_buf;  /* Destination doca buffer as input for the task */
+#ifdef USE_ASTRAEA
+    struct astraea_pe *pe;   /* Astraea progress engine of the ec context */
+    struct astraea_ec *ec;   /* Astraea Erasure coding context */
+    struct astraea_ctx *ctx; /* Astraea context of ec */
+#else
     struct doca_ec *ec; /* DOCA Erasure coding context */
+#endif
     char
         *src_buffer; /* Source memory region to be used as input for the task */
     char *dst_buffer; /* Destination memory region to be used as output for task
@@ -87,10 +97,15 @@ struct ec_sample_objects {
         missing_indices; /* Data indices to that are missing and need recover */
     FILE *out_file;      /* Recovered file pointer to write to */
     FILE *block_file;    /* Block file pointer to write to */
+#ifdef USE_ASTRAEA
+    struct astraea_ec_matrix *encoding_matrix; /* Encoding matrix */
+    struct astraea_ec_matrix *decoding_matrix; /* Decoding matrix */
+#else
     struct doca_ec_matrix *encoding_matrix; /* Encoding matrix that will be use
                                                to create the redundancy */
     struct doca_ec_matrix *decoding_matrix; /* Decoding matrix that will be use
                                                to recover the data */
+#endif
     struct program_core_objects core_state; /* DOCA core objects - please refer
                                                to struct program_core_objects */
     bool run_pe_progress; /* Controls whether progress loop should run */
@@ -132,6 +147,45 @@ static void ec_cleanup(struct ec_sample_objects *state) {
         fclose(state->out_file);
     if (state->block_file != NULL)
         fclose(state->block_file);
+#ifdef USE_ASTRAEA
+    if (state->encoding_matrix != NULL) {
+        result = astraea_ec_matrix_destroy(state->encoding_matrix);
+        if (result != DOCA_SUCCESS)
+            DOCA_LOG_ERR("Failed to destroy ec encoding matrix: %s",
+                         doca_error_get_descr(result));
+    }
+    if (state->decoding_matrix != NULL) {
+        result = astraea_ec_matrix_destroy(state->decoding_matrix);
+        if (result != DOCA_SUCCESS)
+            DOCA_LOG_ERR("Failed to destroy ec decoding matrix: %s",
+                         doca_error_get_descr(result));
+    }
+
+    if (state->ctx != NULL) {
+        result = astraea_ctx_stop(state->ctx);
+        /* Finish the inflight strips before destroying ec and pe */
+        while (result == DOCA_ERROR_IN_PROGRESS) {
+            (void)astraea_pe_progress(state->pe);
+            result = astraea_ctx_stop(state->ctx);
+        }
+        if (result != DOCA_SUCCESS)
+            DOCA_LOG_ERR("Unable to stop context: %s",
+                         doca_error_get_descr(result));
+        state->ctx = NULL;
+    }
+    if (state->ec != NULL) {
+        result = astraea_ec_destroy(state->ec);
+        if (result != DOCA_SUCCESS)
+            DOCA_LOG_ERR("Failed to destroy ec: %s",
+                         doca_error_get_descr(result));
+    }
+    if (state->pe != NULL) {
+        result = astraea_pe_destroy(state->pe);
+        if (result != DOCA_SUCCESS)
+            DOCA_LOG_ERR("Failed to destroy astraea pe: %s",
+                         doca_error_get_descr(result));
+    }
+#else
     if (state->encoding_matrix != NULL) {
         result = doca_ec_matrix_destroy(state->encoding_matrix);
         if (result != DOCA_SUCCESS)
@@ -158,6 +212,7 @@ static void ec_cleanup(struct ec_sample_objects *state) {
             DOCA_LOG_ERR("Failed to destroy ec: %s",
                          doca_error_get_descr(result));
     }
+#endif
 
     result = destroy_core_objects(&state->core_state);
     if (result != DOCA_SUCCESS) {
@@ -166,6 +221,7 @@ static void ec_cleanup(struct ec_sample_objects *state) {
     }
 }
 
+#ifndef USE_ASTRAEA
 /**
  * Callback triggered whenever Erasure Coding context state changes
  *
@@ -219,6 +275,7 @@ static void ec_state_changed_callback(const union doca_data user_data,
         break;
     }
 }
+#endif
 
 /**
  * Init ec core objects.
@@ -247,7 +304,14 @@ static doca_error_t ec_core_init(struct ec_sample_objects *state,
     result = create_core_objects(&state->core_state, max_bufs);
     ASSERT_DOCA_ERR(result, state, "Failed to init core");
 
+#ifdef USE_ASTRAEA
+    result = astraea_pe_create(&state->pe);
+    ASSERT_DOCA_ERR(result, state, "Unable to create astraea pe");
+
+    result = astraea_ec_create(state->core_state.dev, &state->ec);
+#else
     result = doca_ec_create(state->core_state.dev, &state->ec);
+#endif
     ASSERT_DOCA_ERR(result, state, "Unable to create ec engine");
 
     result = doca_ec_cap_get_max_block_size(
@@ -255,11 +319,19 @@ static doca_error_t ec_core_init(struct ec_sample_objects *state,
     ASSERT_DOCA_ERR(result, state,
                     "Unable to query maximum block size supported");
 
+#ifdef USE_ASTRAEA
+    state->ctx = astraea_ec_as_ctx(state->ec);
+    SAMPLE_ASSERT(state->ctx != NULL, DOCA_ERROR_UNEXPECTED, state,
+                  "Unable to retrieve ctx");
+
+    result = astraea_pe_connect_ctx(state->pe, state->ctx);
+#else
     state->core_state.ctx = doca_ec_as_ctx(state->ec);
     SAMPLE_ASSERT(state->core_state.ctx != NULL, DOCA_ERROR_UNEXPECTED, state,
                   "Unable to retrieve ctx");
 
     result = doca_pe_connect_ctx(state->core_state.pe, state->core_state.ctx);
+#endif
     ASSERT_DOCA_ERR(result, state,
                     "Unable to connect context to progress engine");
 
@@ -299,6 +371,13 @@ static doca_error_t ec_core_init(struct ec_sample_objects *state,
 
     /* Include state in user data of context to be used in callbacks */
     ctx_user_data.ptr = state;
+#ifdef USE_ASTRAEA
+    result = astraea_ctx_set_user_data(state->ctx, ctx_user_data);
+    ASSERT_DOCA_ERR(result, state, "Unable to set user data to context");
+
+    /* Astraea stops progressing from the task callbacks instead */
+    return DOCA_SUCCESS;
+#else
     result = doca_ctx_set_user_data(state->core_state.ctx, ctx_user_data);
     ASSERT_DOCA_ERR(result, state, "Unable to set user data to context");
 
@@ -309,8 +388,14 @@ static doca_error_t ec_core_init(struct ec_sample_objects *state,
     ASSERT_DOCA_ERR(result, state, "Unable to set state change callback");
 
     return DOCA_SUCCESS;
+#endif
 }
 
+#ifdef USE_ASTRAEA
+typedef astraea_ec_task_recover ec_task_recover_t;
+#else
+typedef struct doca_ec_task_recover ec_task_recover_t;
+
 /*
  * EC tasks mutual error callback
  *
@@ -332,6 +417,7 @@ static void ec_task_error(struct doca_task *task, doca_error_t *task_status,
     /* Stop context once task is completed */
     (void)doca_ctx_stop(doca_task_get_ctx(task));
 }
+#endif
 
 /*
  * All the necessary variables for EC recover task callback functions defined in
@@ -362,14 +448,26 @@ struct recover_task_data {
  * @task_user_data [in]: doca_data from the task
  * @ctx_user_data [in]: doca_data from the context
  */
-static void ec_recover_error_callback(struct doca_ec_task_recover *recover_task,
+static void ec_recover_error_callback(ec_task_recover_t *recover_task,
                                       union doca_data task_user_data,
                                       union doca_data ctx_user_data) {
     struct recover_task_data *task_data = task_user_data.ptr;
+#ifdef USE_ASTRAEA
+    struct ec_sample_objects *state = ctx_user_data.ptr;
+    (void)recover_task;
+
+    *task_data->task_status = DOCA_ERROR_UNEXPECTED;
+    DOCA_LOG_ERR("EC Task finished unsuccessfully");
+    *task_data->cb_result = DOCA_SUCCESS;
+
+    /* Astraea recycles the task, the context is stopped in ec_cleanup */
+    state->run_pe_progress = false;
+#else
     (void)ctx_user_data;
 
     ec_task_error(doca_ec_task_recover_as_task(recover_task),
                   task_data->task_status, task_data->cb_result);
+#endif
 }
 
 int nb_finished_tasks, total_nb_tasks;
@@ -383,7 +481,7 @@ struct timespec begin_time, end_time;
  * @ctx_user_data [in]: doca_data from the context
  */
 static void
-ec_recover_completed_callback(struct doca_ec_task_recover *recover_task,
+ec_recover_completed_callback(ec_task_recover_t *recover_task,
                               union doca_data task_user_data,
                               union doca_data ctx_user_data) {
     (void)recover_task;
@@ -405,14 +503,20 @@ ec_recover_completed_callback(struct doca_ec_task_recover *recover_task,
 
     *task_data->cb_result = DOCA_SUCCESS;
 
+#ifndef USE_ASTRAEA
     /* Free task */
     doca_task_free(doca_ec_task_recover_as_task(recover_task));
+#endif
 
     if (nb_finished_tasks == total_nb_tasks) {
         clock_gettime(CLOCK_REALTIME, &end_time);
         total_time[total_pos++] = 1e9 * (end_time.tv_sec - begin_time.tv_sec) +
                                   (end_time.tv_nsec - begin_time.tv_nsec);
+#ifdef USE_ASTRAEA
+        state->run_pe_progress = false;
+#else
         (void)doca_ctx_stop(state->core_state.ctx);
+#endif
     }
 }
 
@@ -560,36 +664,62 @@ doca_error_t ec_decode(const char *pci_addr, const char *user_output_file_path,
         block_size, max_block_size);
 
     /* Set task configuration */
+#ifdef USE_ASTRAEA
+    result = astraea_ec_task_recover_set_conf(
+        state->ec, ec_recover_completed_callback, ec_recover_error_callback,
+        NUM_EC_TASKS);
+#else
     result =
         doca_ec_task_recover_set_conf(state->ec, ec_recover_completed_callback,
                                       ec_recover_error_callback, NUM_EC_TASKS);
+#endif
     ASSERT_DOCA_ERR(result, state,
                     "Unable to set configuration for recover tasks");
 
     /* Start the task */
+#ifdef USE_ASTRAEA
+    result = astraea_ctx_start(state->ctx);
+#else
     result = doca_ctx_start(state->core_state.ctx);
+#endif
     ASSERT_DOCA_ERR(result, state, "Unable to start context");
 
     /* Create a matrix for the task */
+#ifdef USE_ASTRAEA
+    result = astraea_ec_matrix_create(state->ec, DOCA_EC_MATRIX_TYPE_CAUCHY,
+                                      data_block_count, rdnc_block_count,
+                                      &state->encoding_matrix);
+#else
     result = doca_ec_matrix_create(state->ec, DOCA_EC_MATRIX_TYPE_CAUCHY,
                                    data_block_count, rdnc_block_count,
                                    &state->encoding_matrix);
+#endif
     ASSERT_DOCA_ERR(result, state, "Unable to create ec matrix");
 
+#ifdef USE_ASTRAEA
+    result = astraea_ec_matrix_create_recover(
+        state->ec, state->encoding_matrix, state->missing_indices, n_missing,
+        &state->decoding_matrix);
+#else
     result = doca_ec_matrix_create_recover(state->ec, state->encoding_matrix,
                                            state->missing_indices, n_missing,
                                            &state->decoding_matrix);
+#endif
     ASSERT_DOCA_ERR(result, state, "Unable to create recovery matrix");
 
     /* Include all necessary parameters for completion callback in user data of
      * task */
     doca_error_t task_status = DOCA_SUCCESS;
     doca_error_t callback_result = DOCA_SUCCESS;
+#ifdef USE_ASTRAEA
+    struct astraea_task *doca_tasks[NUM_EC_TASKS];
+#else
     struct doca_task *doca_tasks[NUM_EC_TASKS];
+#endif
 
     /* Construct EC recover tasks */
     for (int k = 0; k < total_nb_tasks; k++) {
-        struct doca_ec_task_recover *task;
+        ec_task_recover_t *task;
         struct recover_task_data task_data;
         union doca_data user_data;
 
@@ -607,12 +737,23 @@ doca_error_t ec_decode(const char *pci_addr, const char *user_output_file_path,
 
         user_data.ptr = &task_data;
 
+#ifdef USE_ASTRAEA
+        result = astraea_ec_task_recover_allocate_init(
+            state->ec, state->decoding_matrix, state->core_state.src_mmap,
+            state->core_state.dst_mmap, state->src_doca_buf,
+            state->dst_doca_buf, user_data, &task);
+#else
         result = doca_ec_task_recover_allocate_init(
             state->ec, state->decoding_matrix, state->src_doca_buf,
             state->dst_doca_buf, user_data, &task);
+#endif
         ASSERT_DOCA_ERR(result, state, "Unable to allocate and initiate task");
 
+#ifdef USE_ASTRAEA
+        doca_tasks[k] = astraea_ec_task_recover_as_task(task);
+#else
         doca_tasks[k] = doca_ec_task_recover_as_task(task);
+#endif
         SAMPLE_ASSERT(doca_tasks[k] != NULL, DOCA_ERROR_UNEXPECTED, state,
                       "Unable to retrieve task as doca_task");
     }
@@ -620,7 +761,11 @@ doca_error_t ec_decode(const char *pci_addr, const char *user_output_file_path,
     clock_gettime(CLOCK_REALTIME, &begin_time);
     /* Enqueue ec recover tasks */
     for (int k = 0; k < total_nb_tasks; k++) {
+#ifdef USE_ASTRAEA
+        result = astraea_task_submit(doca_tasks[k]);
+#else
         result = doca_task_submit(doca_tasks[k]);
+#endif
         ASSERT_DOCA_ERR(result, state, "Unable to submit task");
     }
 
@@ -628,7 +773,11 @@ doca_error_t ec_decode(const char *pci_addr, const char *user_output_file_path,
 
     /* Wait for recover task completion and for context to return to idle */
     while (state->run_pe_progress) {
+#ifdef USE_ASTRAEA
+        if (astraea_pe_progress(state->pe) == 0)
+#else
         if (doca_pe_progress(state->core_state.pe) == 0)
+#endif
             nanosleep(&ts, &ts);
     }
 
@@ -643,6 +792,7 @@ doca_error_t ec_decode(const char *pci_addr, const char *user_output_file_path,
                      doca_error_get_descr(callback_result));
 
     /* The task was already freed and the context was stopped in the callbacks
+     * Under Astraea, the task was recycled and ec_cleanup stops the context
      */
 
     /* Clean and destroy all relevant objects */
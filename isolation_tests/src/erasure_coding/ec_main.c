@@ -10,6 +10,10 @@
 
 #include <utils.h>
 
+#ifdef USE_ASTRAEA
+#include <astraea.h>
+#endif
+
 DOCA_LOG_REGISTER(EC_RECOVER::MAIN);
 
 #define USER_MAX_PATH_NAME 255 /* max file name length */
@@ -26,6 +30,9 @@ struct ec_cfg {
     uint32_t data_block_count;                    /* data block count */
     uint32_t rdnc_block_count;                    /* redundancy block count */
     int total_nb_tasks;
+#ifdef USE_ASTRAEA
+    uint32_t latency; /* latency SLA of each task in us */
+#endif
 };
 
 /* Sample's Logic */
@@ -106,6 +113,26 @@ static doca_error_t nb_tasks_callback(void *param, void *config) {
     return DOCA_SUCCESS;
 }
 
+#ifdef USE_ASTRAEA
+/*
+ * ARGP Callback - Handle latency SLA parameter
+ *
+ * @param [in]: Input parameter
+ * @config [in/out]: Program configuration context
+ * @return: DOCA_SUCCESS on success and DOCA_ERROR otherwise
+ */
+static doca_error_t latency_callback(void *param, void *config) {
+    struct ec_cfg *ec_cfg = (struct ec_cfg *)config;
+
+    if (*(int *)param <= 0) {
+        DOCA_LOG_ERR("Latency should be bigger than 0");
+        return DOCA_ERROR_INVALID_VALUE;
+    }
+    ec_cfg->latency = *(int *)param;
+    return DOCA_SUCCESS;
+}
+#endif
+
 /*
  * Register the command line parameters for the sample.
  *
@@ -115,6 +142,9 @@ static doca_error_t register_ec_params(void) {
     doca_error_t result;
     struct doca_argp_param *output_path_param, *data_block_count_param,
         *rdnc_block_count_param, *total_nb_tasks_param;
+#ifdef USE_ASTRAEA
+    struct doca_argp_param *latency_param;
+#endif
 
     result = doca_argp_param_create(&output_path_param);
     if (result != DOCA_SUCCESS) {
@@ -194,6 +224,27 @@ static doca_error_t register_ec_params(void) {
         return result;
     }
 
+#ifdef USE_ASTRAEA
+    result = doca_argp_param_create(&latency_param);
+    if (result != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to create ARGP param: %s",
+                     doca_error_get_descr(result));
+        return result;
+    }
+    doca_argp_param_set_short_name(latency_param, "l");
+    doca_argp_param_set_long_name(latency_param, "latency");
+    doca_argp_param_set_description(latency_param,
+                                    "Latency SLA in us - default: 1000");
+    doca_argp_param_set_callback(latency_param, latency_callback);
+    doca_argp_param_set_type(latency_param, DOCA_ARGP_TYPE_INT);
+    result = doca_argp_register_param(latency_param);
+    if (result != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to register program param: %s",
+                     doca_error_get_descr(result));
+        return result;
+    }
+#endif
+
     return DOCA_SUCCESS;
 }
 
@@ -236,6 +287,9 @@ int main(int argc, char **argv) {
     ec_cfg.data_block_count = 2; /* data block count */
     ec_cfg.rdnc_block_count = 2; /* redundancy block count */
     ec_cfg.total_nb_tasks = 10;
+#ifdef USE_ASTRAEA
+    ec_cfg.latency = 1000;
+#endif
 
     result = doca_argp_init("doca_erasure_coding_recover", &ec_cfg);
     if (result != DOCA_SUCCESS) {
@@ -258,9 +312,22 @@ int main(int argc, char **argv) {
         goto argp_cleanup;
     }
 
+#ifdef USE_ASTRAEA
+    /* The scheduler must be running */
+    result = astraea_register(ec_cfg.latency);
+    if (result != DOCA_SUCCESS) {
+        DOCA_LOG_ERR("Failed to register to astraea: %s",
+                     doca_error_get_descr(result));
+        goto argp_cleanup;
+    }
+#endif
+
     result = ec_recover(ec_cfg.pci_address, ec_cfg.output_path,
                         ec_cfg.data_block_count, ec_cfg.rdnc_block_count,
                         ec_cfg.total_nb_tasks);
+#ifdef USE_ASTRAEA
+    astraea_deregister();
+#endif
     if (result != DOCA_SUCCESS) {
         DOCA_LOG_ERR("ec_recover() encountered an error: %s",
                      doca_error_get_descr(result));